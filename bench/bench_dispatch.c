@@ -0,0 +1,103 @@
+/*
+ * uTask benchmarks
+ *
+ * Description:
+ * Dispatch cost of the message loop.  One task sends itself BENCH_MSGS
+ * messages, each carrying an 8 to 64 byte pool block that the handler
+ * writes before the send and reads when it arrives, so the run exercises
+ * uTaskAlloc, uTaskMessageSend, the loop and uTaskFree together.  The
+ * Makefile builds it with the default pool, with UTASK_POOL_ALIGN 64 and
+ * with UTASK_POOL_HUGEPAGE as well.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "utask.h"
+
+#define BENCH_MSGS      2000000L
+
+static long gLeft;
+static unsigned int gSink;
+
+static double
+Now(
+    void
+    )
+{
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+
+    return Ts.tv_sec * 1e9 + Ts.tv_nsec;
+}
+
+/* Id is the size of the block in pMsg */
+static void
+Handler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    unsigned char *p = pMsg;
+    void *pNext;
+    int Size;
+
+    if (p)
+    {
+        gSink = gSink + p[0] + p[Id-1];
+    }
+
+    gLeft = gLeft - 1;
+
+    if (gLeft <= 0)
+    {
+        uTaskDtor();
+        return;
+    }
+
+    Size = 8 << (gLeft & 3);
+    pNext = uTaskAlloc(Size);
+
+    if (pNext)
+    {
+        memset(pNext, (int)gLeft, Size);
+    }
+
+    uTaskMessageSend(pTask, pNext ? Size : 1, pNext, UTASK_IMMEDIATE);
+}
+
+static uTask_T gTask = {Handler};
+
+int
+main(
+    void
+    )
+{
+    double Start;
+    double Ready;
+    double End;
+
+    Start = Now();
+
+    if (uTaskCtor() != UTASK_S_OK)
+    {
+        printf("uTaskCtor failed\n");
+        return 1;
+    }
+
+    Ready = Now();
+
+    gLeft = BENCH_MSGS;
+    uTaskMessageSend(&gTask, 1, NULL, UTASK_IMMEDIATE);
+    uTaskMessageLoop();
+
+    End = Now();
+
+    printf("align %3d hugepage %d: uTaskCtor %8.1f us, %5.1f ns/msg\n",
+           UTASK_POOL_ALIGN, UTASK_POOL_HUGEPAGE, (Ready - Start) / 1e3,
+           (End - Ready) / BENCH_MSGS);
+
+    return 0;
+}
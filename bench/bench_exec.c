@@ -0,0 +1,114 @@
+/*
+ * uTask benchmarks
+ *
+ * Description:
+ * Scaling of the work-stealing executor.  BENCH_TASKS independent tasks
+ * each send themselves messages until BENCH_MSGS have been handled, every
+ * handler does BENCH_WORK rounds of arithmetic so the run is not only
+ * queueing.  The same load runs on 1 up to UTASK_EXEC_WORKERS workers and
+ * the speedup over one worker is printed.  Workers beyond the number of
+ * online cpus share them, so only the rows up to that count show scaling.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "utask.h"
+
+#define BENCH_TASKS     64
+#define BENCH_MSGS      2000000L
+#define BENCH_WORK      200
+
+static long gLeft;
+static unsigned int gSink[BENCH_TASKS];
+
+static double
+Now(
+    void
+    )
+{
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+
+    return Ts.tv_sec * 1e9 + Ts.tv_nsec;
+}
+
+static uTask_T gTask[BENCH_TASKS];
+
+/* Id is the index of the task, its sink is only touched by its handler */
+static void
+Handler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    unsigned int x = gSink[Id];
+    int i;
+
+    for (i = 0; i < BENCH_WORK; i = i + 1)
+    {
+        x = x * 1664525u + 1013904223u;
+    }
+
+    gSink[Id] = x;
+
+    if (__atomic_sub_fetch(&gLeft, 1, __ATOMIC_RELAXED) == 0)
+    {
+        uTaskDtor();
+        return;
+    }
+
+    uTaskMessageSend(pTask, Id, NULL, UTASK_IMMEDIATE);
+}
+
+int
+main(
+    void
+    )
+{
+    double Start;
+    double Base = 0;
+    double Rate;
+    int Workers;
+    int i;
+
+    printf("%ld online cpus, %d tasks, %ld messages\n",
+           sysconf(_SC_NPROCESSORS_ONLN), BENCH_TASKS, BENCH_MSGS);
+
+    for (i = 0; i < BENCH_TASKS; i = i + 1)
+    {
+        gTask[i].Handler = Handler;
+    }
+
+    for (Workers = 1; Workers <= UTASK_EXEC_WORKERS; Workers = Workers + 1)
+    {
+        if (uTaskCtor() != UTASK_S_OK || uTaskExecCtor(Workers) != UTASK_S_OK)
+        {
+            printf("uTaskCtor failed\n");
+            return 1;
+        }
+
+        gLeft = BENCH_MSGS;
+
+        for (i = 0; i < BENCH_TASKS; i = i + 1)
+        {
+            uTaskMessageSend(&gTask[i], i, NULL, UTASK_IMMEDIATE);
+        }
+
+        Start = Now();
+        uTaskExecRun();
+        Rate = BENCH_MSGS / ((Now() - Start) / 1e9);
+
+        if (Workers == 1)
+        {
+            Base = Rate;
+        }
+
+        printf("%2d workers: %6.2f M msg/s, speedup %5.2f\n",
+               Workers, Rate / 1e6, Rate / Base);
+    }
+
+    return 0;
+}
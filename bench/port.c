@@ -0,0 +1,54 @@
+/*
+ * uTask benchmarks
+ *
+ * Description:
+ * Port functions for the benchmarks.  Builds with the executor use a
+ * recursive mutex as the interrupt lock, the cost a multi-threaded host
+ * pays.  Single threaded builds take no lock, like a target where
+ * disabling interrupts is a couple of instructions.
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include "utask.h"
+
+#if UTASK_EXEC_WORKERS
+
+static pthread_mutex_t gPortLock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+int
+uTaskInterruptDisable(
+    void
+    )
+{
+    pthread_mutex_lock(&gPortLock);
+    return 0;
+}
+
+void
+uTaskInterruptRestore(
+    int             PrevState
+    )
+{
+    (void)PrevState;
+    pthread_mutex_unlock(&gPortLock);
+}
+
+#else
+
+int
+uTaskInterruptDisable(
+    void
+    )
+{
+    return 0;
+}
+
+void
+uTaskInterruptRestore(
+    int             PrevState
+    )
+{
+    (void)PrevState;
+}
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Port functions for the tests.  A recursive mutex stands in for disabling
+ * interrupts, so tests that run several threads are safe.  Tests built with
+ * UTASK_PORT_POSIX use the port in utask.c instead.
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include "utask.h"
+
+#if !UTASK_PORT_POSIX
+
+static pthread_mutex_t gPortLock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+int
+uTaskInterruptDisable(
+    void
+    )
+{
+    pthread_mutex_lock(&gPortLock);
+    return 0;
+}
+
+void
+uTaskInterruptRestore(
+    int             PrevState
+    )
+{
+    (void)PrevState;
+    pthread_mutex_unlock(&gPortLock);
+}
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Check helpers shared by the tests in this directory.  Each test is a
+ * program built with utask.c and the utask.h settings it needs, see the
+ * Makefile.  It prints every check that fails and exits with 1 if any did.
+ */
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+static int gTestFailed;
+
+/* Record a failed check and carry on with the test */
+#define CHECK(c)\
+    do\
+    {\
+        if (!(c))\
+        {\
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #c);\
+            gTestFailed = gTestFailed + 1;\
+        }\
+    } while (0)
+
+/* Print the result, returns the exit status of the test */
+#define TEST_DONE()\
+    (printf("%s: %s\n", __FILE__, gTestFailed ? "FAILED" : "ok"),\
+     gTestFailed ? 1 : 0)
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Typed messages and posted closures from utask.hpp, C++14, built with
+ * UTASK_TCB_SLOTS 8 so the task control blocks can run out.  An actor gets
+ * an aggregate, an empty and a counted message type, the counts show that
+ * every payload built is destroyed once, also when the send fails.
+ */
+#include "utask.hpp"
+#include "test.h"
+
+static int gCtors;
+static int gDtors;
+
+/* Counts its constructions and destructions */
+struct Tracked
+{
+    int     Value;
+
+    explicit Tracked(int Value) noexcept : Value(Value)
+    {
+        gCtors = gCtors + 1;
+    }
+
+    Tracked(Tracked &&Other) noexcept : Value(Other.Value)
+    {
+        gCtors = gCtors + 1;
+    }
+
+    ~Tracked() { gDtors = gDtors + 1; }
+};
+
+struct Start
+{
+    int     Speed;
+};
+
+struct Stop
+{
+};
+
+class Motor : public utask::actor<Motor, Start, Stop, Tracked>
+{
+public:
+    void
+    on(
+        const Start     &Msg
+        )
+    {
+        m_Speed = Msg.Speed;
+    }
+
+    void
+    on(
+        const Stop      &
+        )
+    {
+        m_StopTick = uTaskGetTick();
+        uTaskDtor();
+    }
+
+    void
+    on(
+        const Tracked   &Msg
+        )
+    {
+        m_Tracked = m_Tracked + Msg.Value;
+        m_Alive = gCtors - gDtors;
+    }
+
+    int             m_Speed = 0;
+    int             m_Tracked = 0;
+    int             m_Alive = 0;
+    unsigned long   m_StopTick = 0;
+};
+
+static Motor gMotor;
+static int gPosted;
+static unsigned long gPostTick;
+
+static void
+TickHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    uTaskTick();
+    uTaskMessageSend(pTask, 0, NULL, UTASK_IMMEDIATE);
+}
+
+static uTask_T gTicker = {TickHandler};
+
+static void
+IdleHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+}
+
+static uTask_T gIdle = {IdleHandler};
+
+static int
+PoolFull(
+    void
+    )
+{
+    uTaskPoolStats_T Stats;
+    int i;
+
+    for (i = 0; uTaskPoolStats(i, &Stats) == UTASK_S_OK; i = i + 1)
+    {
+        if (Stats.uFree != Stats.uCount)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int
+main(
+    void
+    )
+{
+    int Dtors;
+    int i;
+
+    static_assert(Motor::id<Start> == 0 && Motor::id<Stop> == 1 &&
+                  Motor::id<Tracked> == 2, "ids follow the type list");
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    CHECK(utask::send<Start>(gMotor, 100));
+    CHECK(utask::send<Tracked>(gMotor, 5));
+    CHECK(utask::post([] { gPosted = gPosted + 1; }));
+    CHECK(utask::post([T = Tracked(7)] { gPosted = gPosted + T.Value; }));
+
+    CHECK(utask::post_after(3, [] { gPostTick = uTaskGetTick(); }));
+    CHECK(utask::send_after<Stop>(gMotor, 5));
+    uTaskMessageSend(&gTicker, 0, NULL, UTASK_IMMEDIATE);
+
+    uTaskMessageLoop();
+
+    CHECK(gMotor.m_Speed == 100);
+    CHECK(gMotor.m_Tracked == 5);
+
+    /* In on() the payload and the capture still waiting to run were alive */
+    CHECK(gMotor.m_Alive == 2);
+    CHECK(gPosted == 8);
+    CHECK(gPostTick >= 3 && gPostTick < gMotor.m_StopTick);
+    CHECK(gMotor.m_StopTick >= 5);
+    CHECK(gCtors == gDtors);
+    CHECK(PoolFull());
+
+    /* Without a free tcb the payload built for the send is destroyed */
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    for (i = 0; i < 8; i = i + 1)
+    {
+        CHECK(uTaskMessageSend(&gIdle, 0, NULL, 100) == UTASK_S_OK);
+    }
+
+    Dtors = gDtors;
+
+    CHECK(!utask::send<Tracked>(gMotor, 1));
+    CHECK(!utask::post([T = Tracked(1)] { gPosted = gPosted + T.Value; }));
+    CHECK(gCtors == gDtors);
+    CHECK(gDtors > Dtors);
+    CHECK(PoolFull());
+
+    return TEST_DONE();
+}
@@ -0,0 +1,172 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Tasks pinned to executor workers with Affinity, built with
+ * UTASK_EXEC_WORKERS 4.  Tokens hop around a ring of tasks pinned to
+ * different workers, so most sends go through the target worker's inbox
+ * and have to wake it.  The handlers check that a pinned task only runs on
+ * its own worker's thread.
+ */
+#include <pthread.h>
+#include "utask.h"
+#include "test.h"
+
+#define RING            8
+#define TOKENS          4
+#define HOPS            4000
+
+static uTask_T gRing[RING];
+static uTask_T gFree;
+static uTaskStrand_T gPair;
+static uTask_T gPairTask[2];
+static pthread_t gMain;
+static pthread_t gThread[4];
+static int gSeen[4];
+static int gWrong;
+static int gOverlap;
+static int gPairBusy;
+static int gPairRuns;
+static int gFreeRuns;
+static int gHops;
+static int gDone;
+
+/* Check that worker Affinity-1 always runs on the same thread */
+static void
+CheckWorker(
+    int             Affinity
+    )
+{
+    int w = Affinity - 1;
+
+    if (!gSeen[w])
+    {
+        gThread[w] = pthread_self();
+        __atomic_store_n(&gSeen[w], 1, __ATOMIC_RELEASE);
+    }
+    else if (!pthread_equal(gThread[w], pthread_self()))
+    {
+        __atomic_add_fetch(&gWrong, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* Id counts down the hops left for the token */
+static void
+RingHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    int i = (int)(pTask - gRing);
+
+    CheckWorker(pTask->Affinity);
+    __atomic_add_fetch(&gHops, 1, __ATOMIC_RELAXED);
+
+    if (Id > 0)
+    {
+        CHECK(uTaskMessageSend(&gRing[(i + 1) % RING], Id - 1, NULL,
+                               UTASK_IMMEDIATE) == UTASK_S_OK);
+
+        /* An unpinned task sends into the pinned pair now and then */
+        if (Id % 16 == 0)
+        {
+            uTaskMessageSend(&gFree, 0, NULL, UTASK_IMMEDIATE);
+        }
+    }
+    else if (__atomic_add_fetch(&gDone, 1, __ATOMIC_RELAXED) == TOKENS)
+    {
+        uTaskDtor();
+    }
+}
+
+static void
+FreeHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    gFreeRuns = gFreeRuns + 1;
+    uTaskMessageSend(&gPairTask[gFreeRuns & 1], 0, NULL, UTASK_IMMEDIATE);
+}
+
+/* Both tasks are on a strand pinned to worker 3 */
+static void
+PairHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    if (__atomic_exchange_n(&gPairBusy, 1, __ATOMIC_ACQUIRE))
+    {
+        __atomic_add_fetch(&gOverlap, 1, __ATOMIC_RELAXED);
+    }
+
+    CheckWorker(3);
+    gPairRuns = gPairRuns + 1;
+
+    __atomic_store_n(&gPairBusy, 0, __ATOMIC_RELEASE);
+}
+
+int
+main(
+    void
+    )
+{
+    int i;
+    int k;
+
+    gMain = pthread_self();
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    CHECK(uTaskExecCtor(4) == UTASK_S_OK);
+
+    for (i = 0; i < RING; i = i + 1)
+    {
+        gRing[i].Handler = RingHandler;
+        gRing[i].Affinity = 1 + i % 4;
+    }
+
+    gFree.Handler = FreeHandler;
+
+    /* The strand's Affinity is used, not the tasks' own */
+    uTaskStrandInit(&gPair, 3);
+
+    for (i = 0; i < 2; i = i + 1)
+    {
+        gPairTask[i].Handler = PairHandler;
+        gPairTask[i].Affinity = 2;
+        uTaskStrandJoin(&gPairTask[i], &gPair);
+    }
+
+    for (i = 0; i < TOKENS; i = i + 1)
+    {
+        CHECK(uTaskMessageSend(&gRing[i * 2], HOPS, NULL, UTASK_IMMEDIATE) ==
+              UTASK_S_OK);
+    }
+
+    uTaskExecRun();
+
+    CHECK(gDone == TOKENS);
+    CHECK(gHops == TOKENS * (HOPS + 1));
+    CHECK(gWrong == 0);
+    CHECK(gOverlap == 0);
+    CHECK(gPairRuns > 0);
+
+    /* Worker 0 is the calling thread, every worker has its own thread */
+    CHECK(gSeen[0] && pthread_equal(gThread[0], gMain));
+
+    for (i = 0; i < 4; i = i + 1)
+    {
+        CHECK(gSeen[i]);
+
+        for (k = 0; k < i; k = k + 1)
+        {
+            CHECK(!pthread_equal(gThread[k], gThread[i]));
+        }
+    }
+
+    return TEST_DONE();
+}
@@ -0,0 +1,74 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Cache line aligned pool blocks in a huge page arena, built with
+ * UTASK_POOL_ALIGN 64 and UTASK_POOL_HUGEPAGE.
+ */
+#include <stdint.h>
+#include "utask.h"
+#include "test.h"
+
+#define BLOCKS          30      /* 16 + 8 + 4 + 2 in the default pools */
+
+int
+main(
+    void
+    )
+{
+    void *p[BLOCKS];
+    uintptr_t Lowest = UINTPTR_MAX;
+    uintptr_t a;
+    uintptr_t b;
+    int Sizes[4] = {8, 16, 32, 64};
+    int i;
+    int k;
+    int n = 0;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    /* Every block of every pool starts a cache line of its own */
+    for (i = 0; i < 4; i = i + 1)
+    {
+        for (k = 0; k < (16 >> i); k = k + 1)
+        {
+            p[n] = uTaskAlloc(Sizes[i]);
+            CHECK(p[n] != NULL);
+            n = n + 1;
+        }
+    }
+
+    for (i = 0; i < n; i = i + 1)
+    {
+        a = (uintptr_t)p[i];
+
+        CHECK(a % 64 == 0);
+
+        if (a < Lowest)
+        {
+            Lowest = a;
+        }
+
+        for (k = 0; k < i; k = k + 1)
+        {
+            b = (uintptr_t)p[k];
+            CHECK(a / 64 != b / 64);
+        }
+    }
+
+    /* The arena starts on a huge page boundary */
+    CHECK(Lowest % (2UL * 1024 * 1024) == 0);
+
+    /* A second uTaskCtor keeps the arena */
+    for (i = 0; i < n; i = i + 1)
+    {
+        uTaskFree(p[i]);
+    }
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    a = (uintptr_t)uTaskAlloc(64);
+    CHECK(a >= Lowest && a < Lowest + 2UL * 1024 * 1024);
+
+    return TEST_DONE();
+}
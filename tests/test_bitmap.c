@@ -0,0 +1,86 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Bitmap indexed pools, built with UTASK_POOL_BITMAP and a first pool of
+ * 70 blocks so its bitmap spans three words.
+ */
+#include <string.h>
+#include "utask.h"
+#include "test.h"
+
+int
+main(
+    void
+    )
+{
+    uTaskPoolStats_T Stats;
+    unsigned char *p[70];
+    unsigned char *pOne;
+    int i;
+    int k;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    /* Every block once, lowest free block first */
+    for (i = 0; i < 70; i = i + 1)
+    {
+        p[i] = uTaskAlloc(8);
+        CHECK(p[i] != NULL);
+        CHECK(i == 0 || p[i] > p[i-1]);
+    }
+
+    uTaskPoolStats(0, &Stats);
+    CHECK(Stats.uCount == 70);
+    CHECK(Stats.uFree == 0);
+
+    /* A freed block in the last word is found again */
+    uTaskFree(p[66]);
+    CHECK(uTaskAlloc(8) == p[66]);
+
+    /* The lowest free block is taken, whichever word it is in */
+    uTaskFree(p[65]);
+    uTaskFree(p[3]);
+    uTaskFree(p[40]);
+    CHECK(uTaskAlloc(8) == p[3]);
+    CHECK(uTaskAlloc(8) == p[40]);
+    CHECK(uTaskAlloc(8) == p[65]);
+
+    for (i = 0; i < 70; i = i + 1)
+    {
+        uTaskFree(p[i]);
+    }
+
+    uTaskPoolStats(0, &Stats);
+    CHECK(Stats.uFree == 70);
+
+    /* Free blocks are never written */
+    pOne = uTaskAlloc(8);
+    memset(pOne, 0x5A, 8);
+    uTaskFree(pOne);
+
+    for (k = 0; k < 8; k = k + 1)
+    {
+        CHECK(pOne[k] == 0x5A);
+    }
+
+    /* A double free is ignored */
+    pOne = uTaskAlloc(8);
+    uTaskFree(pOne);
+    uTaskFree(pOne);
+
+    uTaskPoolStats(0, &Stats);
+    CHECK(Stats.uFree == 70);
+
+    for (i = 0; i < 70; i = i + 1)
+    {
+        p[i] = uTaskAlloc(8);
+
+        for (k = 0; k < i; k = k + 1)
+        {
+            CHECK(p[k] != p[i]);
+        }
+    }
+
+    return TEST_DONE();
+}
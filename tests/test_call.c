@@ -0,0 +1,266 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Calls with replies and timeouts, built with UTASK_CALL_SLOTS 4.  A
+ * server answers one call twice, ignores one, answers one after its
+ * timeout and holds one until later.  The client must get exactly one
+ * answer for each, a fifth call must find no free slot, and once all are
+ * answered the slots must be free again.  With UTASK_EXEC_WORKERS 4 a
+ * client pinned to one worker calls a server pinned to another, the
+ * requests and answers must run on the workers of their tasks.
+ */
+#include <pthread.h>
+#include "utask.h"
+#include "test.h"
+
+#define ECHO            1
+#define IGNORE          2
+#define LATE            3
+#define HOLD            4
+#define LATER           5
+#define ANSWER          6
+#define TIMEOUT         10
+#define START           7
+#define ROUNDS          64
+
+static int gEcho;
+static int gIgnore;
+static int gLate;
+static int gHold;
+static int gHeld;
+static unsigned long gStart;
+static int gAnswers;
+static int gSpurious;
+static pthread_t gMain;
+static pthread_t gClientThread;
+static int gWrong;
+static int gRounds;
+
+static void
+ServerHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    int *p;
+
+    switch (Id)
+    {
+    case ECHO:
+        CHECK(uTaskCallCurrent() == gEcho);
+
+        p = uTaskAlloc(sizeof(int));
+        *p = *(int *)pMsg * 2;
+        CHECK(uTaskReply(uTaskCallCurrent(), p) == UTASK_S_OK);
+
+        /* The call has its answer, the second reply stays ours */
+        p = uTaskAlloc(sizeof(int));
+        CHECK(uTaskReply(uTaskCallCurrent(), p) == UTASK_E_FAIL);
+        uTaskFree(p);
+        break;
+
+    case LATE:
+        uTaskMessageSend(pTask, LATER, NULL, TIMEOUT * 2);
+        break;
+
+    case HOLD:
+        gHeld = uTaskCallCurrent();
+        break;
+
+    case LATER:
+        /* The late call timed out, the held one has no timeout */
+        CHECK(uTaskCallCurrent() == 0);
+
+        p = uTaskAlloc(sizeof(int));
+        CHECK(uTaskReply(gLate, p) == UTASK_E_FAIL);
+        CHECK(uTaskReply(gHeld, p) == UTASK_S_OK);
+        break;
+    }
+}
+
+static uTask_T gServer = {ServerHandler};
+
+static void
+ClientHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    int Call = uTaskCallCurrent();
+    int i;
+
+    CHECK(Id == ANSWER);
+    gAnswers = gAnswers + 1;
+
+    if (Call == gEcho)
+    {
+        CHECK(pMsg != NULL && *(int *)pMsg == 42);
+    }
+    else if (Call == gIgnore || Call == gLate)
+    {
+        CHECK(pMsg == NULL);
+        CHECK(uTaskGetTick() - gStart >= TIMEOUT);
+    }
+    else if (Call == gHold)
+    {
+        CHECK(pMsg != NULL);
+        CHECK(uTaskGetTick() - gStart >= TIMEOUT * 2);
+    }
+    else if (gAnswers <= 4 || pMsg != NULL)
+    {
+        gSpurious = gSpurious + 1;
+    }
+
+    /* Every slot is free again, these calls time out after a tick */
+    if (gAnswers == 4)
+    {
+        gEcho = -1;
+        gIgnore = -1;
+        gLate = -1;
+        gHold = -1;
+
+        for (i = 0; i < 4; i = i + 1)
+        {
+            CHECK(uTaskCall(&gServer, IGNORE, NULL, pTask, ANSWER, 1) > 0);
+        }
+    }
+    else if (gAnswers == 8)
+    {
+        uTaskDtor();
+    }
+}
+
+static uTask_T gClient = {ClientHandler};
+
+static void
+TickHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    uTaskTick();
+
+    if (uTaskGetTick() < 500)
+    {
+        uTaskMessageSend(pTask, 0, NULL, UTASK_IMMEDIATE);
+    }
+}
+
+static uTask_T gTicker = {TickHandler};
+
+/* Pinned to worker 0, the thread that runs main */
+static void
+PinnedServerHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    int *p;
+
+    if (!pthread_equal(pthread_self(), gMain))
+    {
+        __atomic_add_fetch(&gWrong, 1, __ATOMIC_RELAXED);
+    }
+
+    p = uTaskAlloc(sizeof(int));
+    *p = *(int *)pMsg;
+    CHECK(uTaskReply(uTaskCallCurrent(), p) == UTASK_S_OK);
+}
+
+static uTask_T gPinnedServer = {PinnedServerHandler};
+
+/* Pinned to worker 2, calls the server again for every answer */
+static void
+PinnedClientHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    int *p;
+
+    if (Id == START)
+    {
+        gClientThread = pthread_self();
+    }
+    else
+    {
+        CHECK(Id == ANSWER && pMsg != NULL && *(int *)pMsg == gRounds);
+        gRounds = gRounds + 1;
+    }
+
+    if (!pthread_equal(pthread_self(), gClientThread) ||
+        pthread_equal(pthread_self(), gMain))
+    {
+        __atomic_add_fetch(&gWrong, 1, __ATOMIC_RELAXED);
+    }
+
+    if (gRounds == ROUNDS)
+    {
+        uTaskDtor();
+        return;
+    }
+
+    p = uTaskAlloc(sizeof(int));
+    *p = gRounds;
+    CHECK(uTaskCall(&gPinnedServer, 0, p, pTask, ANSWER, TIMEOUT) > 0);
+}
+
+static uTask_T gPinnedClient = {PinnedClientHandler};
+
+int
+main(
+    void
+    )
+{
+    uTaskPoolStats_T Stats;
+    int *p;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    p = uTaskAlloc(sizeof(int));
+    *p = 21;
+
+    gStart = uTaskGetTick();
+    gEcho = uTaskCall(&gServer, ECHO, p, &gClient, ANSWER, TIMEOUT);
+    gIgnore = uTaskCall(&gServer, IGNORE, NULL, &gClient, ANSWER, TIMEOUT);
+    gLate = uTaskCall(&gServer, LATE, NULL, &gClient, ANSWER, TIMEOUT);
+    gHold = uTaskCall(&gServer, HOLD, NULL, &gClient, ANSWER, 0);
+
+    CHECK(gEcho > 0 && gIgnore > 0 && gLate > 0 && gHold > 0);
+    CHECK(gEcho != gIgnore && gIgnore != gLate && gLate != gHold);
+
+    /* All four slots are taken */
+    CHECK(uTaskCall(&gServer, IGNORE, NULL, &gClient, ANSWER, TIMEOUT) ==
+          UTASK_E_FAIL);
+
+    uTaskMessageSend(&gTicker, 0, NULL, UTASK_IMMEDIATE);
+    uTaskMessageLoop();
+
+    CHECK(gAnswers == 8);
+    CHECK(gSpurious == 0);
+
+    /* Requests and replies were freed by the loop */
+    uTaskPoolStats(0, &Stats);
+    CHECK(Stats.uFree == Stats.uCount);
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    CHECK(uTaskExecCtor(4) == UTASK_S_OK);
+
+    gMain = pthread_self();
+    gPinnedServer.Affinity = 1;
+    gPinnedClient.Affinity = 3;
+
+    uTaskMessageSend(&gPinnedClient, START, NULL, UTASK_IMMEDIATE);
+    CHECK(uTaskExecRun() == UTASK_S_OK);
+
+    CHECK(gRounds == ROUNDS);
+    CHECK(gWrong == 0);
+
+    return TEST_DONE();
+}
@@ -0,0 +1,151 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Scatter-gather message chains, built with UTASK_CHAIN_USE and eight
+ * 64 byte blocks to take segments from.
+ */
+#include <string.h>
+#include "utask.h"
+#include "test.h"
+
+static int gLength;
+static char gHead[8];
+
+/* Copy a chain's data out by walking its spans */
+static int
+ChainCopy(
+    void            *pChain,
+    char            *pOut,
+    int             Max
+    )
+{
+    void *pPos = NULL;
+    char *pSpan;
+    int Len;
+    int n = 0;
+
+    while ((pSpan = uTaskChainData(pChain, &pPos, &Len)) != NULL)
+    {
+        if (n + Len > Max)
+        {
+            return -1;
+        }
+
+        memcpy(pOut + n, pSpan, Len);
+        n = n + Len;
+    }
+
+    return n;
+}
+
+static int
+PoolFull(
+    void
+    )
+{
+    uTaskPoolStats_T Stats;
+    int i;
+
+    for (i = 0; uTaskPoolStats(i, &Stats) == UTASK_S_OK; i = i + 1)
+    {
+        if (Stats.uFree != Stats.uCount)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* A protocol layer, strips its 5 byte header and looks at the payload */
+static void
+Handler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    char Data[400];
+
+    CHECK(uTaskChainPeel(pMsg, 5) == 5);
+
+    gLength = uTaskChainLength(pMsg);
+    CHECK(ChainCopy(pMsg, Data, sizeof(Data)) == gLength);
+    memcpy(gHead, Data, sizeof(gHead));
+
+    uTaskDtor();
+}
+
+static uTask_T gTask = {Handler};
+
+int
+main(
+    void
+    )
+{
+    char Body[300];
+    char Expect[400];
+    char Data[400];
+    void *pChain;
+    int Len;
+    int i;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    for (i = 0; i < (int)sizeof(Body); i = i + 1)
+    {
+        Body[i] = 'a' + i % 26;
+    }
+
+    /* Appends and prepends across segment boundaries */
+    pChain = uTaskChainAlloc();
+    CHECK(pChain != NULL);
+    CHECK(uTaskChainLength(pChain) == 0);
+
+    CHECK(uTaskChainAppend(pChain, Body, 100) == UTASK_S_OK);
+    CHECK(uTaskChainPrepend(pChain, "HDR1:", 5) == UTASK_S_OK);
+    CHECK(uTaskChainPrepend(pChain, Body + 100, 60) == UTASK_S_OK);
+    CHECK(uTaskChainAppend(pChain, "END", 3) == UTASK_S_OK);
+
+    memcpy(Expect, Body + 100, 60);
+    memcpy(Expect + 60, "HDR1:", 5);
+    memcpy(Expect + 65, Body, 100);
+    memcpy(Expect + 165, "END", 3);
+
+    Len = ChainCopy(pChain, Data, sizeof(Data));
+    CHECK(Len == 168);
+    CHECK(uTaskChainLength(pChain) == 168);
+    CHECK(memcmp(Data, Expect, 168) == 0);
+
+    /* Too much for the pool, the chain is left as it was */
+    CHECK(uTaskChainAppend(pChain, Body, 300) != UTASK_S_OK);
+    CHECK(uTaskChainPrepend(pChain, Body, 300) != UTASK_S_OK);
+    CHECK(uTaskChainLength(pChain) == 168);
+    Len = ChainCopy(pChain, Data, sizeof(Data));
+    CHECK(Len == 168 && memcmp(Data, Expect, 168) == 0);
+
+    /* Peeling frees the segments it empties */
+    CHECK(uTaskChainPeel(pChain, 60) == 60);
+    CHECK(uTaskChainLength(pChain) == 108);
+    Len = ChainCopy(pChain, Data, sizeof(Data));
+    CHECK(Len == 108 && memcmp(Data, Expect + 60, 108) == 0);
+
+    /* Sent as a message, the loop frees it with all of its segments */
+    uTaskMessageSend(&gTask, 0, pChain, UTASK_IMMEDIATE);
+    uTaskMessageLoop();
+
+    CHECK(gLength == 103);
+    CHECK(memcmp(gHead, Body, sizeof(gHead)) == 0);
+    CHECK(PoolFull());
+
+    /* Peeling more than the chain holds empties it */
+    pChain = uTaskChainAlloc();
+    uTaskChainAppend(pChain, Body, 150);
+    CHECK(uTaskChainPeel(pChain, 500) == 150);
+    CHECK(uTaskChainLength(pChain) == 0);
+    uTaskFree(pChain);
+    CHECK(PoolFull());
+
+    return TEST_DONE();
+}
@@ -0,0 +1,124 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Item channels, built with UTASK_CHAN_USE and UTASK_INTAKE_SIZE.  A ring
+ * of four items is filled before the loop runs, then another thread keeps
+ * it full while the consumer drains it.  Items must arrive in order, and a
+ * wakeup message must only come when the channel has items.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include "utask.h"
+#include "test.h"
+
+#define RING            4
+#define ITEMS           1000
+#define WAKE            1
+
+typedef struct
+{
+    int             Seq;
+    short           Check;
+} Item_T;
+
+static Item_T gRing[RING];
+static uTaskChan_T gChan;
+static pthread_t gThread;
+static int gNext;
+static int gWakes;
+static int gEmptyWakes;
+
+static void *
+Producer(
+    void            *pArg
+    )
+{
+    Item_T Item;
+    int i;
+
+    for (i = RING; i < ITEMS; i = i + 1)
+    {
+        Item.Seq = i;
+        Item.Check = (short)~i;
+
+        while (uTaskChanSend(&gChan, &Item) != UTASK_S_OK)
+        {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void
+ConsumerHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    Item_T Item;
+    int Got = 0;
+
+    CHECK(Id == WAKE && pMsg == &gChan);
+    gWakes = gWakes + 1;
+
+    while (uTaskChanRecv(&gChan, &Item) == UTASK_S_OK)
+    {
+        CHECK(Item.Seq == gNext && Item.Check == (short)~gNext);
+        gNext = Item.Seq + 1;
+        Got = Got + 1;
+    }
+
+    if (Got == 0)
+    {
+        gEmptyWakes = gEmptyWakes + 1;
+    }
+
+    if (gNext == RING && Got == RING)
+    {
+        pthread_create(&gThread, NULL, Producer, NULL);
+    }
+    else if (gNext == ITEMS)
+    {
+        uTaskDtor();
+    }
+}
+
+static uTask_T gConsumer = {ConsumerHandler};
+
+int
+main(
+    void
+    )
+{
+    Item_T Item;
+    int i;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    uTaskChanInit(&gChan, gRing, sizeof(Item_T), RING, &gConsumer, WAKE);
+    CHECK(uTaskChanCount(&gChan) == 0);
+    CHECK(uTaskChanRecv(&gChan, &Item) == UTASK_E_FAIL);
+
+    for (i = 0; i < RING; i = i + 1)
+    {
+        Item.Seq = i;
+        Item.Check = (short)~i;
+        CHECK(uTaskChanSend(&gChan, &Item) == UTASK_S_OK);
+    }
+
+    CHECK(uTaskChanSend(&gChan, &Item) == UTASK_E_FAIL);
+    CHECK(uTaskChanCount(&gChan) == RING);
+
+    uTaskMessageLoop();
+    pthread_join(gThread, NULL);
+
+    CHECK(gNext == ITEMS);
+    CHECK(uTaskChanCount(&gChan) == 0);
+    CHECK(gWakes >= 2 && gWakes <= ITEMS - RING + 1);
+    CHECK(gEmptyWakes == 0);
+
+    return TEST_DONE();
+}
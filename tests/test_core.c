@@ -0,0 +1,114 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Scheduler instances alongside the default one, each with its own task
+ * control blocks, tick and loop.
+ */
+#include <pthread.h>
+#include "utask.h"
+#include "test.h"
+
+#define PINGS           20000
+
+typedef struct
+{
+    uTask_T         Task;
+    uTaskCore_T     *pCore;
+    int             Count;
+    int             Last;
+} Pinger_T;
+
+static uTaskCore_T gCoreA;
+static uTaskCore_T gCoreB;
+static uTaskTcb_T gTcbA[8];
+static uTaskTcb_T gTcbB[16];
+
+/* Sends itself PINGS messages on its own instance, then stops it */
+static void
+PingHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    Pinger_T *pPinger = (Pinger_T *)pTask;
+
+    pPinger->Count = pPinger->Count + 1;
+    pPinger->Last = Id;
+
+    if (Id == PINGS)
+    {
+        uTaskCoreDtor(pPinger->pCore);
+        return;
+    }
+
+    uTaskCoreMessageSend(pPinger->pCore, pTask, Id + 1, NULL, UTASK_IMMEDIATE);
+}
+
+static Pinger_T gPingA = {{PingHandler}, &gCoreA};
+static Pinger_T gPingB = {{PingHandler}, &gCoreB};
+
+static void *
+LoopThread(
+    void            *pArg
+    )
+{
+    uTaskCoreMessageLoop(pArg);
+    return NULL;
+}
+
+int
+main(
+    void
+    )
+{
+    pthread_t Thread;
+    int i;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    CHECK(uTaskCoreDefault() != NULL);
+    CHECK(uTaskCoreCtor(&gCoreA, gTcbA, 8) == UTASK_S_OK);
+    CHECK(uTaskCoreCtor(&gCoreB, gTcbB, 16) == UTASK_S_OK);
+
+    /* Each instance has only its own task control blocks */
+    for (i = 0; i < 8; i = i + 1)
+    {
+        CHECK(uTaskCoreMessageSend(&gCoreA, &gPingA.Task, 1, NULL, 100) ==
+              UTASK_S_OK);
+    }
+    CHECK(uTaskCoreMessageSend(&gCoreA, &gPingA.Task, 1, NULL, 100) !=
+          UTASK_S_OK);
+    CHECK(uTaskCoreMessageSend(&gCoreB, &gPingB.Task, 1, NULL, 100) ==
+          UTASK_S_OK);
+    CHECK(uTaskMessageSend(&gPingA.Task, 1, NULL, 100) == UTASK_S_OK);
+
+    /* Cancelling on one instance leaves the others alone */
+    CHECK(uTaskCoreMessageCancel(&gCoreA, &gPingA.Task, 1) == 8);
+    CHECK(uTaskCoreMessageCancel(&gCoreB, &gPingA.Task, 1) == 0);
+    CHECK(uTaskMessageCancel(&gPingA.Task, 1) == 1);
+    CHECK(uTaskCoreMessageCancel(&gCoreB, &gPingB.Task, 1) == 1);
+
+    /* Each instance counts its own ticks */
+    uTaskCoreTick(&gCoreA);
+    uTaskCoreTick(&gCoreA);
+    uTaskCoreTick(&gCoreB);
+    CHECK(uTaskCoreGetTick(&gCoreA) == 2);
+    CHECK(uTaskCoreGetTick(&gCoreB) == 1);
+    CHECK(uTaskGetTick() == 0);
+
+    /* Both loops run at once, on two threads */
+    CHECK(uTaskCoreMessageSend(&gCoreA, &gPingA.Task, 1, NULL,
+                               UTASK_IMMEDIATE) == UTASK_S_OK);
+    CHECK(uTaskCoreMessageSend(&gCoreB, &gPingB.Task, 1, NULL,
+                               UTASK_IMMEDIATE) == UTASK_S_OK);
+
+    pthread_create(&Thread, NULL, LoopThread, &gCoreB);
+    uTaskCoreMessageLoop(&gCoreA);
+    pthread_join(Thread, NULL);
+
+    CHECK(gPingA.Count == PINGS && gPingA.Last == PINGS);
+    CHECK(gPingB.Count == PINGS && gPingB.Last == PINGS);
+
+    return TEST_DONE();
+}
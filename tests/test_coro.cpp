@@ -0,0 +1,152 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * C++20 coroutines from utask.hpp, built with UTASK_POOL_ALIGN 16 and
+ * 512 byte blocks for the frames.  A coroutine sleeps, then bounces a
+ * block off a C task and receives it back, ignoring a message with another
+ * Id.  Its frame must be back in the pool when it returns, and a call
+ * with the pools empty must not run it at all.
+ */
+#include "utask.hpp"
+#include "test.h"
+
+#define ROUNDS          10
+#define BOUNCE          7
+#define NOISE           8
+
+static utask::task gLed;
+static int gRounds;
+static int gStarted;
+static int gAny;
+
+static void
+TickHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    uTaskTick();
+    uTaskMessageSend(pTask, 0, NULL, UTASK_IMMEDIATE);
+}
+
+static uTask_T gTicker = {TickHandler};
+
+/* Sends the block back to the coroutine's task, after some noise */
+static void
+BounceHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    /* The loop frees pMsg after this handler, keep it for the coroutine */
+    uTaskMsgRetain(pMsg);
+
+    uTaskMessageSend(gLed.handle(), NOISE, NULL, UTASK_IMMEDIATE);
+    uTaskMessageSend(gLed.handle(), Id, pMsg, 1);
+}
+
+static uTask_T gBounce = {BounceHandler};
+
+static int
+PoolFull(
+    void
+    )
+{
+    uTaskPoolStats_T Stats;
+    int i;
+
+    for (i = 0; uTaskPoolStats(i, &Stats) == UTASK_S_OK; i = i + 1)
+    {
+        if (Stats.uFree != Stats.uCount)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static utask::coro
+Blink(
+    utask::task     &Led
+    )
+{
+    unsigned long Start;
+    int *p;
+    int i;
+
+    gStarted = gStarted + 1;
+
+    for (i = 0; i < ROUNDS; i = i + 1)
+    {
+        Start = uTaskGetTick();
+        co_await utask::sleep(20);
+        CHECK(uTaskGetTick() - Start >= utask::ms(20));
+
+        p = static_cast<int *>(uTaskAlloc(sizeof(int)));
+        *p = i;
+        uTaskMessageSend(&gBounce, BOUNCE, p, UTASK_IMMEDIATE);
+
+        utask::message Msg = co_await Led.receive(BOUNCE);
+        CHECK(Msg.Id == BOUNCE && Msg.pMsg == p && *p == i);
+
+        gRounds = gRounds + 1;
+    }
+
+    /* Any Id resumes receive(any) */
+    uTaskMessageSend(Led.handle(), NOISE + 1, NULL, UTASK_IMMEDIATE);
+    utask::message Msg = co_await Led.receive(utask::any);
+    gAny = Msg.Id;
+
+    uTaskDtor();
+}
+
+int
+main(
+    void
+    )
+{
+    uTaskPoolStats_T Stats;
+    void *pBlock[64];
+    int n = 0;
+    int i;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    uTaskMessageSend(&gTicker, 0, NULL, UTASK_IMMEDIATE);
+    CHECK(static_cast<bool>(Blink(gLed)));
+    CHECK(gStarted == 1);
+
+    uTaskMessageLoop();
+
+    CHECK(gRounds == ROUNDS);
+    CHECK(gAny == NOISE + 1);
+    CHECK(PoolFull());
+
+    /* With every pool empty the frame can not be allocated */
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    for (i = 0; uTaskPoolStats(i, &Stats) == UTASK_S_OK; i = i + 1)
+    {
+        while (n < 64 && (pBlock[n] = uTaskAlloc(Stats.uSize)) != NULL)
+        {
+            n = n + 1;
+        }
+    }
+
+    CHECK(!Blink(gLed));
+    CHECK(gStarted == 1);
+
+    while (n > 0)
+    {
+        n = n - 1;
+        uTaskFree(pBlock[n]);
+    }
+
+    CHECK(PoolFull());
+
+    return TEST_DONE();
+}
@@ -0,0 +1,128 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Event flags, built with UTASK_EVENT_USE.  Waits for any flag, for all
+ * flags with a clear, for a flag that never comes, for a flag that is
+ * already set and a cancelled wait.  A ticker sets one flag from a task
+ * and one from an isr, each wait must end with exactly one message.
+ */
+#include "utask.h"
+#include "test.h"
+
+#define WAITS           5
+#define TIMEOUT         5
+#define END             10
+
+/* Flags */
+#define F_ONE           0x0001
+#define F_TWO           0x0002
+#define F_NOBODY        0x0004
+#define F_NEVER         0x0010
+#define F_SET           0x0100
+#define F_CANCEL        0x1000
+
+static uTaskEvent_T gEvent;
+static uTaskEventWait_T gWait[WAITS];
+static unsigned long gResult[WAITS];
+static unsigned long gTick[WAITS];
+static int gGot[WAITS];
+
+static void
+WaitHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    CHECK(Id >= 0 && Id < WAITS && pMsg == &gWait[Id]);
+
+    gResult[Id] = uTaskEventResult(pMsg);
+    gTick[Id] = uTaskGetTick();
+    gGot[Id] = gGot[Id] + 1;
+}
+
+static uTask_T gWaiter = {WaitHandler};
+
+static void
+TickHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    int PrevState;
+
+    uTaskTick();
+
+    switch (uTaskGetTick())
+    {
+    case 1:
+        uTaskEventSet(&gEvent, F_ONE | F_NOBODY);
+        break;
+
+    case 2:
+        PrevState = uTaskInterruptDisable();
+        uTaskEventSetIsr(&gEvent, F_TWO);
+        uTaskInterruptRestore(PrevState);
+        break;
+
+    case END:
+        uTaskDtor();
+        return;
+    }
+
+    uTaskMessageSend(pTask, 0, NULL, UTASK_IMMEDIATE);
+}
+
+static uTask_T gTicker = {TickHandler};
+
+int
+main(
+    void
+    )
+{
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    uTaskEventInit(&gEvent);
+    uTaskEventSet(&gEvent, F_SET);
+
+    CHECK(uTaskEventWait(&gEvent, &gWait[0], F_ONE | F_TWO, UTASK_EVENT_ANY,
+                         &gWaiter, 0, 0) == UTASK_S_OK);
+    CHECK(uTaskEventWait(&gEvent, &gWait[1], F_ONE | F_TWO,
+                         UTASK_EVENT_ALL | UTASK_EVENT_CLEAR,
+                         &gWaiter, 1, 0) == UTASK_S_OK);
+    CHECK(uTaskEventWait(&gEvent, &gWait[2], F_NEVER, UTASK_EVENT_ANY,
+                         &gWaiter, 2, TIMEOUT) == UTASK_S_OK);
+    CHECK(uTaskEventWait(&gEvent, &gWait[3], F_SET, UTASK_EVENT_ANY,
+                         &gWaiter, 3, 0) == UTASK_S_OK);
+    CHECK(uTaskEventWait(&gEvent, &gWait[4], F_CANCEL, UTASK_EVENT_ANY,
+                         &gWaiter, 4, 0) == UTASK_S_OK);
+
+    /* A wait in progress can not be reused */
+    CHECK(uTaskEventWait(&gEvent, &gWait[2], F_NEVER, UTASK_EVENT_ANY,
+                         &gWaiter, 2, 0) == UTASK_E_FAIL);
+
+    CHECK(uTaskEventCancel(&gWait[4]) == UTASK_S_OK);
+    CHECK(uTaskEventCancel(&gWait[4]) == UTASK_E_FAIL);
+
+    uTaskMessageSend(&gTicker, 0, NULL, UTASK_IMMEDIATE);
+    uTaskMessageLoop();
+
+    /* The flag set before the wait ended it at once */
+    CHECK(gGot[3] == 1 && gResult[3] == F_SET && gTick[3] == 0);
+
+    CHECK(gGot[0] == 1 && gResult[0] == F_ONE && gTick[0] == 1);
+
+    /* The isr's flag ended the wait when the loop ran, then was cleared */
+    CHECK(gGot[1] == 1 && gResult[1] == (F_ONE | F_TWO) && gTick[1] >= 2);
+    CHECK(gGot[2] == 1 && gResult[2] == 0 && gTick[2] >= TIMEOUT);
+    CHECK(gGot[4] == 0);
+
+    CHECK(uTaskEventGet(&gEvent) == (F_SET | F_NOBODY));
+
+    uTaskEventClear(&gEvent, F_NOBODY);
+    CHECK(uTaskEventGet(&gEvent) == F_SET);
+
+    return TEST_DONE();
+}
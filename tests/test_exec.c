@@ -0,0 +1,210 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * The work-stealing executor, built with UTASK_EXEC_WORKERS 4.  Each task
+ * sends itself numbered messages and pokes its neighbour, the handlers
+ * check that a task never runs on two workers at once and gets its own
+ * messages in order.  Linked with pthread_create wrapped, so a run can be
+ * made to fail to start a worker and must then run no handler at all.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include "utask.h"
+#include "test.h"
+
+#define TASKS           64
+#define SENDS           2000
+#define POKES           4
+
+typedef struct
+{
+    uTask_T         Task;
+    int             Busy;
+    int             Next;
+    int             Pokes;
+    int             InFlight;
+    pthread_t       Worker;
+} Node_T;
+
+static Node_T gNode[TASKS];
+static int gDone;
+static int gOverlap;
+static int gOrder;
+static int gLost;
+static int gWorkers;
+static int gFailCreate;
+
+int __real_pthread_create(pthread_t *, const pthread_attr_t *,
+                          void *(*)(void *), void *);
+
+/* Fails the gFailCreate'th thread creation from now on, if not 0 */
+int
+__wrap_pthread_create(
+    pthread_t               *pThread,
+    const pthread_attr_t    *pAttr,
+    void                    *(*pStart)(void *),
+    void                    *pArg
+    )
+{
+    if (gFailCreate > 0)
+    {
+        gFailCreate = gFailCreate - 1;
+
+        if (gFailCreate == 0)
+        {
+            return EAGAIN;
+        }
+    }
+
+    return __real_pthread_create(pThread, pAttr, pStart, pArg);
+}
+
+static void
+Handler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    Node_T *pNode = (Node_T *)pTask;
+    Node_T *pNext;
+    int i = (int)(pNode - gNode);
+
+    if (__atomic_exchange_n(&pNode->Busy, 1, __ATOMIC_ACQUIRE))
+    {
+        __atomic_add_fetch(&gOverlap, 1, __ATOMIC_RELAXED);
+    }
+
+    if (Id < 0)
+    {
+        pNode->Pokes = pNode->Pokes + 1;
+        __atomic_sub_fetch(&pNode->InFlight, 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        if (Id != pNode->Next)
+        {
+            __atomic_add_fetch(&gOrder, 1, __ATOMIC_RELAXED);
+        }
+
+        pNode->Next = Id + 1;
+        pNode->Worker = pthread_self();
+
+        if (Id + 1 < SENDS &&
+            uTaskMessageSend(pTask, Id + 1, NULL, UTASK_IMMEDIATE) ==
+            UTASK_S_OK)
+        {
+            /* A few pokes in flight per task, so the tcbs never run out */
+            pNext = &gNode[(i + 1) % TASKS];
+
+            if (__atomic_add_fetch(&pNext->InFlight, 1, __ATOMIC_RELAXED) >
+                POKES ||
+                uTaskMessageSend(&pNext->Task, -1, NULL, UTASK_IMMEDIATE) !=
+                UTASK_S_OK)
+            {
+                __atomic_sub_fetch(&pNext->InFlight, 1, __ATOMIC_RELAXED);
+            }
+        }
+        else
+        {
+            /* A lost message ends the task early, the checks catch it */
+            if (Id + 1 < SENDS)
+            {
+                __atomic_add_fetch(&gLost, 1, __ATOMIC_RELAXED);
+            }
+
+            if (__atomic_add_fetch(&gDone, 1, __ATOMIC_RELAXED) == TASKS)
+            {
+                uTaskDtor();
+            }
+        }
+    }
+
+    __atomic_store_n(&pNode->Busy, 0, __ATOMIC_RELEASE);
+}
+
+int
+main(
+    void
+    )
+{
+    int i;
+    int k;
+    int Distinct;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    CHECK(uTaskExecCtor(UTASK_EXEC_WORKERS + 1) != UTASK_S_OK);
+    CHECK(uTaskExecCtor(4) == UTASK_S_OK);
+
+    for (i = 0; i < TASKS; i = i + 1)
+    {
+        gNode[i].Task.Handler = Handler;
+        CHECK(uTaskMessageSend(&gNode[i].Task, 0, NULL, UTASK_IMMEDIATE) ==
+              UTASK_S_OK);
+    }
+
+    uTaskExecRun();
+
+    CHECK(gLost == 0);
+    CHECK(gOverlap == 0);
+    CHECK(gOrder == 0);
+    CHECK(gDone == TASKS);
+
+    for (i = 0; i < TASKS; i = i + 1)
+    {
+        CHECK(gNode[i].Next == SENDS);
+        CHECK(gNode[i].Pokes > 0 && gNode[i].Pokes < SENDS);
+    }
+
+    /* Count the workers that ran the last message of some task */
+    for (i = 0; i < TASKS; i = i + 1)
+    {
+        Distinct = 1;
+
+        for (k = 0; k < i; k = k + 1)
+        {
+            if (pthread_equal(gNode[k].Worker, gNode[i].Worker))
+            {
+                Distinct = 0;
+            }
+        }
+
+        gWorkers = gWorkers + Distinct;
+    }
+
+    CHECK(gWorkers >= 1 && gWorkers <= 4);
+
+    /* Runs again after another uTaskCtor, the pokes left queued are dropped */
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    CHECK(uTaskExecCtor(4) == UTASK_S_OK);
+
+    gDone = 0;
+
+    for (i = 0; i < TASKS; i = i + 1)
+    {
+        gNode[i].Next = 0;
+        gNode[i].InFlight = 0;
+        uTaskMessageSend(&gNode[i].Task, 0, NULL, UTASK_IMMEDIATE);
+    }
+
+    /* Worker 3 does not start, the two that did leave without running */
+    gFailCreate = 3;
+    CHECK(uTaskExecRun() == UTASK_E_FAIL);
+
+    for (i = 0; i < TASKS; i = i + 1)
+    {
+        CHECK(gNode[i].Next == 0);
+    }
+
+    /* The messages are still queued for the next run, on two workers */
+    CHECK(uTaskExecCtor(2) == UTASK_S_OK);
+    CHECK(uTaskExecRun() == UTASK_S_OK);
+
+    CHECK(gLost == 0);
+    CHECK(gOverlap == 0);
+    CHECK(gOrder == 0);
+    CHECK(gDone == TASKS);
+
+    return TEST_DONE();
+}
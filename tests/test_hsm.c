@@ -0,0 +1,298 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Hierarchical state machines, built with UTASK_HSM_DEPTH 3.  A driver
+ * task sends a motor machine one event per pass and checks the entry and
+ * exit actions it logged and the state it ended in: guards, messages
+ * bubbling to enclosing states, self transitions, Init children and
+ * dropped messages.  Tables that nest too deep, loop or have a wrong Lca
+ * must be refused.
+ */
+#include <string.h>
+#include "utask.h"
+#include "test.h"
+
+/* Events */
+#define EV_POWER        1
+#define EV_START        2
+#define EV_DONE         3
+#define EV_RESET        4
+#define EV_SELF         5
+#define EV_COUNT        6
+
+/* States */
+#define OFF             0
+#define ON              1
+#define IDLE            2
+#define BUSY            3
+#define B1              4
+#define B2              5
+
+typedef struct
+{
+    int             Event;
+    int             Allow;
+    const char      *pLog;
+    int             State;
+} Step_T;
+
+static const Step_T gSteps[] =
+{
+    {EV_POWER,  0, "+on +idle ",                IDLE},
+    {EV_START,  0, "deny ",                     IDLE},
+    {EV_START,  1, "start -idle +busy +b1 ",    B1},
+    {EV_SELF,   1, "-b1 -busy +busy +b1 ",      B1},
+    {EV_DONE,   1, "-b1 +b2 ",                  B2},
+    {EV_DONE,   1, "-b2 -busy +idle ",          IDLE},
+    {EV_COUNT,  1, "",                          IDLE},
+    {EV_RESET,  1, "-idle +idle ",              IDLE},
+    {EV_POWER,  1, "-idle -on ",                OFF},
+    {EV_DONE,   1, "",                          OFF},
+};
+
+static char gLog[64];
+static int gAllow;
+static int gCounted;
+static int gStep;
+static uTaskHsm_T gMotor;
+
+static void
+Log(
+    const char      *pText
+    )
+{
+    if (strlen(gLog) + strlen(pText) < sizeof(gLog))
+    {
+        strcat(gLog, pText);
+    }
+}
+
+static void
+OnEntry(
+    uTaskHsm_T      *pHsm
+    )
+{
+    Log("+on ");
+}
+
+static void
+OnExit(
+    uTaskHsm_T      *pHsm
+    )
+{
+    Log("-on ");
+}
+
+static void
+IdleEntry(
+    uTaskHsm_T      *pHsm
+    )
+{
+    Log("+idle ");
+}
+
+static void
+IdleExit(
+    uTaskHsm_T      *pHsm
+    )
+{
+    Log("-idle ");
+}
+
+static void
+BusyEntry(
+    uTaskHsm_T      *pHsm
+    )
+{
+    Log("+busy ");
+}
+
+static void
+BusyExit(
+    uTaskHsm_T      *pHsm
+    )
+{
+    Log("-busy ");
+}
+
+static void
+B1Entry(
+    uTaskHsm_T      *pHsm
+    )
+{
+    Log("+b1 ");
+}
+
+static void
+B1Exit(
+    uTaskHsm_T      *pHsm
+    )
+{
+    Log("-b1 ");
+}
+
+static void
+B2Entry(
+    uTaskHsm_T      *pHsm
+    )
+{
+    Log("+b2 ");
+}
+
+static void
+B2Exit(
+    uTaskHsm_T      *pHsm
+    )
+{
+    Log("-b2 ");
+}
+
+/* Guard, a declined start falls through to the next rule */
+static int
+CanStart(
+    uTaskHsm_T      *pHsm,
+    int             Id,
+    void            *pMsg
+    )
+{
+    Log(gAllow ? "start " : "deny ");
+
+    return gAllow ? UTASK_S_OK : UTASK_E_FAIL;
+}
+
+static int
+Count(
+    uTaskHsm_T      *pHsm,
+    int             Id,
+    void            *pMsg
+    )
+{
+    int *pCount = uTaskHsmContext(pHsm);
+
+    *pCount = *pCount + 1;
+
+    return UTASK_S_OK;
+}
+
+static const uTaskHsmRule_T gOffRules[] =
+{
+    {EV_POWER, NULL, ON, UTASK_HSM_NONE},
+};
+
+static const uTaskHsmRule_T gOnRules[] =
+{
+    {EV_POWER, NULL, OFF, UTASK_HSM_NONE},
+    {EV_RESET, NULL, ON, ON},
+    {EV_COUNT, Count, UTASK_HSM_NONE, 0},
+};
+
+static const uTaskHsmRule_T gIdleRules[] =
+{
+    {EV_START, CanStart, BUSY, ON},
+    {EV_START, NULL, UTASK_HSM_NONE, 0},
+};
+
+static const uTaskHsmRule_T gBusyRules[] =
+{
+    {EV_DONE, NULL, IDLE, ON},
+    {EV_SELF, NULL, BUSY, ON},
+};
+
+static const uTaskHsmRule_T gB1Rules[] =
+{
+    {EV_DONE, NULL, B2, BUSY},
+};
+
+static const uTaskHsmState_T gStates[] =
+{
+    {-1,   -1,   NULL,      NULL,     UTASK_HSM_RULES(gOffRules)},
+    {-1,   IDLE, OnEntry,   OnExit,   UTASK_HSM_RULES(gOnRules)},
+    {ON,   -1,   IdleEntry, IdleExit, UTASK_HSM_RULES(gIdleRules)},
+    {ON,   B1,   BusyEntry, BusyExit, UTASK_HSM_RULES(gBusyRules)},
+    {BUSY, -1,   B1Entry,   B1Exit,   UTASK_HSM_RULES(gB1Rules)},
+    {BUSY, -1,   B2Entry,   B2Exit,   NULL, 0},
+};
+
+/* The rule of state 1 goes to IDLE, state 0 does not enclose state 1 */
+static const uTaskHsmState_T gBadLca[] =
+{
+    {-1, -1, NULL, NULL, NULL, 0},
+    {0,  -1, NULL, NULL, UTASK_HSM_RULES(gBusyRules)},
+};
+
+static const uTaskHsmState_T gLoop[] =
+{
+    {1, -1, NULL, NULL, NULL, 0},
+    {0, -1, NULL, NULL, NULL, 0},
+};
+
+static const uTaskHsmState_T gDeep[] =
+{
+    {-1, -1, NULL, NULL, NULL, 0},
+    {0,  -1, NULL, NULL, NULL, 0},
+    {1,  -1, NULL, NULL, NULL, 0},
+    {2,  -1, NULL, NULL, NULL, 0},
+};
+
+/* Checks the last step, then sends the machine the next event */
+static void
+DriverHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    const Step_T *pStep;
+
+    if (gStep > 0)
+    {
+        pStep = &gSteps[gStep-1];
+
+        CHECK(strcmp(gLog, pStep->pLog) == 0);
+        CHECK(uTaskHsmState(&gMotor) == pStep->State);
+        CHECK(uTaskHsmIn(&gMotor, ON) == (pStep->State != OFF));
+    }
+
+    gLog[0] = '\0';
+
+    if (gStep == (int)(sizeof(gSteps) / sizeof(gSteps[0])))
+    {
+        uTaskDtor();
+        return;
+    }
+
+    gAllow = gSteps[gStep].Allow;
+    uTaskMessageSend(uTaskHsmTask(&gMotor), gSteps[gStep].Event, NULL,
+                     UTASK_IMMEDIATE);
+    gStep = gStep + 1;
+
+    uTaskMessageSend(pTask, 0, NULL, UTASK_IMMEDIATE);
+}
+
+static uTask_T gDriver = {DriverHandler};
+
+int
+main(
+    void
+    )
+{
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    CHECK(uTaskHsmInit(&gMotor, gBadLca, 2, 0, NULL) == UTASK_E_FAIL);
+    CHECK(uTaskHsmInit(&gMotor, gLoop, 2, 0, NULL) == UTASK_E_FAIL);
+    CHECK(uTaskHsmInit(&gMotor, gDeep, 4, 0, NULL) == UTASK_E_FAIL);
+
+    /* OFF has no entry action, nothing is logged */
+    CHECK(uTaskHsmInit(&gMotor, gStates, 6, OFF, &gCounted) == UTASK_S_OK);
+    CHECK(uTaskHsmState(&gMotor) == OFF);
+    CHECK(gLog[0] == '\0');
+
+    uTaskMessageSend(&gDriver, 0, NULL, UTASK_IMMEDIATE);
+    uTaskMessageLoop();
+
+    CHECK(gStep == (int)(sizeof(gSteps) / sizeof(gSteps[0])));
+    CHECK(gCounted == 1);
+
+    return TEST_DONE();
+}
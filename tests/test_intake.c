@@ -0,0 +1,152 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Sends from threads other than the loop's, built with UTASK_INTAKE_SIZE
+ * 1024.  Four producer threads send numbered messages that must arrive in
+ * order per producer, and a delayed send from another thread must still
+ * wait for its ticks.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include "utask.h"
+#include "test.h"
+
+#define PRODUCERS       4
+#define SENDS           20000
+#define DELAY           5
+#define EARLY           UTASK_INTAKE_SIZE
+
+static long gLast[PRODUCERS + 1];
+static int gGot;
+static int gOrder;
+static int gFull;
+static unsigned long gSentAt;
+static unsigned long gArrived;
+
+/* Id is the producer, pMsg its sequence number, Id PRODUCERS is main */
+static void
+Handler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    if ((long)pMsg != gLast[Id] + 1)
+    {
+        gOrder = gOrder + 1;
+    }
+
+    gLast[Id] = (long)pMsg;
+    gGot = gGot + 1;
+
+    if (gGot == PRODUCERS * SENDS + EARLY)
+    {
+        uTaskDtor();
+    }
+}
+
+static uTask_T gTask = {Handler};
+
+static void *
+Producer(
+    void            *pArg
+    )
+{
+    int Id = (int)(long)pArg;
+    long i;
+
+    for (i = 1; i <= SENDS; i = i + 1)
+    {
+        while (uTaskMessageSend(&gTask, Id, (void *)i, UTASK_IMMEDIATE) !=
+               UTASK_S_OK)
+        {
+            __atomic_add_fetch(&gFull, 1, __ATOMIC_RELAXED);
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+/* Ticks once per pass until the delayed message has arrived */
+static void
+TickHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    if (Id == 1)
+    {
+        gArrived = uTaskGetTick();
+        uTaskDtor();
+        return;
+    }
+
+    uTaskTick();
+    uTaskMessageSend(pTask, 0, NULL, UTASK_IMMEDIATE);
+}
+
+static uTask_T gTicker = {TickHandler};
+
+static void *
+Delayed(
+    void            *pArg
+    )
+{
+    gSentAt = uTaskGetTick();
+    CHECK(uTaskMessageSend(&gTicker, 1, NULL, DELAY) == UTASK_S_OK);
+
+    return NULL;
+}
+
+int
+main(
+    void
+    )
+{
+    pthread_t Thread[PRODUCERS];
+    long i;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    /* No loop runs on this thread yet, so its sends fill the intake too */
+    for (i = 1; i <= EARLY; i = i + 1)
+    {
+        CHECK(uTaskMessageSend(&gTask, PRODUCERS, (void *)i,
+                               UTASK_IMMEDIATE) == UTASK_S_OK);
+    }
+    CHECK(uTaskMessageSend(&gTask, PRODUCERS, (void *)i, UTASK_IMMEDIATE) !=
+          UTASK_S_OK);
+
+    for (i = 0; i < PRODUCERS; i = i + 1)
+    {
+        pthread_create(&Thread[i], NULL, Producer, (void *)i);
+    }
+
+    uTaskMessageLoop();
+
+    for (i = 0; i < PRODUCERS; i = i + 1)
+    {
+        pthread_join(Thread[i], NULL);
+        CHECK(gLast[i] == SENDS);
+    }
+
+    CHECK(gLast[PRODUCERS] == EARLY);
+    CHECK(gOrder == 0);
+    CHECK(gGot == PRODUCERS * SENDS + EARLY);
+
+    /* A delayed send from another thread keeps its delay */
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    pthread_create(&Thread[0], NULL, Delayed, NULL);
+    pthread_join(Thread[0], NULL);
+
+    uTaskMessageSend(&gTicker, 0, NULL, UTASK_IMMEDIATE);
+    uTaskMessageLoop();
+
+    CHECK(gArrived >= gSentAt + DELAY);
+
+    return TEST_DONE();
+}
@@ -0,0 +1,217 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Per thread magazine caches in front of the pools, built with
+ * UTASK_POOL_MAG_SIZE 8 and the executor.
+ */
+#include <string.h>
+#include <pthread.h>
+#include "utask.h"
+#include "test.h"
+
+#define THREADS         4
+#define ROUNDS          20000
+#define SENDS           1000
+
+static int gExecCount[THREADS];
+static int gExecDone;
+
+/* Free blocks of pool 0 in the shared pool */
+static unsigned int
+PoolFree0(
+    void
+    )
+{
+    uTaskPoolStats_T Stats;
+
+    uTaskPoolStats(0, &Stats);
+
+    return Stats.uFree;
+}
+
+/* Every pool has all its blocks back */
+static int
+PoolFull(
+    void
+    )
+{
+    uTaskPoolStats_T Stats;
+    int i;
+
+    for (i = 0; uTaskPoolStats(i, &Stats) == UTASK_S_OK; i = i + 1)
+    {
+        if (Stats.uFree != Stats.uCount)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Allocate and free from each pool, each thread fills its blocks with its tag */
+static void *
+Worker(
+    void            *pArg
+    )
+{
+    int Tag = (int)(long)pArg;
+    unsigned char *p[4];
+    int i;
+    int k;
+    int Bad = 0;
+
+    for (i = 0; i < ROUNDS; i = i + 1)
+    {
+        for (k = 0; k < 4; k = k + 1)
+        {
+            p[k] = uTaskAlloc(8 << k);
+
+            if (p[k])
+            {
+                memset(p[k], Tag, 8 << k);
+            }
+        }
+
+        for (k = 0; k < 4; k = k + 1)
+        {
+            if (p[k])
+            {
+                Bad = Bad + (p[k][0] != Tag || p[k][(8 << k) - 1] != Tag);
+                uTaskFree(p[k]);
+            }
+        }
+    }
+
+    uTaskPoolFlush();
+
+    return (void *)(long)Bad;
+}
+
+/* Pinned to one worker, allocates and frees through that worker's magazine */
+static void
+ExecHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    uTaskFree(uTaskAlloc(8));
+    uTaskFree(uTaskAlloc(16));
+
+    gExecCount[Id] = gExecCount[Id] + 1;
+
+    if (gExecCount[Id] == SENDS)
+    {
+        if (__atomic_add_fetch(&gExecDone, 1, __ATOMIC_RELAXED) == THREADS)
+        {
+            uTaskDtor();
+        }
+        return;
+    }
+
+    uTaskMessageSend(pTask, Id, NULL, UTASK_IMMEDIATE);
+}
+
+static uTask_T gExecTask[THREADS] = {
+    {ExecHandler}, {ExecHandler}, {ExecHandler}, {ExecHandler}
+};
+
+int
+main(
+    void
+    )
+{
+    pthread_t Thread[THREADS];
+    void *p[16];
+    void *pRet;
+    int i;
+    int k;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    /* A miss refills a batch, frees stay in the magazine until a flush */
+    p[0] = uTaskAlloc(8);
+    CHECK(p[0] != NULL);
+    CHECK(PoolFree0() == 16 - UTASK_POOL_MAG_BATCH);
+
+    uTaskFree(p[0]);
+    CHECK(PoolFree0() == 16 - UTASK_POOL_MAG_BATCH);
+
+    uTaskPoolFlush();
+    CHECK(PoolFree0() == 16);
+
+    /* A full magazine returns a batch, the last frees stay cached */
+    for (i = 0; i < 16; i = i + 1)
+    {
+        p[i] = uTaskAlloc(8);
+        CHECK(p[i] != NULL);
+    }
+    CHECK(uTaskAlloc(8) == NULL);
+
+    for (i = 0; i < 16; i = i + 1)
+    {
+        uTaskFree(p[i]);
+    }
+    CHECK(PoolFree0() == 16 - UTASK_POOL_MAG_SIZE);
+
+    uTaskPoolFlush();
+    CHECK(PoolFree0() == 16);
+
+    /* Threads never get the same block */
+    for (i = 0; i < THREADS; i = i + 1)
+    {
+        pthread_create(&Thread[i], NULL, Worker, (void *)(long)(i + 1));
+    }
+
+    for (i = 0; i < THREADS; i = i + 1)
+    {
+        pthread_join(Thread[i], &pRet);
+        CHECK(pRet == NULL);
+    }
+
+    CHECK(PoolFull());
+
+    /* A second uTaskCtor gives back blocks that were never freed */
+    for (i = 0; i < 5; i = i + 1)
+    {
+        p[i] = uTaskAlloc(8);
+    }
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    CHECK(PoolFull());
+
+    for (i = 0; i < 16; i = i + 1)
+    {
+        p[i] = uTaskAlloc(8);
+        CHECK(p[i] != NULL);
+
+        for (k = 0; k < i; k = k + 1)
+        {
+            CHECK(p[k] != p[i]);
+        }
+    }
+    CHECK(uTaskAlloc(8) == NULL);
+
+    /* Executor workers flush their magazines when they stop */
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    CHECK(uTaskExecCtor(THREADS) == UTASK_S_OK);
+
+    for (i = 0; i < THREADS; i = i + 1)
+    {
+        gExecTask[i].Affinity = i + 1;
+        uTaskMessageSend(&gExecTask[i], i, NULL, UTASK_IMMEDIATE);
+    }
+
+    uTaskExecRun();
+    uTaskPoolFlush();
+
+    for (i = 0; i < THREADS; i = i + 1)
+    {
+        CHECK(gExecCount[i] == SENDS);
+    }
+    CHECK(PoolFull());
+
+    return TEST_DONE();
+}
@@ -0,0 +1,149 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Idle loops parking on a futex, built with UTASK_IDLE_PARK and
+ * UTASK_INTAKE_SIZE.  A second thread wakes the parked loop with a send,
+ * with an isr send and with the tick that makes a delayed message due.
+ * Between them the loop must sleep, not spin, and each wake up must reach
+ * the handler well before the next one is due.
+ */
+#include <pthread.h>
+#include <time.h>
+#include "utask.h"
+#include "test.h"
+
+#define GAP_MS          20
+#define DELAY           2
+
+static double gSentAt[4];
+static double gLatency[4];
+static int gGot;
+
+static double
+Now(
+    void
+    )
+{
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+
+    return Ts.tv_sec * 1e3 + Ts.tv_nsec / 1e6;
+}
+
+static double
+CpuNow(
+    void
+    )
+{
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &Ts);
+
+    return Ts.tv_sec * 1e3 + Ts.tv_nsec / 1e6;
+}
+
+static void
+Pause(
+    int             Ms
+    )
+{
+    struct timespec Ts = {0, Ms * 1000000L};
+
+    nanosleep(&Ts, NULL);
+}
+
+/*
+ * Id 1 came from a thread, 2 from an isr and 3 after a delay.  The send
+ * orders the write of the send time before the handler reads it.
+ */
+static void
+Handler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    gLatency[Id] = Now() - gSentAt[Id];
+    gGot = gGot + 1;
+
+    if (Id == 2)
+    {
+        CHECK(uTaskMessageSend(pTask, 3, NULL, DELAY) == UTASK_S_OK);
+    }
+    else if (Id == 3)
+    {
+        uTaskDtor();
+    }
+}
+
+static uTask_T gTask = {Handler};
+
+static void *
+Waker(
+    void            *pArg
+    )
+{
+    int PrevState;
+    int i;
+
+    Pause(GAP_MS);
+    gSentAt[1] = Now();
+    CHECK(uTaskMessageSend(&gTask, 1, NULL, UTASK_IMMEDIATE) == UTASK_S_OK);
+
+    Pause(GAP_MS);
+    gSentAt[2] = Now();
+    PrevState = uTaskInterruptDisable();
+    CHECK(uTaskMessageSendIsr(&gTask, 2, NULL) == UTASK_S_OK);
+    uTaskInterruptRestore(PrevState);
+
+    /* Tick until the delayed message is due, it is timed from the last */
+    for (i = 0; i < DELAY; i = i + 1)
+    {
+        Pause(GAP_MS);
+        gSentAt[3] = Now();
+        PrevState = uTaskInterruptDisable();
+        uTaskTick();
+        uTaskInterruptRestore(PrevState);
+    }
+
+    return NULL;
+}
+
+int
+main(
+    void
+    )
+{
+    pthread_t Thread;
+    double Start;
+    double Cpu;
+    double Wall;
+    int i;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    Start = Now();
+    Cpu = CpuNow();
+
+    pthread_create(&Thread, NULL, Waker, NULL);
+    uTaskMessageLoop();
+    pthread_join(Thread, NULL);
+
+    Wall = Now() - Start;
+    Cpu = CpuNow() - Cpu;
+
+    CHECK(gGot == 3);
+
+    for (i = 1; i <= 3; i = i + 1)
+    {
+        CHECK(gLatency[i] >= 0 && gLatency[i] < GAP_MS / 2);
+    }
+
+    /* A spinning loop would use about all of the wall time */
+    CHECK(Wall >= (2 + DELAY) * GAP_MS);
+    CHECK(Cpu < Wall / 4);
+
+    return TEST_DONE();
+}
@@ -0,0 +1,194 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * The POSIX port, built with UTASK_PORT_POSIX and UTASK_EXEC_WORKERS 4.
+ * Delayed messages run off the timerfd tick, and SIGUSR1 raised from the
+ * handlers runs its isr on the interrupt thread, first under the message
+ * loop and then under the executor.  SIGUSR1 would end the process if a
+ * worker took it instead of the signalfd.
+ */
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include "utask.h"
+#include "test.h"
+
+#define STEPS           20
+#define DELAY           2
+
+static pthread_t gMain;
+static pthread_t gIsrThread;
+static int gIsrRuns;
+static int gIsrMsgs;
+static int gSteps;
+static int gLateStart;
+static int gExec;
+
+static double
+Now(
+    void
+    )
+{
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+
+    return Ts.tv_sec * 1e3 + Ts.tv_nsec / 1e6;
+}
+
+static void
+Handler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    );
+
+static uTask_T gTask = {Handler};
+
+/* Runs on the interrupt thread with the interrupt lock held */
+static void
+Isr(
+    int             Signo
+    )
+{
+    CHECK(Signo == SIGUSR1);
+
+    gIsrThread = pthread_self();
+    __atomic_store_n(&gIsrRuns, gIsrRuns + 1, __ATOMIC_RELEASE);
+
+    uTaskMessageSendIsr(&gTask, 2, NULL);
+}
+
+/* Id 1 steps every DELAY ticks and raises the signal, Id 2 is the isr's */
+static void
+Handler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    if (Id == 2)
+    {
+        gIsrMsgs = gIsrMsgs + 1;
+        return;
+    }
+
+    /* The port can not start while the workers run */
+    if (gExec)
+    {
+        gLateStart = gLateStart + (uTaskPortStart(0) != UTASK_S_OK);
+    }
+
+    if (gSteps < STEPS)
+    {
+        gSteps = gSteps + 1;
+        CHECK(uTaskPortRaise(SIGUSR1) == UTASK_S_OK);
+        CHECK(uTaskMessageSend(pTask, 1, NULL, DELAY) == UTASK_S_OK);
+    }
+    else
+    {
+        uTaskDtor();
+    }
+}
+
+static void *
+Starter(
+    void            *pArg
+    )
+{
+    return uTaskPortStart(1000) == UTASK_S_OK ? NULL : &gExec;
+}
+
+int
+main(
+    void
+    )
+{
+    struct timespec Ms = {0, 1000000};
+    pthread_t Thread;
+    sigset_t Set;
+    void *pStatus;
+    double Start;
+    int PrevState;
+    int Runs;
+    int i;
+
+    gMain = pthread_self();
+
+    CHECK(uTaskPortIsr(0, Isr) != UTASK_S_OK);
+    CHECK(uTaskPortIsr(SIGUSR1, Isr) == UTASK_S_OK);
+    CHECK(uTaskPortRaise(SIGUSR2) != UTASK_S_OK);
+
+    /* The message loop, ticking every millisecond */
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    CHECK(uTaskPortStart(1000) == UTASK_S_OK);
+    CHECK(uTaskPortIsr(SIGUSR2, Isr) != UTASK_S_OK);
+
+    Start = Now();
+    uTaskMessageSend(&gTask, 1, NULL, UTASK_IMMEDIATE);
+    uTaskMessageLoop();
+
+    /* Each step waits for at least one whole tick */
+    CHECK(Now() - Start >= STEPS);
+    CHECK(uTaskGetTick() >= STEPS * DELAY);
+    CHECK(gSteps == STEPS);
+
+    /* Raised signals of the same number may merge, but at least one ran */
+    CHECK(gIsrRuns > 0 && gIsrRuns <= STEPS);
+    CHECK(gIsrMsgs > 0 && gIsrMsgs <= gIsrRuns);
+    CHECK(!pthread_equal(gIsrThread, gMain));
+
+    /* An isr waits for the interrupt lock, nested disables only count */
+    Runs = __atomic_load_n(&gIsrRuns, __ATOMIC_ACQUIRE);
+
+    PrevState = uTaskInterruptDisable();
+    CHECK(PrevState == 0);
+    CHECK(uTaskInterruptDisable() == 1);
+    CHECK(uTaskPortRaise(SIGUSR1) == UTASK_S_OK);
+    nanosleep(&Ms, NULL);
+    uTaskInterruptRestore(1);
+    nanosleep(&Ms, NULL);
+    CHECK(__atomic_load_n(&gIsrRuns, __ATOMIC_ACQUIRE) == Runs);
+    uTaskInterruptRestore(PrevState);
+
+    for (i = 0; i < 1000 && __atomic_load_n(&gIsrRuns, __ATOMIC_ACQUIRE) ==
+                            Runs; i = i + 1)
+    {
+        nanosleep(&Ms, NULL);
+    }
+    CHECK(__atomic_load_n(&gIsrRuns, __ATOMIC_ACQUIRE) == Runs + 1);
+
+    uTaskPortStop();
+
+    /*
+     * The executor, with the port started on another thread so this one
+     * has SIGUSR1 unblocked.  uTaskExecRun blocks it for the workers.
+     */
+    gSteps = 0;
+    gIsrRuns = 0;
+    gIsrMsgs = 0;
+    gExec = 1;
+
+    sigemptyset(&Set);
+    sigaddset(&Set, SIGUSR1);
+    pthread_sigmask(SIG_UNBLOCK, &Set, NULL);
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    CHECK(uTaskExecCtor(4) == UTASK_S_OK);
+    pthread_create(&Thread, NULL, Starter, NULL);
+    pthread_join(Thread, &pStatus);
+    CHECK(pStatus == NULL);
+
+    uTaskMessageSend(&gTask, 1, NULL, UTASK_IMMEDIATE);
+    uTaskExecRun();
+
+    CHECK(gSteps == STEPS);
+    CHECK(gLateStart == STEPS + 1);
+    CHECK(gIsrRuns > 0 && gIsrRuns <= STEPS);
+    CHECK(!pthread_equal(gIsrThread, gMain));
+
+    uTaskPortStop();
+
+    return TEST_DONE();
+}
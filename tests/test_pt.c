@@ -0,0 +1,155 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * The protothread coroutine macros.  A ticker task advances the tick each
+ * pass, a coroutine waits for a delay, a timeout, a reply and three
+ * yields, writing a letter to a log at each step.  A second start leaves
+ * early with UTASK_PT_EXIT.
+ */
+#include <string.h>
+#include "utask.h"
+#include "test.h"
+
+#define DONE            5
+#define OTHER           6
+
+typedef struct
+{
+    uTask_T         Task;
+    uTaskPt_T       Pt;
+    unsigned long   Start;
+    int             Runs;
+    int             i;
+} Seq_T;
+
+static char gLog[32];
+static int gLen;
+
+static void
+Log(
+    char            c
+    )
+{
+    if (gLen < (int)sizeof(gLog) - 1)
+    {
+        gLog[gLen] = c;
+        gLen = gLen + 1;
+    }
+}
+
+static void
+SeqHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    Seq_T *p = (Seq_T *)pTask;
+
+    UTASK_PT_BEGIN(&p->Pt, pTask, Id);
+
+    p->Runs = p->Runs + 1;
+    p->Start = uTaskGetTick();
+    Log('S');
+
+    if (p->Runs == 2)
+    {
+        Log('X');
+        uTaskDtor();
+        UTASK_PT_EXIT(&p->Pt);
+    }
+
+    UTASK_PT_DELAY(&p->Pt, pTask, 5);
+    CHECK(Id == UTASK_PT_WAKE);
+    CHECK(uTaskGetTick() - p->Start >= 5);
+    Log('D');
+
+    /* Nothing answers, the wait times out */
+    p->Start = uTaskGetTick();
+    UTASK_PT_WAIT_ID_TIMEOUT(&p->Pt, pTask, DONE, 3);
+    CHECK(Id == UTASK_PT_TIMEOUT);
+    CHECK(uTaskGetTick() - p->Start >= 3);
+    Log('T');
+
+    /* Another Id arrives first and is ignored, the reply cancels the timer */
+    uTaskMessageSend(pTask, OTHER, uTaskAlloc(8), UTASK_IMMEDIATE);
+    uTaskMessageSend(pTask, DONE, (void *)"reply", 2);
+    UTASK_PT_WAIT_ID_TIMEOUT(&p->Pt, pTask, DONE, 10);
+    CHECK(Id == DONE);
+    CHECK(pMsg != NULL && strcmp(pMsg, "reply") == 0);
+    Log('R');
+
+    for (p->i = 0; p->i < 3; p->i = p->i + 1)
+    {
+        UTASK_PT_YIELD(&p->Pt, pTask);
+        Log('Y');
+    }
+
+    Log('E');
+
+    UTASK_PT_END(&p->Pt);
+}
+
+static Seq_T gSeq = {{SeqHandler}};
+
+/* Runs 20 more ticks after the coroutine is done, a stray timeout shows */
+static void
+TickHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    uTaskTick();
+
+    if (gLen > 0 && gLog[gLen-1] == 'E')
+    {
+        Id = Id + 1;
+    }
+
+    if (Id < 20 && uTaskGetTick() < 200)
+    {
+        uTaskMessageSend(pTask, Id, NULL, UTASK_IMMEDIATE);
+    }
+    else
+    {
+        uTaskDtor();
+    }
+}
+
+static uTask_T gTicker = {TickHandler};
+
+int
+main(
+    void
+    )
+{
+    uTaskPoolStats_T Stats;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    UTASK_PT_INIT(&gSeq.Pt);
+    uTaskMessageSend(&gSeq.Task, 1, NULL, UTASK_IMMEDIATE);
+    uTaskMessageSend(&gTicker, 0, NULL, UTASK_IMMEDIATE);
+    uTaskMessageLoop();
+
+    CHECK(strcmp(gLog, "SDTRYYYE") == 0);
+    CHECK(gSeq.Runs == 1);
+
+    /* The ignored message was freed by the loop */
+    uTaskPoolStats(0, &Stats);
+    CHECK(Stats.uFree == Stats.uCount);
+
+    /* The next message starts over */
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    uTaskMessageSend(&gSeq.Task, 1, NULL, UTASK_IMMEDIATE);
+    uTaskMessageSend(&gTicker, 0, NULL, UTASK_IMMEDIATE);
+    uTaskMessageLoop();
+
+    CHECK(strcmp(gLog, "SDTRYYYESX") == 0);
+    CHECK(gSeq.Runs == 2);
+    CHECK(sizeof(uTaskPt_T) == 8);
+
+    return TEST_DONE();
+}
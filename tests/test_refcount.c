@@ -0,0 +1,132 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Reference counted pool blocks and multicast sends, with the default
+ * UTASK_POOL_REFCOUNT 1 and a variable size region.
+ */
+#include <string.h>
+#include "utask.h"
+#include "test.h"
+
+#define RECEIVERS       5
+
+static uTask_T gTask[RECEIVERS];
+static void *gSeen[RECEIVERS];
+static void *gKept;
+static int gCount;
+
+static unsigned int
+PoolFree(
+    int             Pool
+    )
+{
+    uTaskPoolStats_T Stats;
+
+    uTaskPoolStats(Pool, &Stats);
+
+    return Stats.uFree;
+}
+
+/* The first receiver keeps the block past its dispatch */
+static void
+Handler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    int i = (int)(pTask - gTask);
+
+    gSeen[i] = pMsg;
+    gCount = gCount + 1;
+
+    if (i == 0)
+    {
+        CHECK(uTaskMsgRetain(pMsg) == UTASK_S_OK);
+        gKept = pMsg;
+    }
+
+    if (gCount == RECEIVERS)
+    {
+        uTaskDtor();
+    }
+}
+
+static uTask_T gTask[RECEIVERS] = {
+    {Handler}, {Handler}, {Handler}, {Handler}, {Handler}
+};
+
+int
+main(
+    void
+    )
+{
+    uTask_T *pTask[RECEIVERS];
+    char Stack[8];
+    void *p;
+    int i;
+    int n;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    /* Each reference is dropped by one free */
+    p = uTaskAlloc(8);
+    CHECK(uTaskMsgRetain(p) == UTASK_S_OK);
+    CHECK(uTaskMsgRetain(p) == UTASK_S_OK);
+    uTaskFree(p);
+    uTaskMsgRelease(p);
+    CHECK(PoolFree(0) == 15);
+    uTaskFree(p);
+    CHECK(PoolFree(0) == 16);
+
+    /* At most 127 extra references */
+    p = uTaskAlloc(8);
+
+    for (i = 0; i < 127; i = i + 1)
+    {
+        CHECK(uTaskMsgRetain(p) == UTASK_S_OK);
+    }
+    CHECK(uTaskMsgRetain(p) != UTASK_S_OK);
+
+    for (i = 0; i < 128; i = i + 1)
+    {
+        uTaskFree(p);
+    }
+    CHECK(PoolFree(0) == 16);
+
+    /* Memory uTask did not allocate is left alone, region blocks refused */
+    CHECK(uTaskMsgRetain(Stack) == UTASK_S_OK);
+    p = uTaskAlloc(200);
+    CHECK(p != NULL);
+    CHECK(uTaskMsgRetain(p) != UTASK_S_OK);
+    uTaskFree(p);
+
+    /* One block to every receiver, freed after the last handler */
+    for (i = 0; i < RECEIVERS; i = i + 1)
+    {
+        pTask[i] = &gTask[i];
+    }
+
+    p = uTaskAlloc(32);
+    strcpy(p, "shared");
+
+    n = uTaskMessageMulticast(pTask, RECEIVERS, 0, p, UTASK_IMMEDIATE);
+    CHECK(n == RECEIVERS);
+
+    uTaskMessageLoop();
+
+    for (i = 0; i < RECEIVERS; i = i + 1)
+    {
+        CHECK(gSeen[i] == p);
+    }
+
+    CHECK(gKept == p);
+    CHECK(strcmp(gKept, "shared") == 0);
+    CHECK(PoolFree(2) == 3);
+
+    uTaskFree(gKept);
+    CHECK(PoolFree(2) == 4);
+
+    return TEST_DONE();
+}
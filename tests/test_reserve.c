@@ -0,0 +1,74 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Pool blocks held back for isr allocs, built with UTASK_POOL_RESERVE1 3.
+ */
+#include "utask.h"
+#include "test.h"
+
+int
+main(
+    void
+    )
+{
+    uTaskPoolStats_T Stats;
+    void *p[16];
+    void *pIsr[4];
+    int PrevState;
+    int i;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    uTaskPoolStats(0, &Stats);
+    CHECK(Stats.uCount == 16);
+    CHECK(Stats.uReserve == 3);
+
+    /* Task allocs stop at the reserve */
+    for (i = 0; i < 13; i = i + 1)
+    {
+        p[i] = uTaskAlloc(8);
+        CHECK(p[i] != NULL);
+    }
+    CHECK(uTaskAlloc(8) == NULL);
+
+    /* Isr allocs get the reserve, then count that it ran out */
+    PrevState = uTaskInterruptDisable();
+
+    for (i = 0; i < 4; i = i + 1)
+    {
+        pIsr[i] = uTaskAllocIsr(8);
+    }
+
+    uTaskInterruptRestore(PrevState);
+
+    CHECK(pIsr[0] != NULL && pIsr[1] != NULL && pIsr[2] != NULL);
+    CHECK(pIsr[3] == NULL);
+
+    uTaskPoolStats(0, &Stats);
+    CHECK(Stats.uFree == 0);
+    CHECK(Stats.uReserveUsed == 3);
+    CHECK(Stats.uReserveEmpty == 1);
+
+    /* Freeing refills the reserve before task allocs see a block */
+    uTaskFree(pIsr[0]);
+    CHECK(uTaskAlloc(8) == NULL);
+
+    uTaskFree(pIsr[1]);
+    uTaskFree(pIsr[2]);
+    uTaskFree(p[0]);
+    p[0] = uTaskAlloc(8);
+    CHECK(p[0] != NULL);
+    CHECK(uTaskAlloc(8) == NULL);
+
+    /* Other pools have no reserve */
+    uTaskPoolStats(1, &Stats);
+    CHECK(Stats.uReserve == 0);
+
+    for (i = 0; i < 8; i = i + 1)
+    {
+        CHECK(uTaskAlloc(16) != NULL);
+    }
+
+    return TEST_DONE();
+}
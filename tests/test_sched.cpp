@@ -0,0 +1,198 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Schedulers from utask.hpp, built as C++20 with UTASK_POOL_ALIGN 16 and
+ * 512 byte blocks for the frames.  A small scheduler with four task control
+ * blocks runs an actor and fills up, a fast one ticking 10000 times a
+ * second runs a coroutine sleeping on its ticks.  Neither may touch the
+ * thread's own instance.  A scheduler destroyed with messages queued must
+ * give their memory back.
+ */
+#include "utask.hpp"
+#include "test.h"
+
+#define PINGS           1000
+#define ISR_ID          3
+
+struct small_cfg : utask::config
+{
+    static constexpr int tcb_slots = 4;
+};
+
+struct fast_cfg : utask::config
+{
+    static constexpr int tcb_slots = 16;
+    static constexpr unsigned long ticks_per_sec = 10000;
+};
+
+typedef utask::scheduler<small_cfg> small_sched;
+typedef utask::scheduler<fast_cfg> fast_sched;
+
+static_assert(small_sched::tcb_slots == 4 &&
+              small_sched::ticks_per_sec == UTASK_TICKS_PER_SEC,
+              "small_cfg keeps the default tick rate");
+static_assert(fast_sched::ms(5) == 50, "ms() counts the scheduler's ticks");
+static_assert(small_sched::storage ==
+              sizeof(uTaskCore_T) + 4 * sizeof(uTaskTcb_T),
+              "storage is the core and its tcbs");
+
+static small_sched gSmall;
+static fast_sched gFast;
+
+struct Ping
+{
+    int     Count;
+};
+
+class Pinger : public utask::actor<Pinger, Ping>
+{
+public:
+    void
+    on(
+        const Ping      &Msg
+        )
+    {
+        m_Got = m_Got + 1;
+
+        if (Msg.Count > 0)
+        {
+            CHECK(gSmall.send<Ping>(*this, Msg.Count - 1));
+        }
+        else
+        {
+            gSmall.stop();
+        }
+    }
+
+    int     m_Got = 0;
+};
+
+static Pinger gPinger;
+static int gIsr;
+static unsigned long gSlept;
+
+static void
+IdleHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    if (Id == ISR_ID)
+    {
+        gIsr = gIsr + 1;
+    }
+}
+
+static uTask_T gIdle = {IdleHandler};
+
+/* Ticks the fast scheduler once per pass of its loop */
+static void
+TickHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    gFast.tick();
+    CHECK(gFast.send(pTask, 0, NULL) == UTASK_S_OK);
+}
+
+static uTask_T gTicker = {TickHandler};
+
+static utask::coro
+Nap(
+    void
+    )
+{
+    unsigned long Start = gFast.now();
+
+    co_await utask::sleep(gFast, 2);
+    gSlept = gFast.now() - Start;
+
+    gFast.stop();
+}
+
+static int
+PoolFull(
+    void
+    )
+{
+    uTaskPoolStats_T Stats;
+    int i;
+
+    for (i = 0; uTaskPoolStats(i, &Stats) == UTASK_S_OK; i = i + 1)
+    {
+        if (Stats.uFree != Stats.uCount)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int
+main(
+    void
+    )
+{
+    int PrevState;
+    int i;
+
+    /* Message memory comes from the global pools */
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    CHECK(gSmall.send<Ping>(gPinger, PINGS));
+    PrevState = uTaskInterruptDisable();
+    CHECK(gSmall.send_isr(&gIdle, ISR_ID, NULL) == UTASK_S_OK);
+    uTaskInterruptRestore(PrevState);
+
+    gSmall.run();
+
+    CHECK(gPinger.m_Got == PINGS + 1);
+    CHECK(gIsr == 1);
+    CHECK(PoolFull());
+
+    /* Four queued messages take every tcb, then sends fail until a cancel */
+    for (i = 0; i < 4; i = i + 1)
+    {
+        CHECK(gSmall.send(&gIdle, i, NULL, 100) == UTASK_S_OK);
+    }
+
+    CHECK(gSmall.send(&gIdle, 4, NULL) != UTASK_S_OK);
+    CHECK(!gSmall.send<Ping>(gPinger, 0));
+    CHECK(PoolFull());
+
+    CHECK(gSmall.cancel(&gIdle, 2) == 1);
+    CHECK(gSmall.send(&gIdle, 4, NULL) == UTASK_S_OK);
+
+    /* A scheduler going away frees the messages it still has queued */
+    {
+        small_sched Local;
+
+        CHECK(Local.send(&gIdle, 0, uTaskAlloc(8), 100) == UTASK_S_OK);
+        CHECK(Local.send<Ping>(gPinger, 1));
+        PrevState = uTaskInterruptDisable();
+        CHECK(Local.send_isr(&gIdle, ISR_ID, uTaskAlloc(8)) == UTASK_S_OK);
+        uTaskInterruptRestore(PrevState);
+        CHECK(!PoolFull());
+    }
+
+    CHECK(PoolFull());
+
+    /* Two milli seconds are 20 ticks of the fast scheduler */
+    CHECK(gFast.send(&gTicker, 0, NULL) == UTASK_S_OK);
+    CHECK(static_cast<bool>(Nap()));
+
+    gFast.run();
+
+    CHECK(gSlept >= 20 && gSlept <= 21);
+    CHECK(PoolFull());
+
+    /* The thread's own instance saw none of it */
+    CHECK(uTaskGetTick() == 0);
+
+    return TEST_DONE();
+}
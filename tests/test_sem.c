@@ -0,0 +1,277 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Semaphores and mutexes, built with UTASK_SEM_USE and UTASK_EXEC_WORKERS
+ * 4.  A driver task takes the free units, queues waiters in first come and
+ * in priority order, cancels one and then releases.  The grants must arrive
+ * in order, one per release, and a mutex must move to its waiter before the
+ * grant.  On the executor a holder uses up its worker's tcbs before it
+ * releases, the queued waiters must still get every grant.
+ */
+#include "utask.h"
+#include "test.h"
+
+#define FIFO_WAITS      3
+#define PRIO_WAITS      4
+#define LOCKER          10
+#define WAITERS         8
+
+/* Ids of the executor case */
+#define GO              1
+#define LOCKED          2
+#define UNIT            3
+
+static uTaskSem_T gFifo;
+static uTaskSem_T gPrio;
+static uTaskMutex_T gMutex;
+static uTaskSemWait_T gWait[FIFO_WAITS + PRIO_WAITS];
+static uTaskSemWait_T gLockWait;
+static uTaskSemWait_T gOwnWait;
+static int gLog[16];
+static int gCount;
+static uTask_T *gOwnerAtGrant;
+
+static uTaskSem_T gExecSem;
+static uTaskMutex_T gExecMutex;
+static uTaskSemWait_T gSemWait[WAITERS];
+static uTaskSemWait_T gMutexWait[WAITERS];
+static uTask_T gWaiter[WAITERS];
+static int gLocked;
+static int gUnits;
+static int gGrants;
+static int gNotOwner;
+static int gFilled;
+
+/* Priorities of the gPrio waiters, equal ones are served in wait order */
+static const int gPrios[PRIO_WAITS] = {1, 5, 3, 5};
+
+static void
+UserHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    if (Id == LOCKER)
+    {
+        CHECK(pMsg == &gLockWait);
+        gOwnerAtGrant = uTaskMutexOwner(&gMutex);
+    }
+    else
+    {
+        CHECK(pMsg == &gWait[Id]);
+    }
+
+    if (gCount < 16)
+    {
+        gLog[gCount] = Id;
+        gCount = gCount + 1;
+    }
+}
+
+static uTask_T gUser = {UserHandler};
+static uTask_T gLocker = {UserHandler};
+
+static void
+DriverHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    int i;
+
+    if (Id == 0)
+    {
+        /* Two free units, then three waiters of which one gives up */
+        CHECK(uTaskSemTryAcquire(&gFifo) == UTASK_S_OK);
+        CHECK(uTaskSemAcquire(&gFifo, &gWait[0], &gUser, 0, 0) == UTASK_S_OK);
+        CHECK(uTaskSemTryAcquire(&gFifo) == UTASK_E_FAIL);
+
+        for (i = 0; i < FIFO_WAITS; i = i + 1)
+        {
+            CHECK(uTaskSemAcquire(&gFifo, &gWait[i], &gUser, i, 0) ==
+                  UTASK_SEM_QUEUED);
+        }
+
+        CHECK(uTaskSemAcquire(&gFifo, &gWait[0], &gUser, 0, 0) ==
+              UTASK_E_FAIL);
+        CHECK(uTaskSemCancel(&gWait[1]) == UTASK_S_OK);
+        CHECK(uTaskSemCancel(&gWait[1]) == UTASK_E_FAIL);
+        CHECK(uTaskSemCount(&gFifo) == 0);
+
+        for (i = 0; i < PRIO_WAITS; i = i + 1)
+        {
+            CHECK(uTaskSemAcquire(&gPrio, &gWait[FIFO_WAITS + i], &gUser,
+                                  FIFO_WAITS + i, gPrios[i]) ==
+                  UTASK_SEM_QUEUED);
+        }
+
+        CHECK(uTaskMutexLock(&gMutex, &gOwnWait, pTask, 0, 0) == UTASK_S_OK);
+        CHECK(uTaskMutexOwner(&gMutex) == pTask);
+        CHECK(uTaskMutexLock(&gMutex, &gOwnWait, pTask, 0, 0) ==
+              UTASK_E_FAIL);
+        CHECK(uTaskMutexLock(&gMutex, &gLockWait, &gLocker, LOCKER, 0) ==
+              UTASK_SEM_QUEUED);
+
+        uTaskMessageSend(pTask, 1, NULL, UTASK_IMMEDIATE);
+    }
+    else if (Id == 1)
+    {
+        /* Nothing was granted yet */
+        CHECK(gCount == 0);
+
+        uTaskSemRelease(&gFifo);
+        uTaskSemRelease(&gFifo);
+        uTaskSemRelease(&gFifo);
+        CHECK(uTaskSemCount(&gFifo) == 1);
+
+        for (i = 0; i < PRIO_WAITS; i = i + 1)
+        {
+            uTaskSemRelease(&gPrio);
+        }
+
+        CHECK(uTaskMutexUnlock(&gMutex, &gLocker) == UTASK_E_FAIL);
+        CHECK(uTaskMutexUnlock(&gMutex, pTask) == UTASK_S_OK);
+        CHECK(uTaskMutexOwner(&gMutex) == &gLocker);
+        CHECK(uTaskMutexUnlock(&gMutex, pTask) == UTASK_E_FAIL);
+
+        uTaskMessageSend(pTask, 2, NULL, UTASK_IMMEDIATE);
+    }
+    else
+    {
+        CHECK(uTaskMutexUnlock(&gMutex, &gLocker) == UTASK_S_OK);
+        CHECK(uTaskMutexOwner(&gMutex) == NULL);
+
+        uTaskDtor();
+    }
+}
+
+static uTask_T gDriver = {DriverHandler};
+
+static void
+IdleHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+}
+
+static uTask_T gIdle = {IdleHandler};
+
+/* Passes the mutex on, the last grant stops the executor */
+static void
+WaiterHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    if (Id == LOCKED)
+    {
+        if (uTaskMutexOwner(&gExecMutex) != pTask)
+        {
+            __atomic_add_fetch(&gNotOwner, 1, __ATOMIC_RELAXED);
+        }
+
+        __atomic_add_fetch(&gLocked, 1, __ATOMIC_RELAXED);
+        CHECK(uTaskMutexUnlock(&gExecMutex, pTask) == UTASK_S_OK);
+    }
+    else
+    {
+        __atomic_add_fetch(&gUnits, 1, __ATOMIC_RELAXED);
+    }
+
+    if (__atomic_add_fetch(&gGrants, 1, __ATOMIC_RELAXED) == WAITERS * 2)
+    {
+        uTaskDtor();
+    }
+}
+
+/* Takes every tcb of its worker, then releases */
+static void
+HolderHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    int i;
+
+    while (uTaskMessageSend(&gIdle, 0, NULL, 1000000) == UTASK_S_OK)
+    {
+        gFilled = gFilled + 1;
+    }
+
+    for (i = 0; i < WAITERS; i = i + 1)
+    {
+        uTaskSemRelease(&gExecSem);
+    }
+
+    CHECK(uTaskMutexUnlock(&gExecMutex, pTask) == UTASK_S_OK);
+}
+
+static uTask_T gHolder = {HolderHandler};
+
+int
+main(
+    void
+    )
+{
+    static const int Expect[] = {0, 2, 4, 6, 5, 3, LOCKER};
+    int i;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    uTaskSemInit(&gFifo, 2, UTASK_SEM_FIFO);
+    uTaskSemInit(&gPrio, 0, UTASK_SEM_PRIO);
+    uTaskMutexInit(&gMutex, UTASK_SEM_FIFO);
+
+    uTaskMessageSend(&gDriver, 0, NULL, UTASK_IMMEDIATE);
+    uTaskMessageLoop();
+
+    /* One grant per release, then the spare unit stayed free */
+    CHECK(gCount == (int)(sizeof(Expect) / sizeof(Expect[0])));
+
+    for (i = 0; i < gCount; i = i + 1)
+    {
+        CHECK(gLog[i] == Expect[i]);
+    }
+
+    CHECK(gOwnerAtGrant == &gLocker);
+    CHECK(uTaskSemCount(&gFifo) == 1);
+    CHECK(uTaskSemCount(&gPrio) == 0);
+
+    /* The waiters queue before the executor runs, each with its tcb */
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    CHECK(uTaskExecCtor(4) == UTASK_S_OK);
+
+    uTaskSemInit(&gExecSem, 0, UTASK_SEM_FIFO);
+    uTaskMutexInit(&gExecMutex, UTASK_SEM_FIFO);
+
+    CHECK(uTaskMutexLock(&gExecMutex, &gOwnWait, &gHolder, 0, 0) ==
+          UTASK_S_OK);
+
+    for (i = 0; i < WAITERS; i = i + 1)
+    {
+        gWaiter[i].Handler = WaiterHandler;
+
+        CHECK(uTaskMutexLock(&gExecMutex, &gMutexWait[i], &gWaiter[i],
+                             LOCKED, 0) == UTASK_SEM_QUEUED);
+        CHECK(uTaskSemAcquire(&gExecSem, &gSemWait[i], &gWaiter[i], UNIT,
+                              0) == UTASK_SEM_QUEUED);
+    }
+
+    uTaskMessageSend(&gHolder, GO, NULL, UTASK_IMMEDIATE);
+    uTaskExecRun();
+
+    CHECK(gFilled > 0);
+    CHECK(gLocked == WAITERS && gUnits == WAITERS);
+    CHECK(gNotOwner == 0);
+    CHECK(uTaskMutexOwner(&gExecMutex) == NULL);
+    CHECK(uTaskSemCount(&gExecSem) == 0);
+
+    return TEST_DONE();
+}
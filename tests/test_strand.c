@@ -0,0 +1,136 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Shared strands on the executor, built with UTASK_EXEC_WORKERS 4.  Each
+ * of the GROUPS strands has MEMBERS tasks that all send themselves
+ * messages, the handlers check that no two tasks of a strand run at once.
+ * A feeder sends numbered messages to two tasks of the first strand, the
+ * strand must handle them in send order.
+ */
+#include "utask.h"
+#include "test.h"
+
+#define GROUPS          8
+#define MEMBERS         4
+#define SENDS           1000
+#define FEEDS           64
+
+static uTaskStrand_T gStrand[GROUPS];
+static uTask_T gTask[GROUPS][MEMBERS];
+static int gBusy[GROUPS];
+static int gOverlap;
+static int gFeedNext;
+static int gFeedOrder;
+static int gDone;
+
+static void
+Handler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    int g = (int)(pTask - &gTask[0][0]) / MEMBERS;
+
+    if (__atomic_exchange_n(&gBusy[g], 1, __ATOMIC_ACQUIRE))
+    {
+        __atomic_add_fetch(&gOverlap, 1, __ATOMIC_RELAXED);
+    }
+
+    if (Id < 0)
+    {
+        /* A feed, -1 - Id is its number */
+        if (-1 - Id != gFeedNext)
+        {
+            gFeedOrder = gFeedOrder + 1;
+        }
+        gFeedNext = -Id;
+    }
+    else if (Id + 1 < SENDS)
+    {
+        CHECK(uTaskMessageSend(pTask, Id + 1, NULL, UTASK_IMMEDIATE) ==
+              UTASK_S_OK);
+    }
+    else if (__atomic_add_fetch(&gDone, 1, __ATOMIC_RELAXED) ==
+             GROUPS * MEMBERS)
+    {
+        uTaskDtor();
+    }
+
+    __atomic_store_n(&gBusy[g], 0, __ATOMIC_RELEASE);
+}
+
+/* Sends all the feeds from one handler, alternating between two tasks */
+static void
+FeedHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    int i;
+
+    for (i = 0; i < FEEDS; i = i + 1)
+    {
+        CHECK(uTaskMessageSend(&gTask[0][i & 1], -1 - i, NULL,
+                               UTASK_IMMEDIATE) == UTASK_S_OK);
+    }
+}
+
+static uTask_T gFeeder = {FeedHandler};
+
+int
+main(
+    void
+    )
+{
+    int g;
+    int m;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    CHECK(uTaskExecCtor(4) == UTASK_S_OK);
+
+    for (g = 0; g < GROUPS; g = g + 1)
+    {
+        uTaskStrandInit(&gStrand[g], 0);
+
+        for (m = 0; m < MEMBERS; m = m + 1)
+        {
+            gTask[g][m].Handler = Handler;
+            uTaskStrandJoin(&gTask[g][m], &gStrand[g]);
+            uTaskMessageSend(&gTask[g][m], 0, NULL, UTASK_IMMEDIATE);
+        }
+    }
+
+    uTaskMessageSend(&gFeeder, 0, NULL, UTASK_IMMEDIATE);
+
+    uTaskExecRun();
+
+    CHECK(gDone == GROUPS * MEMBERS);
+    CHECK(gOverlap == 0);
+    CHECK(gFeedNext == FEEDS);
+    CHECK(gFeedOrder == 0);
+
+    /* Back on their own strands the tasks still run, each on its own */
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    CHECK(uTaskExecCtor(4) == UTASK_S_OK);
+
+    gDone = 0;
+
+    for (g = 0; g < GROUPS; g = g + 1)
+    {
+        for (m = 0; m < MEMBERS; m = m + 1)
+        {
+            uTaskStrandJoin(&gTask[g][m], NULL);
+            CHECK(gTask[g][m].pStrand == NULL);
+            uTaskMessageSend(&gTask[g][m], SENDS - 1, NULL, UTASK_IMMEDIATE);
+        }
+    }
+
+    uTaskExecRun();
+
+    CHECK(gDone == GROUPS * MEMBERS);
+
+    return TEST_DONE();
+}
@@ -0,0 +1,171 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Bip-buffer byte streams from an isr to a task, built with
+ * UTASK_STREAM_USE.  A second thread holding the interrupt lock stands in
+ * for the isr.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include "utask.h"
+#include "test.h"
+
+#define TOTAL           100000
+
+static uTaskStream_T gStream;
+static unsigned char gBuf[64];
+static unsigned char gBigBuf[4096];
+static int gWakes;
+static int gRead;
+static int gBad;
+
+/* Reads the stream empty, the bytes count up from 0 */
+static void
+Handler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    unsigned char *p;
+    int Len;
+    int i;
+
+    gWakes = gWakes + 1;
+
+    while ((p = uTaskStreamRead(pMsg, &Len)) != NULL)
+    {
+        for (i = 0; i < Len; i = i + 1)
+        {
+            gBad = gBad + (p[i] != (unsigned char)(gRead + i));
+        }
+
+        gRead = gRead + Len;
+        uTaskStreamConsume(pMsg, Len);
+    }
+
+    if (gRead == TOTAL)
+    {
+        uTaskDtor();
+    }
+}
+
+static uTask_T gTask = {Handler};
+
+static void *
+Isr(
+    void            *pArg
+    )
+{
+    unsigned char Data[13];
+    int Sent = 0;
+    int Len;
+    int PrevState;
+    int Status;
+    int i;
+
+    while (Sent < TOTAL)
+    {
+        Len = TOTAL - Sent < 13 ? TOTAL - Sent : 1 + Sent % 13;
+
+        for (i = 0; i < Len; i = i + 1)
+        {
+            Data[i] = (unsigned char)(Sent + i);
+        }
+
+        PrevState = uTaskInterruptDisable();
+        Status = uTaskStreamWriteIsr(&gStream, Data, Len);
+        uTaskInterruptRestore(PrevState);
+
+        if (Status == UTASK_S_OK)
+        {
+            Sent = Sent + Len;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+int
+main(
+    void
+    )
+{
+    pthread_t Thread;
+    unsigned char Data[64];
+    unsigned char *p;
+    int PrevState;
+    int Len;
+    int i;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    uTaskStreamInit(&gStream, gBuf, sizeof(gBuf), &gTask, 1);
+
+    for (i = 0; i < (int)sizeof(Data); i = i + 1)
+    {
+        Data[i] = (unsigned char)i;
+    }
+
+    PrevState = uTaskInterruptDisable();
+
+    /* Only the write to an empty stream wakes the task */
+    CHECK(uTaskStreamWriteIsr(&gStream, Data, 50) == UTASK_S_OK);
+    CHECK(uTaskStreamWriteIsr(&gStream, Data + 50, 10) == UTASK_S_OK);
+    CHECK(uTaskStreamWriteIsr(&gStream, Data, 10) != UTASK_S_OK);
+
+    uTaskInterruptRestore(PrevState);
+
+    p = uTaskStreamRead(&gStream, &Len);
+    CHECK(p == gBuf && Len == 60);
+    uTaskStreamConsume(&gStream, 40);
+
+    /* No room at the end, the space freed at the front is used */
+    PrevState = uTaskInterruptDisable();
+
+    p = uTaskStreamReserveIsr(&gStream, 30);
+    CHECK(p == gBuf);
+    memcpy(p, Data + 60, 4);
+    uTaskStreamCommitIsr(&gStream, 4);
+    CHECK(uTaskStreamReserveIsr(&gStream, 40) == NULL);
+
+    uTaskInterruptRestore(PrevState);
+
+    /* The older span is read first, then the wrapped one */
+    p = uTaskStreamRead(&gStream, &Len);
+    CHECK(p == gBuf + 40 && Len == 20);
+    CHECK(memcmp(p, Data + 40, 20) == 0);
+    uTaskStreamConsume(&gStream, 20);
+
+    p = uTaskStreamRead(&gStream, &Len);
+    CHECK(p == gBuf && Len == 4);
+    CHECK(memcmp(p, Data + 60, 4) == 0);
+    uTaskStreamConsume(&gStream, 4);
+    CHECK(uTaskStreamRead(&gStream, &Len) == NULL);
+
+    /* The single wake up from the first write is still queued */
+    gRead = TOTAL;
+    uTaskMessageLoop();
+    CHECK(gWakes == 1);
+
+    /* An isr thread streams bytes to the task through the loop */
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    uTaskStreamInit(&gStream, gBigBuf, sizeof(gBigBuf), &gTask, 1);
+    gWakes = 0;
+    gRead = 0;
+
+    pthread_create(&Thread, NULL, Isr, NULL);
+    uTaskMessageLoop();
+    pthread_join(Thread, NULL);
+
+    CHECK(gRead == TOTAL);
+    CHECK(gBad == 0);
+    CHECK(gWakes > 0);
+
+    return TEST_DONE();
+}
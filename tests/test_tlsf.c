@@ -0,0 +1,113 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Variable size region for allocs larger than every pool block, built
+ * with UTASK_TLSF_SIZE 64K and UTASK_POOL_ALIGN 32.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utask.h"
+#include "test.h"
+
+#define SLOTS           200
+#define ROUNDS          200000
+
+static int gGot;
+
+static void
+Handler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    unsigned char *p = pMsg;
+
+    gGot = p && p[0] == Id && p[999] == Id;
+    uTaskDtor();
+}
+
+static uTask_T gTask = {Handler};
+
+int
+main(
+    void
+    )
+{
+    unsigned char *p[SLOTS] = {0};
+    int Size[SLOTS] = {0};
+    unsigned char *pBig;
+    int Bad = 0;
+    int Fails = 0;
+    int i;
+    int k;
+    int n;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    /* Too large for the region */
+    CHECK(uTaskAlloc(UTASK_TLSF_SIZE + 1) == NULL);
+
+    /* Random allocs and frees, no block overlaps another */
+    srand(1);
+
+    for (n = 0; n < ROUNDS; n = n + 1)
+    {
+        i = rand() % SLOTS;
+
+        if (p[i])
+        {
+            for (k = 0; k < Size[i]; k = k + 1)
+            {
+                Bad = Bad + (p[i][k] != (unsigned char)i);
+            }
+
+            uTaskFree(p[i]);
+            p[i] = NULL;
+        }
+        else
+        {
+            Size[i] = 65 + rand() % (rand() % 4 ? 200 : 3000);
+            p[i] = uTaskAlloc(Size[i]);
+
+            if (p[i])
+            {
+                Bad = Bad + ((uintptr_t)p[i] % 32 != 0);
+                memset(p[i], i, Size[i]);
+            }
+            else
+            {
+                Fails = Fails + 1;
+            }
+        }
+    }
+
+    CHECK(Bad == 0);
+    CHECK(Fails < ROUNDS / 4);
+
+    /* Freed neighbours merge back into one block */
+    for (i = 0; i < SLOTS; i = i + 1)
+    {
+        uTaskFree(p[i]);
+    }
+
+    pBig = uTaskAlloc(UTASK_TLSF_SIZE / 4 * 3);
+    CHECK(pBig != NULL);
+    CHECK(uTaskAlloc(UTASK_TLSF_SIZE / 4 * 3) == NULL);
+    uTaskFree(pBig);
+
+    /* The loop frees a region block sent as a message */
+    pBig = uTaskAlloc(1000);
+    CHECK(pBig != NULL);
+    memset(pBig, 7, 1000);
+    uTaskMessageSend(&gTask, 7, pBig, UTASK_IMMEDIATE);
+    uTaskMessageLoop();
+    CHECK(gGot);
+
+    pBig = uTaskAlloc(UTASK_TLSF_SIZE / 4 * 3);
+    CHECK(pBig != NULL);
+
+    return TEST_DONE();
+}
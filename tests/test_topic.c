@@ -0,0 +1,187 @@
+/*
+ * uTask tests
+ *
+ * Description:
+ * Topics, built with UTASK_TOPIC_USE and UTASK_TCB_SLOTS 16.  Eight
+ * tasks subscribe to a topic, every publish must reach the subscribers in
+ * subscription order with the same block, which is freed after the last of
+ * them.  A publish with too few tcbs reaches the first subscribers only and
+ * keeps one reference for each of them.
+ */
+#include "utask.h"
+#include "test.h"
+
+#define SUBS            8
+#define DELAY           3
+#define STOP            99
+
+typedef struct
+{
+    int             Id;
+    void            *pMsg;
+    unsigned long   Tick;
+} Got_T;
+
+static uTask_T gTask[SUBS];
+static uTaskSub_T gSub[SUBS];
+static uTaskTopic_T gTopic;
+static uTaskTopic_T gEmpty;
+static Got_T gGot[SUBS * 3];
+static int gCount;
+
+static void
+SubHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    if (Id == STOP)
+    {
+        uTaskDtor();
+        return;
+    }
+
+    CHECK(pTask == &gTask[Id]);
+
+    if (gCount < SUBS * 3)
+    {
+        gGot[gCount].Id = Id;
+        gGot[gCount].pMsg = pMsg;
+        gGot[gCount].Tick = uTaskGetTick();
+        gCount = gCount + 1;
+    }
+}
+
+static void
+IdleHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+}
+
+static uTask_T gIdle = {IdleHandler};
+
+static void
+TickHandler(
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg
+    )
+{
+    uTaskTick();
+
+    if (uTaskGetTick() < DELAY * 2)
+    {
+        uTaskMessageSend(pTask, 0, NULL, UTASK_IMMEDIATE);
+    }
+    else
+    {
+        uTaskMessageSend(&gTask[0], STOP, NULL, UTASK_IMMEDIATE);
+    }
+}
+
+static uTask_T gTicker = {TickHandler};
+
+static int
+PoolFull(
+    void
+    )
+{
+    uTaskPoolStats_T Stats;
+
+    uTaskPoolStats(0, &Stats);
+
+    return Stats.uFree == Stats.uCount;
+}
+
+int
+main(
+    void
+    )
+{
+    void *pFirst;
+    void *pSecond;
+    void *p;
+    int i;
+    int n;
+
+    CHECK(uTaskCtor() == UTASK_S_OK);
+
+    for (i = 0; i < SUBS; i = i + 1)
+    {
+        gTask[i].Handler = SubHandler;
+        CHECK(uTaskSubscribe(&gTopic, &gSub[i], &gTask[i], i) == UTASK_S_OK);
+    }
+
+    CHECK(uTaskSubscribe(&gTopic, &gSub[3], &gTask[3], 3) != UTASK_S_OK);
+
+    pFirst = uTaskAlloc(8);
+    CHECK(uTaskPublish(&gTopic, pFirst, UTASK_IMMEDIATE) == SUBS);
+
+    /* The second publish misses the dropped subscriber */
+    CHECK(uTaskUnsubscribe(&gTopic, &gSub[5]) == UTASK_S_OK);
+    CHECK(uTaskUnsubscribe(&gTopic, &gSub[5]) != UTASK_S_OK);
+
+    pSecond = uTaskAlloc(8);
+    CHECK(uTaskPublish(&gTopic, pSecond, DELAY) == SUBS - 1);
+
+    /* Nobody to send to, the block is still ours */
+    p = uTaskAlloc(8);
+    CHECK(uTaskPublish(&gEmpty, p, UTASK_IMMEDIATE) == 0);
+    uTaskFree(p);
+
+    uTaskMessageSend(&gTicker, 0, NULL, UTASK_IMMEDIATE);
+    uTaskMessageLoop();
+
+    CHECK(gCount == SUBS * 2 - 1);
+
+    for (i = 0; i < SUBS; i = i + 1)
+    {
+        CHECK(gGot[i].Id == i && gGot[i].pMsg == pFirst);
+    }
+
+    n = SUBS;
+
+    for (i = 0; i < SUBS; i = i + 1)
+    {
+        if (i != 5)
+        {
+            CHECK(gGot[n].Id == i && gGot[n].pMsg == pSecond);
+            CHECK(gGot[n].Tick >= DELAY);
+            n = n + 1;
+        }
+    }
+
+    CHECK(PoolFull());
+
+    /* With 3 tcbs left the publish reaches 3 subscribers */
+    CHECK(uTaskCtor() == UTASK_S_OK);
+    CHECK(uTaskSubscribe(&gTopic, &gSub[5], &gTask[5], 5) == UTASK_S_OK);
+
+    for (i = 0; i < 16 - 3; i = i + 1)
+    {
+        CHECK(uTaskMessageSend(&gIdle, 0, NULL, 1000) == UTASK_S_OK);
+    }
+
+    gCount = 0;
+    p = uTaskAlloc(8);
+    CHECK(uTaskPublish(&gTopic, p, UTASK_IMMEDIATE) == 3);
+
+    CHECK(uTaskMessageCancel(&gIdle, 0) == 16 - 3);
+    uTaskMessageSend(&gTask[0], STOP, NULL, UTASK_IMMEDIATE);
+    uTaskMessageLoop();
+
+    CHECK(gCount == 3);
+
+    for (i = 0; i < 3; i = i + 1)
+    {
+        CHECK(gGot[i].Id == i && gGot[i].pMsg == p);
+    }
+
+    CHECK(PoolFull());
+
+    return TEST_DONE();
+}
@@ -3,9 +3,39 @@
  *
  */
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include "utask.h"
 
+#if UTASK_POOL_HUGEPAGE
+#include <sys/mman.h>
+#endif
+
+#if UTASK_EXEC_WORKERS
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+#if UTASK_IDLE_PARK
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#if UTASK_PORT_POSIX
+#include <pthread.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#endif
+
 /* Documentation macros */
 #define IN
 #define OUT
@@ -54,6 +84,22 @@
 #define CORE_FLAGS_INIT     (1 << 0)
 #define CORE_FLAGS_SHUTDOWN (1 << 1)
 
+/* Park states of an idle loop */
+#define CORE_RUN            0
+#define CORE_PARK           1
+#define CORE_PARK_TIMER     2
+
+/* Set when the tick, flags and isr queue are shared with other threads */
+#define CORE_ATOMIC\
+    (UTASK_EXEC_WORKERS || UTASK_PORT_POSIX || UTASK_IDLE_PARK)
+
+/* Flags are read by loops while other threads may set them */
+#if CORE_ATOMIC
+#define CORE_FLAGS(c)       __atomic_load_n(&(c)->Flags, __ATOMIC_ACQUIRE)
+#else
+#define CORE_FLAGS(c)       ((c)->Flags)
+#endif
+
 #define TCB_FLAGS_APP       (1 << 0)
 #define TCB_FLAGS_ISR       (1 << 1)
 
@@ -105,6 +151,35 @@
 #define QUEUE_FULL(q)\
     ((q.hdr.rear + 1) % q.hdr.size == q.hdr.front)
 
+/*
+ * When isr's are threads the loop must see an item before the new rear, the
+ * index is published with release and read with acquire.
+ */
+#if CORE_ATOMIC
+
+#undef QUEUE_PUT
+#define QUEUE_PUT(q, item)\
+    q.items[q.hdr.rear] = item;\
+    __atomic_store_n(&q.hdr.rear, (q.hdr.rear+1) % q.hdr.size,\
+                     __ATOMIC_RELEASE)
+
+#undef QUEUE_GET
+#define QUEUE_GET(q, item)\
+    item = q.items[q.hdr.front];\
+    __atomic_store_n(&q.hdr.front, (q.hdr.front + 1) % q.hdr.size,\
+                     __ATOMIC_RELEASE)
+
+#undef QUEUE_EMPTY
+#define QUEUE_EMPTY(q)\
+    (q.hdr.front == __atomic_load_n(&q.hdr.rear, __ATOMIC_ACQUIRE))
+
+#undef QUEUE_FULL
+#define QUEUE_FULL(q)\
+    ((q.hdr.rear + 1) % q.hdr.size ==\
+     __atomic_load_n(&q.hdr.front, __ATOMIC_ACQUIRE))
+
+#endif
+
 /* Private - do not access directly - use above macros */
 typedef struct
 {
@@ -123,266 +198,661 @@ typedef long            int32;
 typedef unsigned long   uint32;
 typedef unsigned int    uint;
 
-typedef struct Tcb_T
-{
-    struct Tcb_T        *pNext;
-    struct Tcb_T        *pPrev;
-    uint16              Flags;
-    uTask_T             *pTask;
-    int                 Id;
-    void                *pMsg;
-    uint32              Expire;
-} Tcb_T;
+typedef uTaskTcb_T      Tcb_T;
 
-typedef struct
+/* Chain segment, a pool block holding uLen bytes at uOff after the header */
+typedef struct ChainSeg_T
 {
-    queue_hdr_t         hdr;
-    Tcb_T               items[UTASK_ISR_QUEUE_SIZE+1];
-} IsrQ_T;
+    struct ChainSeg_T   *pNext;
+    uint16              uOff;
+    uint16              uLen;
+} ChainSeg_T;
 
+/* Chain header, the handle passed as a message */
 typedef struct
 {
-    uint16              Flags;
-    uint32              Tick;
-    Tcb_T               *pFree;
-    Tcb_T               *pHead;
-    Tcb_T               *pTail;
-    IsrQ_T              IsrQ;
-    Tcb_T               Tcb[UTASK_TCB_SLOTS];
-} uTaskCore_T;
+    ChainSeg_T          *pHead;
+    ChainSeg_T          *pTail;
+    uint                uLen;
+} Chain_T;
 
 /******************************************************************************/
 
 void
 TcbInit(
-    void
+    IN uTaskCore_T *pCore,
+    IN Tcb_T *pTcb,
+    IN int Count
     );
 
 Tcb_T *
 TcbAlloc(
-    void
+    IN uTaskCore_T *pCore
     );
 
 void
 TcbFree(
+    IN uTaskCore_T *pCore,
     IN Tcb_T *pTcb
     );
 
 Tcb_T *
 TcbFront(
-    void
+    IN uTaskCore_T *pCore
     );
 
 void
 TcbEnqueue(
+    IN uTaskCore_T *pCore,
     IN Tcb_T *pTcb
     );
 
 Tcb_T *
 TcbDequeue(
-    void
+    IN uTaskCore_T *pCore
     );
 
-/******************************************************************************/
+void
+TcbEnqueueRun(
+    IN uTaskCore_T *pCore,
+    IN Tcb_T *pFirst,
+    IN Tcb_T *pLast
+    );
 
 void
-PoolInit(
+TcbRemove(
+    IN uTaskCore_T *pCore,
+    IN Tcb_T *pTcb
+    );
+
+int
+TcbCancel(
+    IN uTaskCore_T *pCore,
+    IN Tcb_T *pTcb
+    );
+
+uTaskCore_T *
+CoreSelf(
     void
     );
 
-void *
-PoolAlloc(
-    uint uSize
+int
+IntakePut(
+    IN uTaskCore_T *pCore,
+    IN uTask_T *pTask,
+    IN int Id,
+    IN void *pMsg,
+    IN unsigned long Expire
     );
 
 void
-PoolFree(
-    void *pMem
+IntakeDrain(
+    IN uTaskCore_T *pCore
     );
 
-/******************************************************************************/
+int
+CorePending(
+    IN uTaskCore_T *pCore
+    );
 
-#if UTASK_DEBUG
-static uint16 gDebug = {DBG_TRACE|DBG_WARN|DBG_ERROR};
-#endif
+void
+CoreIdle(
+    IN uTaskCore_T *pCore,
+    IN OUT int *pIdle,
+    IN Tcb_T **ppInbox,
+    IN long TimeoutNs
+    );
 
-static uTaskCore_T gCore;
+void
+CoreWake(
+    IN uTaskCore_T *pCore
+    );
 
 /******************************************************************************/
 
+void
+ExecLock(
+    int *pLock
+    );
+
 int
-uTaskCtor(
-    void
-    )
-{
-    DBG_MSG(DBG_TRACE, "%s\n", __FUNCTION__);
+ExecTryLock(
+    int *pLock
+    );
 
-    memset(&gCore, 0, sizeof(gCore));
+void
+ExecUnlock(
+    int *pLock
+    );
+
+void
+ExecReady(
+    int Worker,
+    Tcb_T *pTcb
+    );
 
-    QUEUE_INIT(gCore.IsrQ);
+void
+ExecPush(
+    int Worker,
+    uTaskStrand_T *pStrand
+    );
 
-    TcbInit();
+void
+ExecInboxPush(
+    int Worker,
+    Tcb_T *pTcb
+    );
 
-    PoolInit();
+void
+ExecInboxDrain(
+    int Worker
+    );
 
-    gCore.Flags = CORE_FLAGS_INIT;
+uTaskStrand_T *
+ExecPopHome(
+    int Worker
+    );
 
-    return UTASK_S_OK;
-}
+#if !UTASK_IDLE_PARK
 
 void
-uTaskDtor(
-    void
-    )
-{
-    DBG_MSG(DBG_TRACE, "%s\n", __FUNCTION__);
+ExecSleep(
+    int Worker
+    );
 
-    gCore.Flags = gCore.Flags | CORE_FLAGS_SHUTDOWN;
-}
+#endif
 
-void
-uTaskTick(
-    void
-    )
-{
-    int PrevState = uTaskInterruptDisable();
-    gCore.Tick++;
-    uTaskInterruptRestore(PrevState);
-}
+uTaskStrand_T *
+ExecPop(
+    int Worker
+    );
 
-unsigned long
-uTaskGetTick(
-    void
-    )
-{
-    return gCore.Tick;
-}
+uTaskStrand_T *
+ExecSteal(
+    int Worker
+    );
 
-int
-uTaskMessageSend(
-    IN uTask_T          *pTask,
-    IN int              Id,
-    IN void             *pMsg,
-    IN unsigned long    Time
-    )
-{
-    Tcb_T *pTcb;
+void
+ExecRunStrand(
+    int Worker,
+    uTaskStrand_T *pStrand
+    );
 
-    /* Valid task and handler must be provided */
-    if (pTask && pTask->Handler)
-    {
-        pTcb = TcbAlloc();
+void
+ExecLoop(
+    int Worker
+    );
 
-        if (pTcb)
-        {
-            pTcb->Flags     = TCB_FLAGS_APP;
-            pTcb->pTask     = pTask;
-            pTcb->Id        = Id;
-            pTcb->pMsg      = pMsg;
-            pTcb->Expire    = Time + uTaskGetTick();
+void
+ExecReset(
+    int Worker
+    );
 
-            TcbEnqueue(pTcb);
+void *
+ExecThread(
+    void *pArg
+    );
 
-            return UTASK_S_OK;
-        }
-        else
-        {
-            DBG_MSG(DBG_ERROR, "Tcb exhaustion\n");
-        }
-    }
+/******************************************************************************/
 
-    return UTASK_E_FAIL;
-}
+void *
+PortThread(
+    void *pArg
+    );
+
+#if UTASK_PORT_POSIX
 
 int
-uTaskMessageSendIsr(
-    IN uTask_T          *pTask,
-    IN int              Id,
-    IN void             *pData
-    )
-{
-    /* The task and handler must be valid */
-    if (pTask && pTask->Handler)
-    {
-        if (!QUEUE_FULL(gCore.IsrQ))
-        {
-            Tcb_T Tcb;
+PortBlock(
+    OUT sigset_t *pSet
+    );
 
-            Tcb.Flags   = TCB_FLAGS_ISR;
-            Tcb.pTask   = pTask;
-            Tcb.Id      = Id;
-            Tcb.pMsg    = pData;
-            Tcb.Expire  = uTaskGetTick();
+#endif
 
-            QUEUE_PUT(gCore.IsrQ, Tcb);
+/******************************************************************************/
 
-            return UTASK_S_OK;
-        }
-    }
+int
+PoolInit(
+    void
+    );
 
-    return UTASK_E_FAIL;
-}
+void *
+PoolAlloc(
+    uint uSize
+    );
 
-void
-uTaskMessageLoop(
-    void
-    )
-{
-    Tcb_T *pTcb;
+void *
+PoolAllocIsr(
+    uint uSize
+    );
 
-    if (!gCore.Flags & CORE_FLAGS_INIT)
-    {
-        return;
-    }
+int
+PoolStats(
+    int i,
+    uTaskPoolStats_T *pStats
+    );
 
-    for ( ; ; )
-    {
-        /* Has a shutdown request occurred */
-        if (gCore.Flags & CORE_FLAGS_SHUTDOWN)
-        {
-            DBG_MSG(DBG_WARN, "Shutdown request\n");
-            break;
-        }
+void
+PoolFree(
+    void *pMem
+    );
 
-        /* If the are any isr queue items, move them into tcb queue */
-        if (!QUEUE_EMPTY(gCore.IsrQ))
-        {
-            pTcb = TcbAlloc();
+int
+PoolArena(
+    void
+    );
 
-            if (pTcb)
-            {
-                QUEUE_GET(gCore.IsrQ, *pTcb);
+int
+PoolClass(
+    uint uSize
+    );
 
-                TcbEnqueue(pTcb);
-            }
-        }
+int
+PoolFind(
+    void *pMem
+    );
 
-        pTcb = TcbFront();
+void *
+PoolGet(
+    int i
+    );
 
-        if (pTcb)
-        {
-            /* Has pTcb expired */
-            if (TIME_AFTER_EQ(uTaskGetTick(), pTcb->Expire))
-            {
-                pTcb = TcbDequeue();
+void
+PoolPut(
+    int i,
+    void *p
+    );
 
-                DBG_MSG(DBG_TRACE, "Delay(%ld) Task %p Id %d pMsg %p\n",
-                                   uTaskGetTick()-pTcb->Expire,
-                                   pTcb->pTask,
-                                   pTcb->Id,
-                                   pTcb->pMsg);
+void *
+PoolSign(
+    void *p,
+    uint uSize
+    );
 
-                /* Send the message to the task */
-                pTcb->pTask->Handler(pTcb->pTask, pTcb->Id, pTcb->pMsg);
+void *
+PoolCheck(
+    int i,
+    void *pMem
+    );
 
-                /* Free the message structure */
-                uTaskFree(pTcb->pMsg);
+void *
+PoolMagAlloc(
+    uint uSize
+    );
 
-                TcbFree(pTcb);
-            }
-        }
-    }
-}
+void
+PoolMagFree(
+    void *pMem
+    );
+
+void
+PoolMagFlush(
+    void
+    );
+
+int
+PoolIndex(
+    int i,
+    void *pMem
+    );
+
+int
+PoolRetain(
+    void *pMem
+    );
+
+int
+PoolRelease(
+    int i,
+    void *pMem
+    );
+
+void
+PoolChainMark(
+    void *pMem
+    );
+
+void *
+PoolChainTake(
+    int i,
+    void *pMem
+    );
+
+uint
+PoolMax(
+    void
+    );
+
+/******************************************************************************/
+
+ChainSeg_T *
+ChainSegAlloc(
+    uint uCount
+    );
+
+void
+ChainSegFree(
+    ChainSeg_T *pSeg
+    );
+
+/******************************************************************************/
+
+void
+CallInit(
+    void
+    );
+
+void
+CallFree(
+    IN int Index
+    );
+
+void
+CallReq(
+    IN uTask_T *pTask,
+    IN int Id,
+    IN void *pMsg
+    );
+
+void
+CallRsp(
+    IN uTask_T *pTask,
+    IN int Id,
+    IN void *pMsg
+    );
+
+/******************************************************************************/
+
+void
+EventCheck(
+    IN uTaskEvent_T *pEvent
+    );
+
+void
+EventEnd(
+    IN uTaskEventWait_T *pWait
+    );
+
+void
+EventIsr(
+    IN uTask_T *pTask,
+    IN int Id,
+    IN void *pMsg
+    );
+
+void
+EventTimeout(
+    IN uTask_T *pTask,
+    IN int Id,
+    IN void *pMsg
+    );
+
+#if !defined(__GNUC__)
+
+unsigned long
+EventOr(
+    IN unsigned long *pFlags,
+    IN unsigned long Mask
+    );
+
+unsigned long
+EventAnd(
+    IN unsigned long *pFlags,
+    IN unsigned long Mask
+    );
+
+#endif
+
+/******************************************************************************/
+
+int
+SemTake(
+    IN uTaskSem_T *pSem,
+    IN uTaskSemWait_T *pWait,
+    IN uTask_T *pTask,
+    IN int Id,
+    IN int Prio,
+    OUT uTask_T **ppOwner
+    );
+
+uTaskSemWait_T *
+SemGive(
+    IN uTaskSem_T *pSem,
+    OUT uTask_T **ppOwner
+    );
+
+void
+SemGrant(
+    IN uTaskSemWait_T *pWait
+    );
+
+/******************************************************************************/
+
+void
+HsmDispatch(
+    IN uTask_T *pTask,
+    IN int Id,
+    IN void *pMsg
+    );
+
+void
+HsmEnter(
+    IN uTaskHsm_T *pHsm,
+    IN int From,
+    IN int To
+    );
+
+int
+HsmEncloses(
+    IN const uTaskHsmState_T *pState,
+    IN int Outer,
+    IN int Inner
+    );
+
+/******************************************************************************/
+
+void
+TlsfInit(
+    void
+    );
+
+void *
+TlsfAlloc(
+    uint uSize
+    );
+
+void
+TlsfFree(
+    void *pMem
+    );
+
+int
+TlsfFind(
+    void *pMem
+    );
+
+/******************************************************************************/
+
+#if UTASK_DEBUG
+static uint16 gDebug = {DBG_TRACE|DBG_WARN|DBG_ERROR};
+#endif
+
+#if UTASK_ISR_QUEUE_SIZE <= 0
+#error UTASK_ISR_QUEUE_SIZE must be greater than 0
+#endif
+
+/* The default instance used by the uTask api's without a core argument */
+static uTaskCore_T gCore;
+static Tcb_T gTcb[UTASK_TCB_SLOTS];
+
+#if UTASK_INTAKE_SIZE
+
+#if UTASK_INTAKE_SIZE & (UTASK_INTAKE_SIZE - 1)
+#error UTASK_INTAKE_SIZE must be a power of 2
+#endif
+
+/* The instance whose loop runs on this thread, its sends need no intake */
+static UTASK_THREAD_LOCAL uTaskCore_T *gpLoopCore;
+
+#endif
+
+#if UTASK_EXEC_WORKERS
+
+#define EXEC_IDLE           0
+#define EXEC_QUEUED         1
+#define EXEC_RUNNING        2
+
+/* Idle passes before a worker sleeps, and the longest sleep */
+#define EXEC_SPIN           64
+#define EXEC_SLEEP_NS       1000000L
+
+/* The strand of a task, its own unless it joined a shared one */
+#define EXEC_STRAND(t)\
+    ((t)->pStrand ? (t)->pStrand : &(t)->Strand)
+
+#define EXEC_AFFINITY(t)\
+    ((t)->pStrand ? (t)->pStrand->Affinity : (t)->Affinity)
+
+/* Worker an affinity pins to, -1 if it may run on any worker */
+#define EXEC_HOME(a)\
+    ((a) > 0 && (a) <= gExecCount ? (a)-1 : -1)
+
+/*
+ * A worker, its instance, the queue of strands with ready messages that
+ * idle workers steal from, the queue of strands pinned to it and the inbox
+ * other workers send its pinned strands' messages to.
+ */
+typedef struct
+{
+    uTaskCore_T         *pCore;
+    uTaskStrand_T       *pHead;
+    uTaskStrand_T       *pTail;
+    int                 Lock;
+    uTaskStrand_T       *pHomeHead;
+    uTaskStrand_T       *pHomeTail;
+    Tcb_T               *pInbox;
+#if !UTASK_IDLE_PARK
+    int                 Sleeping;       /* Parked on Cond, see ExecSleep */
+    pthread_mutex_t     Mutex;
+    pthread_cond_t      Cond;
+#endif
+    pthread_t           Thread;
+} ExecWorker_T;
+
+static ExecWorker_T gExecWorker[UTASK_EXEC_WORKERS];
+
+/* Instances of workers 1 and up, worker 0 uses the default instance */
+static uTaskCore_T gExecCore[UTASK_EXEC_WORKERS];
+static Tcb_T gExecTcb[UTASK_EXEC_WORKERS][UTASK_TCB_SLOTS];
+static int gExecCount;
+
+/* Worker threads are running, between uTaskExecRun and its return */
+static int gExecRunning;
+
+/* Lets the workers start, 1 once all exist and -1 if one could not start */
+static int gExecGo;
+
+/* Index plus one of the worker running on this thread, 0 if none */
+static UTASK_THREAD_LOCAL int gExecSelf;
+
+#endif
+
+/******************************************************************************/
+
+int
+uTaskCtor(
+    void
+    )
+{
+    DBG_MSG(DBG_TRACE, "%s\n", __FUNCTION__);
+
+    if (PoolInit() != UTASK_S_OK)
+    {
+        DBG_MSG(DBG_ERROR, "Pool init failed\n");
+        return UTASK_E_FAIL;
+    }
+
+    TlsfInit();
+
+    CallInit();
+
+    return uTaskCoreCtor(&gCore, gTcb, COUNTOF(gTcb));
+}
+
+void
+uTaskDtor(
+    void
+    )
+{
+    uTaskCoreDtor(&gCore);
+}
+
+void
+uTaskTick(
+    void
+    )
+{
+#if UTASK_EXEC_WORKERS
+    int i;
+
+    /* Worker instances keep the same time as the default instance */
+    for (i = 1; i < gExecCount; i = i + 1)
+    {
+        uTaskCoreTick(&gExecCore[i]);
+    }
+#endif
+
+    uTaskCoreTick(&gCore);
+}
+
+unsigned long
+uTaskGetTick(
+    void
+    )
+{
+    return uTaskCoreGetTick(CoreSelf());
+}
+
+int
+uTaskMessageSend(
+    IN uTask_T          *pTask,
+    IN int              Id,
+    IN void             *pMsg,
+    IN unsigned long    Time
+    )
+{
+    return uTaskCoreMessageSend(CoreSelf(), pTask, Id, pMsg, Time);
+}
+
+int
+uTaskMessageSendIsr(
+    IN uTask_T          *pTask,
+    IN int              Id,
+    IN void             *pData
+    )
+{
+    return uTaskCoreMessageSendIsr(&gCore, pTask, Id, pData);
+}
+
+void
+uTaskMessageLoop(
+    void
+    )
+{
+    uTaskCoreMessageLoop(&gCore);
+}
+
+int
+uTaskMessageMulticast(
+    IN uTask_T          **ppTask,
+    IN int              Count,
+    IN int              Id,
+    IN void             *pMsg,
+    IN unsigned long    Time
+    )
+{
+    return uTaskCoreMessageMulticast(CoreSelf(), ppTask, Count, Id, pMsg, Time);
+}
 
 int
 uTaskMessageCancel(
@@ -390,463 +860,5690 @@ uTaskMessageCancel(
     IN int              Id
     )
 {
-    int i = 0;
-    Tcb_T *pEntry;
-    Tcb_T *pTemp;
+    return uTaskCoreMessageCancel(CoreSelf(), pTask, Id);
+}
+
+/* The instance used by the uTask api's on this thread */
+uTaskCore_T *
+CoreSelf(
+    void
+    )
+{
+#if UTASK_EXEC_WORKERS
+    if (gExecSelf)
+    {
+        return gExecWorker[gExecSelf-1].pCore;
+    }
+#endif
+
+    return &gCore;
+}
+
+/******************************************************************************/
+
+uTaskCore_T *
+uTaskCoreDefault(
+    void
+    )
+{
+    return &gCore;
+}
+
+int
+uTaskCoreCtor(
+    OUT uTaskCore_T     *pCore,
+    IN uTaskTcb_T       *pTcb,
+    IN int              TcbCount
+    )
+{
+#if UTASK_INTAKE_SIZE
+    int i;
+#endif
+
+    DBG_MSG(DBG_TRACE, "%s %p\n", __FUNCTION__, pCore);
+
+    memset(pCore, 0, sizeof(*pCore));
+
+    QUEUE_INIT(pCore->IsrQ);
+
+    TcbInit(pCore, pTcb, TcbCount);
+
+#if UTASK_INTAKE_SIZE
+    /* Entry i is free for the sender that claims position i */
+    for (i = 0; i < UTASK_INTAKE_SIZE; i = i + 1)
+    {
+        pCore->Intake.items[i].Seq = (unsigned long)i;
+    }
+#endif
+
+    pCore->Flags = CORE_FLAGS_INIT;
+
+    return UTASK_S_OK;
+}
+
+void
+uTaskCoreDtor(
+    IN uTaskCore_T      *pCore
+    )
+{
+    DBG_MSG(DBG_TRACE, "%s %p\n", __FUNCTION__, pCore);
+
+#if CORE_ATOMIC
+    /* Loops on other threads poll the flags */
+    __atomic_fetch_or(&pCore->Flags, CORE_FLAGS_SHUTDOWN, __ATOMIC_RELEASE);
+#if UTASK_IDLE_PARK
+    CoreWake(pCore);
+#endif
+#else
+    pCore->Flags = pCore->Flags | CORE_FLAGS_SHUTDOWN;
+#endif
+}
+
+void
+uTaskCoreTick(
+    IN uTaskCore_T      *pCore
+    )
+{
+#if CORE_ATOMIC
+    /* Loops on other threads read the tick without the lock */
+    unsigned long Tick = __atomic_add_fetch(&pCore->Tick, 1, __ATOMIC_RELAXED);
+
+#if UTASK_IDLE_PARK
+    /* Wake a loop parked until its next timer */
+    if (__atomic_load_n(&pCore->Park, __ATOMIC_ACQUIRE) == CORE_PARK_TIMER &&
+        TIME_AFTER_EQ(Tick, __atomic_load_n(&pCore->ParkExpire,
+                                            __ATOMIC_RELAXED)))
+    {
+        CoreWake(pCore);
+    }
+#else
+    UNUSED_PARAM(Tick);
+#endif
+#else
+    int PrevState = uTaskInterruptDisable();
+    pCore->Tick++;
+    uTaskInterruptRestore(PrevState);
+#endif
+}
+
+unsigned long
+uTaskCoreGetTick(
+    IN uTaskCore_T      *pCore
+    )
+{
+#if CORE_ATOMIC
+    return __atomic_load_n(&pCore->Tick, __ATOMIC_RELAXED);
+#else
+    return pCore->Tick;
+#endif
+}
+
+int
+uTaskCoreMessageSend(
+    IN uTaskCore_T      *pCore,
+    IN uTask_T          *pTask,
+    IN int              Id,
+    IN void             *pMsg,
+    IN unsigned long    Time
+    )
+{
+    Tcb_T *pTcb;
+
+    /* Valid task and handler must be provided */
+    if (pTask && pTask->Handler)
+    {
+#if UTASK_INTAKE_SIZE
+        /* Other threads leave the tcb queue to the loop */
+        if (gpLoopCore != pCore)
+        {
+            return IntakePut(pCore, pTask, Id, pMsg,
+                             Time + uTaskCoreGetTick(pCore));
+        }
+#endif
+
+        pTcb = TcbAlloc(pCore);
+
+        if (pTcb)
+        {
+            pTcb->Flags     = TCB_FLAGS_APP;
+            pTcb->pTask     = pTask;
+            pTcb->Id        = Id;
+            pTcb->pMsg      = pMsg;
+            pTcb->Expire    = Time + uTaskCoreGetTick(pCore);
+
+#if UTASK_EXEC_WORKERS
+            /* A worker hands messages due now straight to the task */
+            if (Time == 0 && gExecSelf && CoreSelf() == pCore)
+            {
+                ExecReady(gExecSelf-1, pTcb);
+                return UTASK_S_OK;
+            }
+#endif
+
+            TcbEnqueue(pCore, pTcb);
+
+            return UTASK_S_OK;
+        }
+        else
+        {
+            DBG_MSG(DBG_ERROR, "Tcb exhaustion\n");
+        }
+    }
+
+    return UTASK_E_FAIL;
+}
+
+int
+uTaskCoreMessageSendIsr(
+    IN uTaskCore_T      *pCore,
+    IN uTask_T          *pTask,
+    IN int              Id,
+    IN void             *pData
+    )
+{
+    /* The task and handler must be valid */
+    if (pTask && pTask->Handler)
+    {
+        if (!QUEUE_FULL(pCore->IsrQ))
+        {
+            Tcb_T Tcb;
+
+            Tcb.Flags   = TCB_FLAGS_ISR;
+            Tcb.pTask   = pTask;
+            Tcb.Id      = Id;
+            Tcb.pMsg    = pData;
+            Tcb.Expire  = uTaskCoreGetTick(pCore);
+#if UTASK_EXEC_WORKERS
+            Tcb.pOwner  = pCore;
+#endif
+
+            QUEUE_PUT(pCore->IsrQ, Tcb);
+
+#if UTASK_IDLE_PARK
+            CoreWake(pCore);
+#endif
+
+            return UTASK_S_OK;
+        }
+    }
+
+    return UTASK_E_FAIL;
+}
+
+void
+uTaskCoreMessageLoop(
+    IN uTaskCore_T      *pCore
+    )
+{
+    Tcb_T *pTcb;
+#if UTASK_IDLE_PARK
+    int Idle = 0;
+#endif
+
+    if (!(pCore->Flags & CORE_FLAGS_INIT))
+    {
+        return;
+    }
+
+#if UTASK_INTAKE_SIZE
+    gpLoopCore = pCore;
+#endif
+
+    for ( ; ; )
+    {
+        /* Has a shutdown request occurred */
+        if (CORE_FLAGS(pCore) & CORE_FLAGS_SHUTDOWN)
+        {
+            DBG_MSG(DBG_WARN, "Shutdown request\n");
+            break;
+        }
+
+        /* Move sends from other threads into the tcb queue */
+        IntakeDrain(pCore);
+
+        /* If the are any isr queue items, move them into tcb queue */
+        if (!QUEUE_EMPTY(pCore->IsrQ))
+        {
+            pTcb = TcbAlloc(pCore);
+
+            if (pTcb)
+            {
+                QUEUE_GET(pCore->IsrQ, *pTcb);
+
+                TcbEnqueue(pCore, pTcb);
+            }
+        }
+
+        pTcb = TcbFront(pCore);
+
+        if (pTcb)
+        {
+            /* Has pTcb expired */
+            if (TIME_AFTER_EQ(uTaskCoreGetTick(pCore), pTcb->Expire))
+            {
+                pTcb = TcbDequeue(pCore);
+
+                DBG_MSG(DBG_TRACE, "Delay(%ld) Task %p Id %d pMsg %p\n",
+                                   uTaskCoreGetTick(pCore)-pTcb->Expire,
+                                   pTcb->pTask,
+                                   pTcb->Id,
+                                   pTcb->pMsg);
+
+                /* Send the message to the task */
+                pTcb->pTask->Handler(pTcb->pTask, pTcb->Id, pTcb->pMsg);
+
+                /* Free the message structure */
+                uTaskFree(pTcb->pMsg);
+
+                TcbFree(pCore, pTcb);
+
+#if UTASK_IDLE_PARK
+                Idle = 0;
+                continue;
+#endif
+            }
+        }
+
+#if UTASK_IDLE_PARK
+        /* Nothing was due this pass */
+        CoreIdle(pCore, &Idle, NULL, 0);
+#endif
+    }
+
+#if UTASK_INTAKE_SIZE
+    gpLoopCore = NULL;
+#endif
+}
+
+int
+uTaskCoreMessageMulticast(
+    IN uTaskCore_T      *pCore,
+    IN uTask_T          **ppTask,
+    IN int              Count,
+    IN int              Id,
+    IN void             *pMsg,
+    IN unsigned long    Time
+    )
+{
+    int i;
+    int Sent = 0;
+
+    /* One reference per receiver, the caller's reference is the first */
+    for (i = 1; i < Count; i = i + 1)
+    {
+        if (uTaskMsgRetain(pMsg) != UTASK_S_OK)
+        {
+            /* Undo the references taken so far */
+            for ( ; i > 1; i = i - 1)
+            {
+                uTaskFree(pMsg);
+            }
+            return 0;
+        }
+    }
+
+    for (i = 0; i < Count; i = i + 1)
+    {
+        if (uTaskCoreMessageSend(pCore, ppTask[i], Id, pMsg, Time) == UTASK_S_OK)
+        {
+            Sent = Sent + 1;
+        }
+    }
+
+    /* Drop the references of failed sends, keeping the caller's if none */
+    for (i = (Sent ? Sent : 1); i < Count; i = i + 1)
+    {
+        uTaskFree(pMsg);
+    }
+
+    return Sent;
+}
+
+int
+uTaskCoreMessageCancel(
+    IN uTaskCore_T      *pCore,
+    IN uTask_T          *pTask,
+    IN int              Id
+    )
+{
+    int i = 0;
+    Tcb_T *pEntry;
+    Tcb_T *pTemp;
+
+    /* Traverse the queue */
+    for (pEntry = pCore->pHead; pEntry; )
+    {
+        pTemp = pEntry;
+        pEntry = pEntry->pNext;
+
+        if (pTemp->pTask == pTask && pTemp->Id == Id)
+        {
+            /* Count the number of cancelled items */
+            i = i + 1;
+
+            TcbRemove(pCore, pTemp);
+
+            TcbFree(pCore, pTemp);
+        }
+    }
+
+    return i;
+}
+
+void
+uTaskCoreFlush(
+    IN uTaskCore_T      *pCore
+    )
+{
+    Tcb_T *pTcb;
+    Tcb_T Tcb;
+
+    while (!QUEUE_EMPTY(pCore->IsrQ))
+    {
+        QUEUE_GET(pCore->IsrQ, Tcb);
+
+        uTaskFree(Tcb.pMsg);
+    }
+
+    /* Sends waiting in the intake need the tcbs freed by the last pass */
+    for ( ; ; )
+    {
+        IntakeDrain(pCore);
+
+        pTcb = TcbDequeue(pCore);
+
+        if (pTcb == NULL)
+        {
+            break;
+        }
+
+        for ( ; pTcb; pTcb = TcbDequeue(pCore))
+        {
+            uTaskFree(pTcb->pMsg);
+
+            TcbFree(pCore, pTcb);
+        }
+    }
+}
+
+void *
+uTaskAlloc(
+    IN int              uSize
+    )
+{
+    void *p;
+    int PrevState;
+
+#if UTASK_POOL_MAG_SIZE
+
+    /* Allocate from this thread's magazine, it locks only to refill */
+    p = PoolMagAlloc(uSize);
+
+#else
+
+    /* Disable interrupts, allowing pool allocs during isr execution */
+    PrevState = uTaskInterruptDisable();
+
+    /* Allocate the pool block, note this is not your normal alloc */
+    p = PoolAlloc(uSize);
+
+    /* Restore the interrupt state */
+    uTaskInterruptRestore(PrevState);
+
+#endif
+
+    /* Too large for any pool, use the variable size region */
+    if (p == NULL && PoolClass(uSize) < 0)
+    {
+        PrevState = uTaskInterruptDisable();
+        p = TlsfAlloc(uSize);
+        uTaskInterruptRestore(PrevState);
+    }
+
+    return p;
+}
+
+void *
+uTaskAllocIsr(
+    IN int              uSize
+    )
+{
+    void *p;
+
+    /* Interrupts are already disabled in isr context */
+    p = PoolAllocIsr(uSize);
+
+    if (p == NULL && PoolClass(uSize) < 0)
+    {
+        p = TlsfAlloc(uSize);
+    }
+
+    return p;
+}
+
+void
+uTaskFree(
+    IN void             *pMem
+    )
+{
+    int PrevState;
+
+    /* Blocks from the variable size region */
+    if (TlsfFind(pMem))
+    {
+        PrevState = uTaskInterruptDisable();
+        TlsfFree(pMem);
+        uTaskInterruptRestore(PrevState);
+        return;
+    }
+
+#if UTASK_POOL_MAG_SIZE
+
+    /* Free to this thread's magazine, it locks only to flush */
+    PoolMagFree(pMem);
+
+#else
+
+    /* Disable interrupts, allowing pool frees during isr execution */
+    PrevState = uTaskInterruptDisable();
+   /* 
+    * Release the pool block, caution if in an isr pool over write 
+    * detection cannot print if executing in isr context.
+    */
+    PoolFree(pMem);
+
+    /* Restore the interrupt state */
+    uTaskInterruptRestore(PrevState);
+
+#endif
+}
+
+int
+uTaskMsgRetain(
+    IN void             *pMsg
+    )
+{
+    int Status;
+
+    int PrevState = uTaskInterruptDisable();
+
+    Status = PoolRetain(pMsg);
+
+    uTaskInterruptRestore(PrevState);
+
+    return Status;
+}
+
+void
+uTaskMsgRelease(
+    IN void             *pMsg
+    )
+{
+    uTaskFree(pMsg);
+}
+
+void
+uTaskPoolFlush(
+    void
+    )
+{
+    PoolMagFlush();
+}
+
+int
+uTaskPoolStats(
+    IN int              Pool,
+    OUT uTaskPoolStats_T *pStats
+    )
+{
+    int Status;
+
+    int PrevState = uTaskInterruptDisable();
+
+    Status = PoolStats(Pool, pStats);
+
+    uTaskInterruptRestore(PrevState);
+
+    return Status;
+}
+
+/******************************************************************************/
+
+void
+TcbInit(
+    IN uTaskCore_T *pCore,
+    IN Tcb_T *pTcb,
+    IN int Count
+    )
+{
+    int i;
+    Tcb_T *p;
+
+    p = pTcb;
+
+    /* Create Tcb free list */
+    for (i = 0; i < Count; i = i + 1)
+    {
+#if UTASK_EXEC_WORKERS
+        p->pOwner = pCore;
+#endif
+        TcbFree(pCore, p);
+        p = p + 1;
+    }
+}
+
+Tcb_T *
+TcbAlloc(
+    IN uTaskCore_T *pCore
+    )
+{
+    Tcb_T *pTcb;
+
+    /* Remove item from head of free list */
+    pTcb = pCore->pFree;
+
+#if UTASK_EXEC_WORKERS
+    /* Take back the blocks other workers have freed */
+    if (pTcb == NULL)
+    {
+        pTcb = __atomic_exchange_n(&pCore->pRemote, NULL, __ATOMIC_ACQUIRE);
+    }
+#endif
+
+    if (pTcb)
+    {
+        pCore->pFree = pTcb->pNext;
+        pTcb->pNext = NULL;
+    }
+
+    return pTcb;
+}
+
+void
+TcbFree(
+    IN uTaskCore_T *pCore,
+    IN Tcb_T *pTcb
+    )
+{
+#if UTASK_EXEC_WORKERS
+    /* Return a block of another worker to its remote list */
+    if (pTcb->pOwner != pCore)
+    {
+        pCore = pTcb->pOwner;
+        pTcb->pPrev = NULL;
+        pTcb->pNext = __atomic_load_n(&pCore->pRemote, __ATOMIC_RELAXED);
+
+        while (!__atomic_compare_exchange_n(&pCore->pRemote, &pTcb->pNext,
+                    pTcb, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        {
+        }
+        return;
+    }
+#endif
+
+    /* Add item to head of free list */
+    pTcb->pNext = pCore->pFree;
+    pCore->pFree = pTcb;
+    pTcb->pPrev = NULL;
+}
+
+/* Items enter at the tail head and leave at the head */
+Tcb_T *
+TcbFront(
+    IN uTaskCore_T *pCore
+    )
+{
+    /* Return item at head */
+    return pCore->pHead;
+}
+
+/* Add at head */
+void
+TcbEnqueue(
+    IN uTaskCore_T *pCore,
+    IN Tcb_T *pTcb
+    )
+{
+    Tcb_T *pEntry;
+
+    /* The queue is empty update head and tail */
+    if (pCore->pHead == NULL && pCore->pTail == NULL)
+    {
+        pCore->pHead = pTcb;
+        pCore->pTail = pTcb;
+        pTcb->pNext = NULL;
+        pTcb->pPrev = NULL;
+        return;
+    }
+
+    /* Most sends expire last, append without the walk */
+    if (!TIME_AFTER(pCore->pTail->Expire, pTcb->Expire))
+    {
+        pEntry = NULL;
+    }
+    else
+    {
+        pEntry = pCore->pHead;
+    }
+
+    /* Traverse the queue */
+    for ( ; pEntry; pEntry = pEntry->pNext)
+    {
+        /* Is the current pEntry after the new pTcb entry */
+        if (TIME_AFTER(pEntry->Expire, pTcb->Expire))
+        {
+            /* Insert new pTcb entry before current pEntry */
+            if (pEntry->pPrev)
+            {
+                pEntry->pPrev->pNext = pTcb;
+                pTcb->pPrev = pEntry->pPrev;
+                pEntry->pPrev = pTcb;
+                pTcb->pNext = pEntry;
+            }
+            else
+            {
+                pEntry->pPrev = pTcb;
+                pTcb->pNext = pEntry;
+                pTcb->pPrev = NULL;
+                pCore->pHead = pTcb;
+            }
+            return;
+        }
+    }
+
+    /* The queue end was found, insert at tail */
+    pCore->pTail->pNext = pTcb;
+    pTcb->pPrev = pCore->pTail;
+    pCore->pTail = pTcb;
+    pTcb->pNext = NULL;
+    return;
+}
+
+/* Remove at tail */
+Tcb_T *
+TcbDequeue(
+    IN uTaskCore_T *pCore
+    )
+{
+    Tcb_T *pTcb;
+
+    /* Case 1, Head and Tail point to nothing */
+    if (pCore->pHead == NULL && pCore->pTail == NULL)
+    {
+        pTcb = NULL;
+    }
+
+    /* Case 2, Head and Tail point to same element */
+    else if (pCore->pHead == pCore->pTail)
+    {
+        pTcb = pCore->pHead;
+        pCore->pHead = NULL;
+        pCore->pTail = NULL;
+    }
+
+    /* Case 3, Head and Tail point to different elements */
+    else
+    {
+        pTcb = pCore->pHead;
+        pCore->pHead = pCore->pHead->pNext;
+        pCore->pHead->pPrev = NULL;
+    }
+
+    return pTcb;
+}
+
+/*
+ * Add a run of tcbs, linked in order from pFirst to pLast, that all expire
+ * at the same tick.  The run is placed with a single walk of the queue.
+ */
+void
+TcbEnqueueRun(
+    IN uTaskCore_T *pCore,
+    IN Tcb_T *pFirst,
+    IN Tcb_T *pLast
+    )
+{
+    Tcb_T *pEntry;
+
+    /* The queue is empty, the run becomes the queue */
+    if (pCore->pHead == NULL && pCore->pTail == NULL)
+    {
+        pCore->pHead = pFirst;
+        pCore->pTail = pLast;
+        pFirst->pPrev = NULL;
+        pLast->pNext = NULL;
+        return;
+    }
+
+    /* Most sends expire last, append without the walk */
+    if (!TIME_AFTER(pCore->pTail->Expire, pFirst->Expire))
+    {
+        pEntry = NULL;
+    }
+    else
+    {
+        pEntry = pCore->pHead;
+    }
+
+    for ( ; pEntry; pEntry = pEntry->pNext)
+    {
+        /* Insert the run before the first entry that expires after it */
+        if (TIME_AFTER(pEntry->Expire, pFirst->Expire))
+        {
+            pFirst->pPrev = pEntry->pPrev;
+
+            if (pEntry->pPrev)
+            {
+                pEntry->pPrev->pNext = pFirst;
+            }
+            else
+            {
+                pCore->pHead = pFirst;
+            }
+
+            pLast->pNext = pEntry;
+            pEntry->pPrev = pLast;
+            return;
+        }
+    }
+
+    /* The queue end was found, append at tail */
+    pCore->pTail->pNext = pFirst;
+    pFirst->pPrev = pCore->pTail;
+    pCore->pTail = pLast;
+    pLast->pNext = NULL;
+}
+
+/* Unlink pTcb from anywhere in the queue */
+void
+TcbRemove(
+    IN uTaskCore_T *pCore,
+    IN Tcb_T *pTcb
+    )
+{
+    /* Entry found only one Tcb in queue */
+    if (pTcb == pCore->pHead && pTcb == pCore->pTail)
+    {
+        pCore->pHead = NULL;
+        pCore->pTail = NULL;
+    }
+    /* Entry found at head of the queue */
+    else if (pTcb == pCore->pHead)
+    {
+        pCore->pHead = pCore->pHead->pNext;
+        pCore->pHead->pPrev = NULL;
+    }
+    /* Entry found at tail of the queue */
+    else if (pTcb == pCore->pTail)
+    {
+        pCore->pTail = pCore->pTail->pPrev;
+        pCore->pTail->pNext = NULL;
+    }
+    /* Entry found in the middle of the queue */
+    else
+    {
+        pTcb->pNext->pPrev = pTcb->pPrev;
+        pTcb->pPrev->pNext = pTcb->pNext;
+    }
+}
+
+/*
+ * Unlink and free a queued timer of pCore.  With the executor only the
+ * worker of pCore dequeues its timers, and not before they expire, so the
+ * timer can only be taken back on that worker before it is due.  Returns 0
+ * if it was left to expire.
+ */
+int
+TcbCancel(
+    IN uTaskCore_T *pCore,
+    IN Tcb_T *pTcb
+    )
+{
+#if UTASK_EXEC_WORKERS
+    if (pCore != CoreSelf() ||
+        !TIME_BEFORE(uTaskCoreGetTick(pCore), pTcb->Expire))
+    {
+        return 0;
+    }
+#endif
+
+    TcbRemove(pCore, pTcb);
+    TcbFree(pCore, pTcb);
+
+    return 1;
+}
+
+/******************************************************************************/
+
+#if UTASK_INTAKE_SIZE
+
+/*
+ * Bounded multi-producer queue, each entry has a sequence number telling
+ * whose turn it is.  A sender claims a position with one compare and swap,
+ * fills the entry and publishes it by advancing its sequence.
+ */
+int
+IntakePut(
+    IN uTaskCore_T *pCore,
+    IN uTask_T *pTask,
+    IN int Id,
+    IN void *pMsg,
+    IN unsigned long Expire
+    )
+{
+    unsigned long Pos;
+    unsigned long Seq;
+    long Diff;
+
+    Pos = __atomic_load_n(&pCore->Intake.Head, __ATOMIC_RELAXED);
+
+    for ( ; ; )
+    {
+        Seq = __atomic_load_n(
+                &pCore->Intake.items[Pos & (UTASK_INTAKE_SIZE-1)].Seq,
+                __ATOMIC_ACQUIRE);
+
+        Diff = (long)(Seq - Pos);
+
+        if (Diff == 0)
+        {
+            /* The entry is free, claim it, Pos is reloaded on failure */
+            if (__atomic_compare_exchange_n(&pCore->Intake.Head, &Pos,
+                        Pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (Diff < 0)
+        {
+            /* The loop has not taken the entry from the previous lap */
+            DBG_MSG(DBG_ERROR, "Intake full\n");
+            return UTASK_E_FAIL;
+        }
+        else
+        {
+            Pos = __atomic_load_n(&pCore->Intake.Head, __ATOMIC_RELAXED);
+        }
+    }
+
+    Pos = Pos & (UTASK_INTAKE_SIZE-1);
+
+    pCore->Intake.items[Pos].pTask  = pTask;
+    pCore->Intake.items[Pos].Id     = Id;
+    pCore->Intake.items[Pos].pMsg   = pMsg;
+    pCore->Intake.items[Pos].Expire = Expire;
+
+    __atomic_store_n(&pCore->Intake.items[Pos].Seq, Seq + 1, __ATOMIC_RELEASE);
+
+#if UTASK_IDLE_PARK
+    CoreWake(pCore);
+#endif
+
+    return UTASK_S_OK;
+}
+
+/* Loop side, move every published entry into the tcb queue */
+void
+IntakeDrain(
+    IN uTaskCore_T *pCore
+    )
+{
+    unsigned long Tail = pCore->Intake.Tail;
+    Tcb_T *pTcb;
+    int i;
+
+    for ( ; ; )
+    {
+        i = (int)(Tail & (UTASK_INTAKE_SIZE-1));
+
+        if (__atomic_load_n(&pCore->Intake.items[i].Seq, __ATOMIC_ACQUIRE) !=
+            Tail + 1)
+        {
+            break;
+        }
+
+        /* Out of tcbs, the rest waits in the intake */
+        pTcb = TcbAlloc(pCore);
+
+        if (pTcb == NULL)
+        {
+            break;
+        }
+
+        pTcb->Flags     = TCB_FLAGS_APP;
+        pTcb->pTask     = pCore->Intake.items[i].pTask;
+        pTcb->Id        = pCore->Intake.items[i].Id;
+        pTcb->pMsg      = pCore->Intake.items[i].pMsg;
+        pTcb->Expire    = pCore->Intake.items[i].Expire;
+
+        TcbEnqueue(pCore, pTcb);
+
+        /* Free the entry for the sender one lap ahead */
+        __atomic_store_n(&pCore->Intake.items[i].Seq,
+                         Tail + UTASK_INTAKE_SIZE, __ATOMIC_RELEASE);
+
+        Tail = Tail + 1;
+    }
+
+    pCore->Intake.Tail = Tail;
+}
+
+#else
+
+void
+IntakeDrain(
+    IN uTaskCore_T *pCore
+    )
+{
+    UNUSED_PARAM(pCore);
+}
+
+#endif
+
+/******************************************************************************/
+
+#if UTASK_IDLE_PARK
+
+/* Is there anything for the loop to do */
+int
+CorePending(
+    IN uTaskCore_T *pCore
+    )
+{
+    Tcb_T *pTcb;
+
+    if ((CORE_FLAGS(pCore) & CORE_FLAGS_SHUTDOWN) || !QUEUE_EMPTY(pCore->IsrQ))
+    {
+        return 1;
+    }
+
+#if UTASK_INTAKE_SIZE
+    if (__atomic_load_n(&pCore->Intake.items[pCore->Intake.Tail &
+                                             (UTASK_INTAKE_SIZE-1)].Seq,
+                        __ATOMIC_ACQUIRE) == pCore->Intake.Tail + 1)
+    {
+        return 1;
+    }
+#endif
+
+    pTcb = TcbFront(pCore);
+
+    return pTcb && TIME_AFTER_EQ(uTaskCoreGetTick(pCore), pTcb->Expire);
+}
+
+/*
+ * Called by a loop for each pass without work.  Spins UTASK_IDLE_SPIN
+ * passes, yields the cpu UTASK_IDLE_YIELD passes, then parks on a futex
+ * until a send, the tick reaching the next expiry or TimeoutNs if not 0.
+ * A non empty *ppInbox also counts as work.
+ */
+void
+CoreIdle(
+    IN uTaskCore_T *pCore,
+    IN OUT int *pIdle,
+    IN Tcb_T **ppInbox,
+    IN long TimeoutNs
+    )
+{
+    struct timespec Ts;
+    Tcb_T *pTcb;
+    int Park;
+
+    if (*pIdle < UTASK_IDLE_SPIN)
+    {
+        *pIdle = *pIdle + 1;
+        return;
+    }
+
+    if (*pIdle < UTASK_IDLE_SPIN + UTASK_IDLE_YIELD)
+    {
+        *pIdle = *pIdle + 1;
+        sched_yield();
+        return;
+    }
+
+    *pIdle = 0;
+
+    /* The tick wakes the loop once the front tcb is due */
+    pTcb = TcbFront(pCore);
+
+    if (pTcb)
+    {
+        __atomic_store_n(&pCore->ParkExpire, pTcb->Expire, __ATOMIC_RELAXED);
+        Park = CORE_PARK_TIMER;
+    }
+    else
+    {
+        Park = CORE_PARK;
+    }
+
+    /* Senders check the flag after publishing, the loop checks after this */
+    __atomic_store_n(&pCore->Park, Park, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (!CorePending(pCore) &&
+        !(ppInbox && __atomic_load_n(ppInbox, __ATOMIC_ACQUIRE)))
+    {
+        Ts.tv_sec  = TimeoutNs / 1000000000L;
+        Ts.tv_nsec = TimeoutNs % 1000000000L;
+
+        /* Returns at once if a sender cleared Park in the mean time */
+        syscall(SYS_futex, &pCore->Park, FUTEX_WAIT_PRIVATE, Park,
+                TimeoutNs ? &Ts : NULL, NULL, 0);
+    }
+
+    __atomic_store_n(&pCore->Park, CORE_RUN, __ATOMIC_RELAXED);
+}
+
+/* Wake the loop if it is parked, the common running case costs no syscall */
+void
+CoreWake(
+    IN uTaskCore_T *pCore
+    )
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&pCore->Park, __ATOMIC_RELAXED) != CORE_RUN &&
+        __atomic_exchange_n(&pCore->Park, CORE_RUN, __ATOMIC_SEQ_CST) !=
+        CORE_RUN)
+    {
+        syscall(SYS_futex, &pCore->Park, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+#endif
+
+/******************************************************************************/
+
+#if UTASK_EXEC_WORKERS
+
+int
+uTaskExecCtor(
+    IN int              Workers
+    )
+{
+#if !UTASK_IDLE_PARK
+    pthread_condattr_t Attr;
+#endif
+    int i;
+
+    DBG_MSG(DBG_TRACE, "%s %d\n", __FUNCTION__, Workers);
+
+    if (!(gCore.Flags & CORE_FLAGS_INIT) ||
+        Workers < 1 || Workers > UTASK_EXEC_WORKERS)
+    {
+        return UTASK_E_FAIL;
+    }
+
+    memset(gExecWorker, 0, sizeof(gExecWorker));
+
+    gExecWorker[0].pCore = &gCore;
+
+    for (i = 1; i < Workers; i = i + 1)
+    {
+        uTaskCoreCtor(&gExecCore[i], gExecTcb[i], UTASK_TCB_SLOTS);
+        gExecCore[i].Tick = gCore.Tick;
+        gExecWorker[i].pCore = &gExecCore[i];
+    }
+
+#if !UTASK_IDLE_PARK
+    /* Sleeping workers wait on the monotonic clock */
+    pthread_condattr_init(&Attr);
+    pthread_condattr_setclock(&Attr, CLOCK_MONOTONIC);
+
+    for (i = 0; i < Workers; i = i + 1)
+    {
+        pthread_mutex_init(&gExecWorker[i].Mutex, NULL);
+        pthread_cond_init(&gExecWorker[i].Cond, &Attr);
+    }
+
+    pthread_condattr_destroy(&Attr);
+#endif
+
+    gExecCount = Workers;
+
+    return UTASK_S_OK;
+}
+
+int
+uTaskExecRun(
+    void
+    )
+{
+    int i;
+    int j;
+
+#if UTASK_PORT_POSIX
+    sigset_t Set;
+#endif
+
+    if (gExecCount == 0)
+    {
+        return UTASK_E_FAIL;
+    }
+
+#if UTASK_PORT_POSIX
+    /* Workers inherit the mask, port signals must not reach any of them */
+    PortBlock(&Set);
+#endif
+
+    __atomic_store_n(&gExecRunning, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&gExecGo, 0, __ATOMIC_RELAXED);
+
+    for (i = 1; i < gExecCount; i = i + 1)
+    {
+        if (pthread_create(&gExecWorker[i].Thread, NULL,
+                           ExecThread, (void *)(long)i) != 0)
+        {
+            DBG_MSG(DBG_ERROR, "Worker %d create failed\n", i);
+            break;
+        }
+    }
+
+    /*
+     * Affinities name workers up to gExecCount, without all of them the
+     * workers that started leave before running anything.
+     */
+    __atomic_store_n(&gExecGo, i == gExecCount ? 1 : -1, __ATOMIC_RELEASE);
+
+    if (i == gExecCount)
+    {
+        ExecLoop(0);
+    }
+
+    for (j = 1; j < i; j = j + 1)
+    {
+        pthread_join(gExecWorker[j].Thread, NULL);
+    }
+
+    for (j = 0; j < gExecCount; j = j + 1)
+    {
+        ExecReset(j);
+    }
+
+    __atomic_store_n(&gExecRunning, 0, __ATOMIC_RELEASE);
+
+    return i == gExecCount ? UTASK_S_OK : UTASK_E_FAIL;
+}
+
+void
+uTaskStrandInit(
+    OUT uTaskStrand_T   *pStrand,
+    IN int              Affinity
+    )
+{
+    memset(pStrand, 0, sizeof(*pStrand));
+
+    pStrand->Affinity = Affinity;
+}
+
+void
+uTaskStrandJoin(
+    IN uTask_T          *pTask,
+    IN uTaskStrand_T    *pStrand
+    )
+{
+    pTask->pStrand = pStrand;
+}
+
+/* Spin lock, yielding while held as the holder may share this cpu */
+void
+ExecLock(
+    int *pLock
+    )
+{
+    while (__atomic_exchange_n(pLock, 1, __ATOMIC_ACQUIRE))
+    {
+        while (__atomic_load_n(pLock, __ATOMIC_RELAXED))
+        {
+            sched_yield();
+        }
+    }
+}
+
+int
+ExecTryLock(
+    int *pLock
+    )
+{
+    return !__atomic_load_n(pLock, __ATOMIC_RELAXED) &&
+           !__atomic_exchange_n(pLock, 1, __ATOMIC_ACQUIRE);
+}
+
+void
+ExecUnlock(
+    int *pLock
+    )
+{
+    __atomic_store_n(pLock, 0, __ATOMIC_RELEASE);
+}
+
+/* Add a message that is due to its strand, queue the strand if it was idle */
+void
+ExecReady(
+    int Worker,
+    Tcb_T *pTcb
+    )
+{
+    uTaskStrand_T *pStrand = EXEC_STRAND(pTcb->pTask);
+    int Home = EXEC_HOME(EXEC_AFFINITY(pTcb->pTask));
+    int Queue;
+
+    /* Messages for a strand pinned elsewhere go to its worker's inbox */
+    if (Home >= 0 && Home != Worker)
+    {
+        ExecInboxPush(Home, pTcb);
+        return;
+    }
+
+    pTcb->pNext = NULL;
+    pTcb->pPrev = NULL;
+
+    ExecLock(&pStrand->Lock);
+
+    if (pStrand->pReadyTail)
+    {
+        pStrand->pReadyTail->pNext = pTcb;
+    }
+    else
+    {
+        pStrand->pReadyHead = pTcb;
+    }
+    pStrand->pReadyTail = pTcb;
+
+    /* A queued or running strand is picked up again by its worker */
+    Queue = (pStrand->State == EXEC_IDLE);
+
+    if (Queue)
+    {
+        pStrand->State = EXEC_QUEUED;
+        pStrand->Home = Home;
+    }
+
+    ExecUnlock(&pStrand->Lock);
+
+    if (Queue)
+    {
+        ExecPush(Worker, pStrand);
+    }
+}
+
+/* Add at tail of the worker's ready queue, or its home queue if pinned */
+void
+ExecPush(
+    int Worker,
+    uTaskStrand_T *pStrand
+    )
+{
+    ExecWorker_T *pWorker = &gExecWorker[Worker];
+
+    pStrand->pNextReady = NULL;
+
+    /* Only this worker touches its home queue */
+    if (pStrand->Home == Worker)
+    {
+        if (pWorker->pHomeTail)
+        {
+            pWorker->pHomeTail->pNextReady = pStrand;
+        }
+        else
+        {
+            pWorker->pHomeHead = pStrand;
+        }
+        pWorker->pHomeTail = pStrand;
+        return;
+    }
+
+    ExecLock(&pWorker->Lock);
+
+    if (pWorker->pTail)
+    {
+        pWorker->pTail->pNextReady = pStrand;
+    }
+    else
+    {
+        __atomic_store_n(&pWorker->pHead, pStrand, __ATOMIC_RELAXED);
+    }
+    pWorker->pTail = pStrand;
+
+    ExecUnlock(&pWorker->Lock);
+}
+
+/* Remove at head of the worker's ready queue */
+uTaskStrand_T *
+ExecPop(
+    int Worker
+    )
+{
+    ExecWorker_T *pWorker = &gExecWorker[Worker];
+    uTaskStrand_T *pStrand;
+
+    /* Peek first, an idle worker should not contend for its own lock */
+    if (__atomic_load_n(&pWorker->pHead, __ATOMIC_RELAXED) == NULL)
+    {
+        return NULL;
+    }
+
+    ExecLock(&pWorker->Lock);
+
+    pStrand = pWorker->pHead;
+
+    if (pStrand)
+    {
+        __atomic_store_n(&pWorker->pHead, pStrand->pNextReady, __ATOMIC_RELAXED);
+
+        if (pWorker->pHead == NULL)
+        {
+            pWorker->pTail = NULL;
+        }
+    }
+
+    ExecUnlock(&pWorker->Lock);
+
+    return pStrand;
+}
+
+/* Remove at head of the worker's home queue */
+uTaskStrand_T *
+ExecPopHome(
+    int Worker
+    )
+{
+    ExecWorker_T *pWorker = &gExecWorker[Worker];
+    uTaskStrand_T *pStrand;
+
+    pStrand = pWorker->pHomeHead;
+
+    if (pStrand)
+    {
+        pWorker->pHomeHead = pStrand->pNextReady;
+
+        if (pWorker->pHomeHead == NULL)
+        {
+            pWorker->pHomeTail = NULL;
+        }
+    }
+
+    return pStrand;
+}
+
+/* Lock-free push onto the worker's inbox, waking the worker if asleep */
+void
+ExecInboxPush(
+    int Worker,
+    Tcb_T *pTcb
+    )
+{
+    ExecWorker_T *pWorker = &gExecWorker[Worker];
+
+    pTcb->pPrev = NULL;
+    pTcb->pNext = __atomic_load_n(&pWorker->pInbox, __ATOMIC_RELAXED);
+
+    while (!__atomic_compare_exchange_n(&pWorker->pInbox, &pTcb->pNext,
+                pTcb, 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    {
+    }
+
+#if UTASK_IDLE_PARK
+    CoreWake(pWorker->pCore);
+#else
+    /* Pairs with the sleeping flag set before the inbox check in ExecSleep */
+    if (__atomic_load_n(&pWorker->Sleeping, __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(&pWorker->Mutex);
+        pthread_cond_signal(&pWorker->Cond);
+        pthread_mutex_unlock(&pWorker->Mutex);
+    }
+#endif
+}
+
+/* Take the whole inbox at once and hand its messages out in send order */
+void
+ExecInboxDrain(
+    int Worker
+    )
+{
+    ExecWorker_T *pWorker = &gExecWorker[Worker];
+    Tcb_T *pTcb;
+    Tcb_T *pNext;
+    Tcb_T *pList = NULL;
+
+    if (__atomic_load_n(&pWorker->pInbox, __ATOMIC_RELAXED) == NULL)
+    {
+        return;
+    }
+
+    pTcb = __atomic_exchange_n(&pWorker->pInbox, NULL, __ATOMIC_ACQUIRE);
+
+    /* The inbox is last in first out, reverse it */
+    for ( ; pTcb; pTcb = pNext)
+    {
+        pNext = pTcb->pNext;
+        pTcb->pNext = pList;
+        pList = pTcb;
+    }
+
+    for (pTcb = pList; pTcb; pTcb = pNext)
+    {
+        pNext = pTcb->pNext;
+        ExecReady(Worker, pTcb);
+    }
+}
+
+#if !UTASK_IDLE_PARK
+
+/* Wait for the inbox or a timeout, delayed and stolen work is polled */
+void
+ExecSleep(
+    int Worker
+    )
+{
+    ExecWorker_T *pWorker = &gExecWorker[Worker];
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+
+    Ts.tv_nsec = Ts.tv_nsec + EXEC_SLEEP_NS;
+
+    if (Ts.tv_nsec >= 1000000000L)
+    {
+        Ts.tv_sec = Ts.tv_sec + 1;
+        Ts.tv_nsec = Ts.tv_nsec - 1000000000L;
+    }
+
+    pthread_mutex_lock(&pWorker->Mutex);
+
+    __atomic_store_n(&pWorker->Sleeping, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&pWorker->pInbox, __ATOMIC_SEQ_CST) == NULL)
+    {
+        pthread_cond_timedwait(&pWorker->Cond, &pWorker->Mutex, &Ts);
+    }
+
+    __atomic_store_n(&pWorker->Sleeping, 0, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&pWorker->Mutex);
+}
+
+#endif
+
+/* Take a ready strand from another worker, skipping workers that are busy */
+uTaskStrand_T *
+ExecSteal(
+    int Worker
+    )
+{
+    ExecWorker_T *pVictim;
+    uTaskStrand_T *pStrand;
+    int i;
+
+    for (i = 1; i < gExecCount; i = i + 1)
+    {
+        pVictim = &gExecWorker[(Worker + i) % gExecCount];
+
+        if (__atomic_load_n(&pVictim->pHead, __ATOMIC_RELAXED) == NULL ||
+            !ExecTryLock(&pVictim->Lock))
+        {
+            continue;
+        }
+
+        pStrand = pVictim->pHead;
+
+        if (pStrand)
+        {
+            __atomic_store_n(&pVictim->pHead, pStrand->pNextReady,
+                             __ATOMIC_RELAXED);
+
+            if (pVictim->pHead == NULL)
+            {
+                pVictim->pTail = NULL;
+            }
+        }
+
+        ExecUnlock(&pVictim->Lock);
+
+        if (pStrand)
+        {
+            return pStrand;
+        }
+    }
+
+    return NULL;
+}
+
+/* Run up to a batch of the strand's messages, requeue it if more are ready */
+void
+ExecRunStrand(
+    int Worker,
+    uTaskStrand_T *pStrand
+    )
+{
+    Tcb_T *pTcb;
+    int Queue;
+    int i;
+
+    for (i = 0; i < UTASK_EXEC_BATCH; i = i + 1)
+    {
+        ExecLock(&pStrand->Lock);
+
+        pTcb = pStrand->pReadyHead;
+
+        if (pTcb)
+        {
+            pStrand->pReadyHead = pTcb->pNext;
+
+            if (pStrand->pReadyHead == NULL)
+            {
+                pStrand->pReadyTail = NULL;
+            }
+
+            pStrand->State = EXEC_RUNNING;
+        }
+        else
+        {
+            pStrand->State = EXEC_IDLE;
+        }
+
+        ExecUnlock(&pStrand->Lock);
+
+        if (pTcb == NULL)
+        {
+            return;
+        }
+
+        /* Send the message to the task */
+        pTcb->pTask->Handler(pTcb->pTask, pTcb->Id, pTcb->pMsg);
+
+        /* Free the message structure */
+        uTaskFree(pTcb->pMsg);
+
+        TcbFree(gExecWorker[Worker].pCore, pTcb);
+    }
+
+    ExecLock(&pStrand->Lock);
+
+    Queue = (pStrand->pReadyHead != NULL);
+
+    pStrand->State = Queue ? EXEC_QUEUED : EXEC_IDLE;
+
+    ExecUnlock(&pStrand->Lock);
+
+    if (Queue)
+    {
+        ExecPush(Worker, pStrand);
+    }
+}
+
+void
+ExecLoop(
+    int Worker
+    )
+{
+    uTaskCore_T *pCore = gExecWorker[Worker].pCore;
+    uTaskStrand_T *pStrand;
+    Tcb_T *pTcb;
+    int Idle = 0;
+    int Turn = 0;
+
+    gExecSelf = Worker + 1;
+
+#if UTASK_INTAKE_SIZE
+    gpLoopCore = pCore;
+#endif
+
+    for ( ; ; )
+    {
+        /* The default instance holds the shutdown request for all workers */
+        if (CORE_FLAGS(&gCore) & CORE_FLAGS_SHUTDOWN)
+        {
+            DBG_MSG(DBG_WARN, "Worker %d shutdown\n", Worker);
+            break;
+        }
+
+        /* If the are any isr queue items, move them into tcb queue */
+        if (!QUEUE_EMPTY(pCore->IsrQ))
+        {
+            pTcb = TcbAlloc(pCore);
+
+            if (pTcb)
+            {
+                QUEUE_GET(pCore->IsrQ, *pTcb);
+
+                TcbEnqueue(pCore, pTcb);
+            }
+        }
+
+        IntakeDrain(pCore);
+
+        /* Hand every expired tcb to its strand */
+        for (pTcb = TcbFront(pCore);
+             pTcb && TIME_AFTER_EQ(uTaskCoreGetTick(pCore), pTcb->Expire);
+             pTcb = TcbFront(pCore))
+        {
+            ExecReady(Worker, TcbDequeue(pCore));
+        }
+
+        ExecInboxDrain(Worker);
+
+        /* Alternate between pinned and shared strands so neither starves */
+        Turn = !Turn;
+
+        pStrand = Turn ? ExecPopHome(Worker) : NULL;
+
+        if (pStrand == NULL)
+        {
+            pStrand = ExecPop(Worker);
+        }
+
+        if (pStrand == NULL)
+        {
+            pStrand = ExecPopHome(Worker);
+        }
+
+        if (pStrand == NULL)
+        {
+            pStrand = ExecSteal(Worker);
+        }
+
+        if (pStrand)
+        {
+            ExecRunStrand(Worker, pStrand);
+            Idle = 0;
+        }
+#if UTASK_IDLE_PARK
+        else
+        {
+            /* Bounded, other workers do not wake it for stealable work */
+            CoreIdle(pCore, &Idle, &gExecWorker[Worker].pInbox,
+                     EXEC_SLEEP_NS);
+        }
+#else
+        else if (Idle < EXEC_SPIN)
+        {
+            sched_yield();
+            Idle = Idle + 1;
+        }
+        else
+        {
+            ExecSleep(Worker);
+        }
+#endif
+    }
+
+    gExecSelf = 0;
+
+#if UTASK_INTAKE_SIZE
+    gpLoopCore = NULL;
+#endif
+}
+
+/*
+ * Drop the messages still queued on the worker's strands after a run, so
+ * the strands are idle for the next run.  Like the tcb queue, their tcbs
+ * are taken back by uTaskCtor.
+ */
+void
+ExecReset(
+    int Worker
+    )
+{
+    uTaskStrand_T *pStrand;
+
+    while ((pStrand = ExecPop(Worker)) != NULL ||
+           (pStrand = ExecPopHome(Worker)) != NULL)
+    {
+        pStrand->pReadyHead = NULL;
+        pStrand->pReadyTail = NULL;
+        pStrand->State = EXEC_IDLE;
+    }
+
+    gExecWorker[Worker].pInbox = NULL;
+}
+
+void *
+ExecThread(
+    void *pArg
+    )
+{
+    int Go;
+
+    /* Wait until every worker exists */
+    while ((Go = __atomic_load_n(&gExecGo, __ATOMIC_ACQUIRE)) == 0)
+    {
+        sched_yield();
+    }
+
+    if (Go < 0)
+    {
+        return NULL;
+    }
+
+    ExecLoop((int)(long)pArg);
+
+    /* Blocks cached by this thread would be lost when it exits */
+    uTaskPoolFlush();
+
+    return NULL;
+}
+
+#endif
+
+/******************************************************************************/
+
+/* If the sum of all block counts are zero we disable the pool */
+#if ((UTASK_POOL_COUNT1+UTASK_POOL_COUNT2+\
+      UTASK_POOL_COUNT3+UTASK_POOL_COUNT4) == 0)
+#undef UTASK_POOL_USE
+#endif
+
+#if UTASK_POOL_USE
+
+#if UTASK_DEBUG && UTASK_POOL_DEBUG
+
+/*
+ * For overwrite detection we increase the block size to include the
+ * beginning signature, the actual size of the block and the end
+ * signature.  The size of the block is needed because the caller could
+ * request a block of 5 bytes, but the only block avaiable is a 64 byte
+ * block.  If this happens we need the requested size to ensure the caller
+ * is not writing passed the requested size, not just writing passed the
+ * data avilable in the block.
+ */
+#define UTASK_POOL_SIG_SIZE     (sizeof(uint16)+sizeof(uint16)+sizeof(uint))
+#define UTASK_POOL_SIG_BEG      0xDEAD
+#define UTASK_POOL_SIG_END      0xFFED
+#define UTASK_POOL_SIG_EMPTY    0xEE
+
+#else
+
+#define UTASK_POOL_SIG_SIZE     0
+
+#endif
+
+#if UTASK_POOL_ALIGN & (UTASK_POOL_ALIGN - 1)
+#error UTASK_POOL_ALIGN must be a power of 2
+#endif
+
+#if defined(__SIZEOF_POINTER__) && UTASK_POOL_ALIGN &&\
+    UTASK_POOL_ALIGN < __SIZEOF_POINTER__
+#error UTASK_POOL_ALIGN must be no smaller than a pointer
+#endif
+
+#if (UTASK_POOL_COUNT1 && UTASK_POOL_SIZE1 <= 0) ||\
+    (UTASK_POOL_COUNT2 && UTASK_POOL_SIZE2 <= 0) ||\
+    (UTASK_POOL_COUNT3 && UTASK_POOL_SIZE3 <= 0) ||\
+    (UTASK_POOL_COUNT4 && UTASK_POOL_SIZE4 <= 0)
+#error A pool with blocks needs a block size
+#endif
+
+#if UTASK_POOL_RESERVE1 > UTASK_POOL_COUNT1 ||\
+    UTASK_POOL_RESERVE2 > UTASK_POOL_COUNT2 ||\
+    UTASK_POOL_RESERVE3 > UTASK_POOL_COUNT3 ||\
+    UTASK_POOL_RESERVE4 > UTASK_POOL_COUNT4
+#error A pool reserve must not exceed the pool count
+#endif
+
+#if UTASK_POOL_ALIGN
+#define UTASK_POOL_ALIGN_SIZE   UTASK_POOL_ALIGN
+#else
+#define UTASK_POOL_ALIGN_SIZE   sizeof(PoolBlock_T)
+#endif
+
+/* Block size including the signatures, rounded up to the block alignment */
+#define UTASK_POOL_UP(n)\
+    ((((n)+UTASK_POOL_SIG_SIZE)+(UTASK_POOL_ALIGN_SIZE-1)) & ~(UTASK_POOL_ALIGN_SIZE-1))
+
+#if defined(__GNUC__)
+#define UTASK_POOL_MEM_ALIGN    __attribute__((aligned(UTASK_POOL_ALIGN_SIZE)))
+#else
+#define UTASK_POOL_MEM_ALIGN
+#endif
+
+/* 2MB, the usual huge page size */
+#define UTASK_POOL_HUGEPAGE_SIZE    (2UL*1024*1024)
+
+typedef struct PoolBlock_T
+{
+    struct PoolBlock_T  *pNext;
+} PoolBlock_T;
+
+typedef struct
+{
+    uint                uCount;
+    uint                uSize;
+    uint                uReserve;
+    void                *pBeg;
+    PoolBlock_T         *pHead;
+    uint                uFree;
+    uint32              uReserveUsed;
+    uint32              uReserveEmpty;
+#if UTASK_POOL_BITMAP
+    uint                *pMap;
+#endif
+#if UTASK_POOL_REFCOUNT
+    uint8               *pRef;
+#endif
+} PoolHead_T;
+
+#define UTASK_POOL_MEM_SIZE\
+    ((UTASK_POOL_COUNT1*UTASK_POOL_UP(UTASK_POOL_SIZE1)) +\
+     (UTASK_POOL_COUNT2*UTASK_POOL_UP(UTASK_POOL_SIZE2)) +\
+     (UTASK_POOL_COUNT3*UTASK_POOL_UP(UTASK_POOL_SIZE3)) +\
+     (UTASK_POOL_COUNT4*UTASK_POOL_UP(UTASK_POOL_SIZE4)))
+
+#if UTASK_POOL_HUGEPAGE
+static uint8 *gPoolMem;
+#else
+static uint8 gPoolMem[UTASK_POOL_MEM_SIZE] UTASK_POOL_MEM_ALIGN;
+#endif
+
+/* Initializers of the optional PoolHead_T fields */
+#if UTASK_POOL_BITMAP
+#define POOL_HEAD_MAP           , NULL
+#else
+#define POOL_HEAD_MAP
+#endif
+
+#if UTASK_POOL_REFCOUNT
+#define POOL_HEAD_REF           , NULL
+#else
+#define POOL_HEAD_REF
+#endif
+
+#define POOL_HEAD(Count, Size, Reserve)\
+    {Count, Size, Reserve, NULL, NULL, 0, 0, 0 POOL_HEAD_MAP POOL_HEAD_REF}
+
+static PoolHead_T gPool[] =
+{
+#if UTASK_POOL_COUNT1
+    POOL_HEAD(UTASK_POOL_COUNT1, UTASK_POOL_SIZE1, UTASK_POOL_RESERVE1),
+#endif
+#if UTASK_POOL_COUNT2
+    POOL_HEAD(UTASK_POOL_COUNT2, UTASK_POOL_SIZE2, UTASK_POOL_RESERVE2),
+#endif
+#if UTASK_POOL_COUNT3
+    POOL_HEAD(UTASK_POOL_COUNT3, UTASK_POOL_SIZE3, UTASK_POOL_RESERVE3),
+#endif
+#if UTASK_POOL_COUNT4
+    POOL_HEAD(UTASK_POOL_COUNT4, UTASK_POOL_SIZE4, UTASK_POOL_RESERVE4),
+#endif
+};
+
+#if UTASK_POOL_BITMAP
+
+/* Bits per bitmap word, a set bit marks a free block */
+#define POOL_MAP_BITS           (sizeof(uint)*8)
+#define POOL_MAP_WORDS(n)       (((n) + POOL_MAP_BITS - 1) / POOL_MAP_BITS)
+
+#if defined(__GNUC__)
+#define POOL_MAP_CTZ(w)         ((uint)__builtin_ctz(w))
+#else
+#define POOL_MAP_CTZ(w)         PoolCtz(w)
+#endif
+
+static uint gPoolMap
+[
+    POOL_MAP_WORDS(UTASK_POOL_COUNT1) +
+    POOL_MAP_WORDS(UTASK_POOL_COUNT2) +
+    POOL_MAP_WORDS(UTASK_POOL_COUNT3) +
+    POOL_MAP_WORDS(UTASK_POOL_COUNT4)
+];
+
+uint
+PoolCtz(
+    uint w
+    );
+
+#endif
+
+#if UTASK_POOL_REFCOUNT
+
+/* Low bits count extra references, the top bit marks a chain header */
+#define POOL_REF_MASK           0x7F
+#define POOL_REF_CHAIN          0x80
+
+/* Extra references per block, 0 when the block has a single owner */
+static uint8 gPoolRef
+[
+    UTASK_POOL_COUNT1 + UTASK_POOL_COUNT2 + UTASK_POOL_COUNT3 + UTASK_POOL_COUNT4
+];
+
+#endif
+
+#if UTASK_POOL_MAG_SIZE
+
+#if UTASK_POOL_MAG_BATCH < 1 || UTASK_POOL_MAG_BATCH > UTASK_POOL_MAG_SIZE
+#error UTASK_POOL_MAG_BATCH must be between 1 and UTASK_POOL_MAG_SIZE
+#endif
+
+/* Per thread stack of free blocks for one pool */
+typedef struct
+{
+    uint                uCount;
+    void                *pBlock[UTASK_POOL_MAG_SIZE];
+} PoolMag_T;
+
+static UTASK_THREAD_LOCAL PoolMag_T gPoolMag[COUNTOF(gPool)];
+
+#endif
+
+int
+PoolInit(
+    void
+    )
+{
+    int i;
+    int j;
+    uint8 *p;
+    PoolHead_T Temp;
+#if UTASK_POOL_BITMAP
+    uint *pMap;
+#endif
+
+    DBG_MSG(DBG_TRACE, "%s\n", __FUNCTION__);
+
+#if UTASK_POOL_HUGEPAGE
+    if (gPoolMem == NULL)
+    {
+        if (PoolArena() != UTASK_S_OK)
+        {
+            return UTASK_E_FAIL;
+        }
+    }
+#endif
+
+    /* Sort the pool blocks into accending sizes */
+    for (i = COUNTOF(gPool) - 2; i >= 0; i = i - 1)
+    {
+        for (j = 0; j <= i; j = j + 1)
+        {
+            if (gPool[j].uSize > gPool[j+1].uSize)
+            {
+                Temp = gPool[j];
+                gPool[j] = gPool[j+1];
+                gPool[j+1] = Temp;
+            }
+        }
+    }
+
+    for (i = 0; i < (int)COUNTOF(gPool); i = i + 1)
+    {
+        gPool[i].uFree = gPool[i].uCount;
+    }
+
+#if UTASK_POOL_REFCOUNT
+    /* Each pool's slice of the reference counts */
+    memset(gPoolRef, 0, sizeof(gPoolRef));
+
+    for (i = 0, j = 0; i < (int)COUNTOF(gPool); i = i + 1)
+    {
+        gPool[i].pRef = &gPoolRef[j];
+        j = j + gPool[i].uCount;
+    }
+#endif
+
+#if UTASK_POOL_BITMAP
+
+    /* Mark every block in the pool bitmaps free */
+    p = gPoolMem;
+    pMap = gPoolMap;
+
+    for (i = 0; i < (int)COUNTOF(gPool); i = i + 1)
+    {
+        gPool[i].pBeg = p;
+        gPool[i].pMap = pMap;
+
+        for (j = 0; j < (int)gPool[i].uCount; j = j + POOL_MAP_BITS)
+        {
+            if (gPool[i].uCount - j >= POOL_MAP_BITS)
+            {
+                *pMap = ~0u;
+            }
+            else
+            {
+                *pMap = (1u << (gPool[i].uCount - j)) - 1;
+            }
+            pMap = pMap + 1;
+        }
+
+        p = p + gPool[i].uCount * UTASK_POOL_UP(gPool[i].uSize);
+    }
+
+#else
+
+    /* Build the pool free blocks lists, from scratch on a second uTaskCtor */
+    p = gPoolMem;
+
+    for (i = 0; i < COUNTOF(gPool); i = i + 1)
+    {
+        gPool[i].pHead = NULL;
+
+        if (gPool[i].uCount)
+        {
+            gPool[i].pBeg = p;
+
+            for (j = 0; j < (int)gPool[i].uCount; j = j + 1)
+            {
+                ((PoolBlock_T *)p)->pNext = gPool[i].pHead;
+                gPool[i].pHead = (PoolBlock_T *)p;
+                p = p + UTASK_POOL_UP(gPool[i].uSize);
+            }
+        }
+    }
+
+#endif
+
+#if UTASK_POOL_MAG_SIZE
+    /* Blocks cached by the calling thread belong to the old lists */
+    memset(gPoolMag, 0, sizeof(gPoolMag));
+#endif
+
+    return UTASK_S_OK;
+}
+
+#if UTASK_POOL_HUGEPAGE
+
+int
+PoolArena(
+    void
+    )
+{
+    uint8 *p;
+    uint8 *pBeg;
+    unsigned long uSize;
+
+    /* Map an extra huge page so the arena can start on a huge page boundary */
+    uSize = (UTASK_POOL_MEM_SIZE + UTASK_POOL_HUGEPAGE_SIZE - 1) &
+            ~(UTASK_POOL_HUGEPAGE_SIZE - 1);
+
+    p = mmap(NULL, uSize + UTASK_POOL_HUGEPAGE_SIZE, PROT_READ|PROT_WRITE,
+             MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+
+    if (p == MAP_FAILED)
+    {
+        DBG_MSG(DBG_ERROR, "Pool arena map failed\n");
+        return UTASK_E_FAIL;
+    }
+
+    pBeg = (uint8 *)(((unsigned long)p + UTASK_POOL_HUGEPAGE_SIZE - 1) &
+                     ~(UTASK_POOL_HUGEPAGE_SIZE - 1));
+
+    /* Return the unaligned head and tail of the mapping */
+    if (pBeg != p)
+    {
+        munmap(p, pBeg - p);
+    }
+
+    munmap(pBeg + uSize, (p + uSize + UTASK_POOL_HUGEPAGE_SIZE) - (pBeg + uSize));
+
+#ifdef MADV_HUGEPAGE
+    /* Only advice, the arena still works on small pages */
+    madvise(pBeg, uSize, MADV_HUGEPAGE);
+#endif
+
+    /* Fault in every page now rather than on first use */
+    memset(pBeg, 0, uSize);
+
+    gPoolMem = pBeg;
+
+    return UTASK_S_OK;
+}
+
+#endif
+
+int
+PoolClass(
+    uint uSize
+    )
+{
+    int i;
+
+    /* Pools are sorted, the first pool large enough is the best fit */
+    for (i = 0; i < (int)COUNTOF(gPool); i = i + 1)
+    {
+        if (uSize <= gPool[i].uSize)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int
+PoolFind(
+    void *pMem
+    )
+{
+    uint8 *p = pMem;
+    int i;
+
+    /* Is this memory block in the pool */
+    if (p >= (uint8 *)gPoolMem &&
+        p < ((uint8 *)gPoolMem + UTASK_POOL_MEM_SIZE))
+    {
+        for (i = 0; i < (int)COUNTOF(gPool); i = i + 1)
+        {
+            if (p >= (uint8 *)gPool[i].pBeg &&
+                p < ((uint8 *)gPool[i].pBeg + 
+                     (gPool[i].uCount * UTASK_POOL_UP(gPool[i].uSize))))
+            {
+                return i;
+            }
+        }
+    }
+
+    return -1;
+}
+
+int
+PoolIndex(
+    int i,
+    void *pMem
+    )
+{
+    /* Block number from any address within the block */
+    return ((uint8 *)pMem - (uint8 *)gPool[i].pBeg) / UTASK_POOL_UP(gPool[i].uSize);
+}
+
+#if UTASK_POOL_REFCOUNT
+
+int
+PoolRetain(
+    void *pMem
+    )
+{
+    int i;
+    uint8 *pRef;
+
+    i = PoolFind(pMem);
+
+    if (i < 0)
+    {
+        /* Variable size blocks have no count, other memory is never freed */
+        return TlsfFind(pMem) ? UTASK_E_FAIL : UTASK_S_OK;
+    }
+
+    pRef = &gPool[i].pRef[PoolIndex(i, pMem)];
+
+    if ((*pRef & POOL_REF_MASK) == POOL_REF_MASK)
+    {
+        DBG_MSG(DBG_ERROR, "Pool block %p reference overflow\n", pMem);
+        return UTASK_E_FAIL;
+    }
+
+    *pRef = *pRef + 1;
+
+    return UTASK_S_OK;
+}
+
+int
+PoolRelease(
+    int i,
+    void *pMem
+    )
+{
+    uint8 *pRef;
+
+    pRef = &gPool[i].pRef[PoolIndex(i, pMem)];
+
+    /* Drop an extra reference, 0 means the caller holds the last one */
+    if (*pRef & POOL_REF_MASK)
+    {
+        *pRef = *pRef - 1;
+        return 1;
+    }
+
+    return 0;
+}
+
+#else
+
+int
+PoolRetain(
+    void *pMem
+    )
+{
+    return (PoolFind(pMem) < 0 && !TlsfFind(pMem)) ? UTASK_S_OK : UTASK_E_FAIL;
+}
+
+int
+PoolRelease(
+    int i,
+    void *pMem
+    )
+{
+    UNUSED_PARAM(i);
+    UNUSED_PARAM(pMem);
+    return 0;
+}
+
+#endif
+
+#if UTASK_CHAIN_USE
+
+void
+PoolChainMark(
+    void *pMem
+    )
+{
+    int i;
+
+    i = PoolFind(pMem);
+
+    if (i >= 0)
+    {
+        gPool[i].pRef[PoolIndex(i, pMem)] |= POOL_REF_CHAIN;
+    }
+}
+
+void *
+PoolChainTake(
+    int i,
+    void *pMem
+    )
+{
+    uint8 *pRef;
+
+    pRef = &gPool[i].pRef[PoolIndex(i, pMem)];
+
+    /* A chain header owns its segments, hand them to the caller to free */
+    if (*pRef & POOL_REF_CHAIN)
+    {
+        *pRef = *pRef & ~POOL_REF_CHAIN;
+        return ((Chain_T *)pMem)->pHead;
+    }
+
+    return NULL;
+}
+
+#else
+
+void *
+PoolChainTake(
+    int i,
+    void *pMem
+    )
+{
+    UNUSED_PARAM(i);
+    UNUSED_PARAM(pMem);
+    return NULL;
+}
+
+#endif
+
+uint
+PoolMax(
+    void
+    )
+{
+    return gPool[COUNTOF(gPool) - 1].uSize;
+}
+
+#if UTASK_POOL_BITMAP
+
+uint
+PoolCtz(
+    uint w
+    )
+{
+    uint n = 0;
+
+    /* Count trailing zeros, w must not be zero */
+    while ((w & 1) == 0)
+    {
+        w = w >> 1;
+        n = n + 1;
+    }
+
+    return n;
+}
+
+void *
+PoolGet(
+    int i
+    )
+{
+    uint j;
+    uint n;
+    uint *pMap = gPool[i].pMap;
+
+    /* First word with a free block, its lowest set bit is the block */
+    for (j = 0; j < POOL_MAP_WORDS(gPool[i].uCount); j = j + 1)
+    {
+        if (pMap[j])
+        {
+            n = POOL_MAP_CTZ(pMap[j]);
+            pMap[j] = pMap[j] & ~(1u << n);
+            gPool[i].uFree = gPool[i].uFree - 1;
+
+            return (uint8 *)gPool[i].pBeg + 
+                   (j * POOL_MAP_BITS + n) * UTASK_POOL_UP(gPool[i].uSize);
+        }
+    }
+
+    return NULL;
+}
+
+void
+PoolPut(
+    int i,
+    void *p
+    )
+{
+    uint n;
+    uint *pMap;
+
+    n = PoolIndex(i, p);
+    pMap = &gPool[i].pMap[n / POOL_MAP_BITS];
+    n = n % POOL_MAP_BITS;
+
+    if (*pMap & (1u << n))
+    {
+        /* Already free, ignore it rather than free it twice */
+        DBG_MSG(DBG_WARN, "Pool block %p double free\n", p);
+        return;
+    }
+
+    *pMap = *pMap | (1u << n);
+    gPool[i].uFree = gPool[i].uFree + 1;
+}
+
+#else
+
+void *
+PoolGet(
+    int i
+    )
+{
+    PoolBlock_T *p;
+
+    /* Remove block from head of pool free list */
+    p = gPool[i].pHead;
+
+    if (p)
+    {
+        gPool[i].pHead = p->pNext;
+        gPool[i].uFree = gPool[i].uFree - 1;
+    }
+
+    return p;
+}
+
+void
+PoolPut(
+    int i,
+    void *p
+    )
+{
+    /* Add block to head of pool free list */
+    ((PoolBlock_T *)p)->pNext = gPool[i].pHead;
+    gPool[i].pHead = (PoolBlock_T *)p;
+    gPool[i].uFree = gPool[i].uFree + 1;
+}
+
+#endif
+
+void *
+PoolSign(
+    void *p,
+    uint uSize
+    )
+{
+#if UTASK_DEBUG && UTASK_POOL_DEBUG
+    /* Set the alloc size and beg and end signatures */
+    *(uint *)p = uSize;
+    *(uint16 *)((uint8 *)p+sizeof(uint)) = UTASK_POOL_SIG_BEG;
+    p = (uint8 *)p + sizeof(uint16) + sizeof(uint);
+    memset(p, UTASK_POOL_SIG_EMPTY, uSize);
+    *(uint16 *)((uint8 *)p + uSize) = UTASK_POOL_SIG_END;
+#else
+    UNUSED_PARAM(uSize);
+#endif
+
+    return p;
+}
+
+void *
+PoolCheck(
+    int i,
+    void *pMem
+    )
+{
+    uint8 *p = pMem;
+
+#if UTASK_DEBUG && UTASK_POOL_DEBUG
+    uint uSize = *(uint *)((uint8 *)p - 
+                 (sizeof(uint) + sizeof(uint16)));
+
+    /* Validate the memory size */
+    if (uSize > gPool[i].uSize)
+    {
+        /* Size overwrite */
+        DBG_MSG(DBG_WARN, "Pool block %p size out of range\n", p);
+    }
+
+    if (*(uint16 *)((uint8 *)p - sizeof(uint16)) != UTASK_POOL_SIG_BEG)
+    {
+        /* Beginning signature overwrite */
+        DBG_MSG(DBG_WARN, "Pool block %p beg signature overwrite\n", p);
+    }
+
+    if (*(uint16 *)((uint8 *)p + uSize) != UTASK_POOL_SIG_END)
+    {
+        /* Ending signature overwrite */
+        DBG_MSG(DBG_WARN, "Pool block %p end signature overwrite\n", p);
+    }
+
+    p = (uint8 *)p - (sizeof(uint16) + sizeof(uint));
+#else
+    UNUSED_PARAM(i);
+#endif
+
+    return p;
+}
+
+void *
+PoolAlloc(
+    uint uSize
+    )
+{
+    int i;
+    void *p = NULL;
+
+    i = PoolClass(uSize);
+
+    /* Task context allocs leave the reserve for isr allocs */
+    if (i >= 0 && gPool[i].uFree > gPool[i].uReserve)
+    {
+        p = PoolGet(i);
+
+        if (p)
+        {
+            p = PoolSign(p, uSize);
+        }
+    }
+
+    return p;
+}
+
+void *
+PoolAllocIsr(
+    uint uSize
+    )
+{
+    int i;
+    void *p = NULL;
+
+    i = PoolClass(uSize);
+
+    if (i >= 0)
+    {
+        /* Count allocs which dip into or find an empty reserve */
+        if (gPool[i].uFree <= gPool[i].uReserve)
+        {
+            if (gPool[i].uFree)
+            {
+                gPool[i].uReserveUsed = gPool[i].uReserveUsed + 1;
+            }
+            else if (gPool[i].uReserve)
+            {
+                gPool[i].uReserveEmpty = gPool[i].uReserveEmpty + 1;
+            }
+        }
+
+        p = PoolGet(i);
+
+        if (p)
+        {
+            p = PoolSign(p, uSize);
+        }
+    }
+
+    return p;
+}
+
+int
+PoolStats(
+    int i,
+    uTaskPoolStats_T *pStats
+    )
+{
+    if (i < 0 || i >= (int)COUNTOF(gPool))
+    {
+        return UTASK_E_FAIL;
+    }
+
+    pStats->uSize           = gPool[i].uSize;
+    pStats->uCount          = gPool[i].uCount;
+    pStats->uFree           = gPool[i].uFree;
+    pStats->uReserve        = gPool[i].uReserve;
+    pStats->uReserveUsed    = gPool[i].uReserveUsed;
+    pStats->uReserveEmpty   = gPool[i].uReserveEmpty;
+
+    return UTASK_S_OK;
+}
+
+void
+PoolFree(
+    void *pMem
+    )
+{
+    int i;
+    ChainSeg_T *pSeg;
+    ChainSeg_T *pNext;
+
+    i = PoolFind(pMem);
+
+    if (i >= 0 && !PoolRelease(i, pMem))
+    {
+        pSeg = PoolChainTake(i, pMem);
+
+        PoolPut(i, PoolCheck(i, pMem));
+
+        /* Last reference to a chain, free its segments too */
+        while (pSeg)
+        {
+            pNext = pSeg->pNext;
+            PoolFree(pSeg);
+            pSeg = pNext;
+        }
+    }
+}
+
+#if UTASK_POOL_MAG_SIZE
+
+void *
+PoolMagAlloc(
+    uint uSize
+    )
+{
+    int i;
+    int PrevState;
+    void *p = NULL;
+    PoolMag_T *pMag;
+
+    i = PoolClass(uSize);
+
+    if (i >= 0)
+    {
+        pMag = &gPoolMag[i];
+
+        /* Magazine is empty, refill a batch from the shared pool */
+        if (pMag->uCount == 0)
+        {
+            PrevState = uTaskInterruptDisable();
+
+            while (pMag->uCount < UTASK_POOL_MAG_BATCH &&
+                   gPool[i].uFree > gPool[i].uReserve &&
+                   (p = PoolGet(i)) != NULL)
+            {
+                pMag->pBlock[pMag->uCount] = p;
+                pMag->uCount = pMag->uCount + 1;
+            }
+
+            uTaskInterruptRestore(PrevState);
+        }
+
+        p = NULL;
+
+        if (pMag->uCount)
+        {
+            pMag->uCount = pMag->uCount - 1;
+            p = PoolSign(pMag->pBlock[pMag->uCount], uSize);
+        }
+    }
+
+    return p;
+}
+
+void
+PoolMagFree(
+    void *pMem
+    )
+{
+    int i;
+    int PrevState;
+    int Shared;
+    PoolMag_T *pMag;
+    ChainSeg_T *pSeg;
+    ChainSeg_T *pNext;
+
+    i = PoolFind(pMem);
+
+#if UTASK_POOL_REFCOUNT
+    /*
+     * Other references exist, drop ours under the lock.  With no extra
+     * references the caller is the only owner and nobody can add one.
+     */
+    if (i >= 0 && (gPool[i].pRef[PoolIndex(i, pMem)] & POOL_REF_MASK))
+    {
+        PrevState = uTaskInterruptDisable();
+        Shared = PoolRelease(i, pMem);
+        uTaskInterruptRestore(PrevState);
+
+        if (Shared)
+        {
+            return;
+        }
+    }
+#endif
+
+    if (i >= 0)
+    {
+        pMag = &gPoolMag[i];
+        pSeg = PoolChainTake(i, pMem);
+
+        /* Magazine is full, return a batch to the shared pool */
+        if (pMag->uCount == UTASK_POOL_MAG_SIZE)
+        {
+            PrevState = uTaskInterruptDisable();
+
+            while (pMag->uCount > UTASK_POOL_MAG_SIZE - UTASK_POOL_MAG_BATCH)
+            {
+                pMag->uCount = pMag->uCount - 1;
+                PoolPut(i, pMag->pBlock[pMag->uCount]);
+            }
+
+            uTaskInterruptRestore(PrevState);
+        }
+
+        pMag->pBlock[pMag->uCount] = PoolCheck(i, pMem);
+        pMag->uCount = pMag->uCount + 1;
+
+        /* Last reference to a chain, free its segments too */
+        while (pSeg)
+        {
+            pNext = pSeg->pNext;
+            PoolMagFree(pSeg);
+            pSeg = pNext;
+        }
+    }
+}
+
+void
+PoolMagFlush(
+    void
+    )
+{
+    int i;
+    int PrevState;
+    PoolMag_T *pMag;
+
+    PrevState = uTaskInterruptDisable();
+
+    for (i = 0; i < (int)COUNTOF(gPool); i = i + 1)
+    {
+        pMag = &gPoolMag[i];
+
+        while (pMag->uCount)
+        {
+            pMag->uCount = pMag->uCount - 1;
+            PoolPut(i, pMag->pBlock[pMag->uCount]);
+        }
+    }
+
+    uTaskInterruptRestore(PrevState);
+}
+
+#else
+
+void *
+PoolMagAlloc(
+    uint uSize
+    )
+{
+    UNUSED_PARAM(uSize);
+    return NULL;
+}
+
+void
+PoolMagFree(
+    void *pMem
+    )
+{
+    UNUSED_PARAM(pMem);
+}
+
+void
+PoolMagFlush(
+    void
+    )
+{
+}
+
+#endif
+
+#else
+
+int
+PoolInit(
+    void
+    )
+{
+    return UTASK_S_OK;
+}
+
+int
+PoolClass(
+    uint uSize
+    )
+{
+    (void)uSize;
+    return -1;
+}
+
+int
+PoolFind(
+    void *pMem
+    )
+{
+    (void)pMem;
+    return -1;
+}
+
+int
+PoolRetain(
+    void *pMem
+    )
+{
+    return TlsfFind(pMem) ? UTASK_E_FAIL : UTASK_S_OK;
+}
+
+uint
+PoolMax(
+    void
+    )
+{
+    return 0;
+}
+
+void *
+PoolAlloc(
+    uint uSize
+    )
+{
+    (void)uSize;
+    return NULL;
+}
+
+void *
+PoolAllocIsr(
+    uint uSize
+    )
+{
+    (void)uSize;
+    return NULL;
+}
+
+int
+PoolStats(
+    int i,
+    uTaskPoolStats_T *pStats
+    )
+{
+    (void)i;
+    (void)pStats;
+    return UTASK_E_FAIL;
+}
+
+void
+PoolFree(
+    void *pMem
+    )
+{
+    (void)pMem;
+}
+
+void *
+PoolMagAlloc(
+    uint uSize
+    )
+{
+    (void)uSize;
+    return NULL;
+}
+
+void
+PoolMagFree(
+    void *pMem
+    )
+{
+    (void)pMem;
+}
+
+void
+PoolMagFlush(
+    void
+    )
+{
+}
+
+#endif
+
+/******************************************************************************/
+
+#if UTASK_CHAIN_USE
+
+#if !UTASK_POOL_USE || !UTASK_POOL_REFCOUNT
+#error UTASK_CHAIN_USE requires UTASK_POOL_USE and UTASK_POOL_REFCOUNT
+#endif
+
+/* Segments are blocks of the largest pool */
+#define CHAIN_SEG_CAP       (PoolMax() - (uint)sizeof(ChainSeg_T))
+#define CHAIN_SEG_DATA(s)   ((uint8 *)((s) + 1))
+#define CHAIN_MIN(a, b)     ((a) < (b) ? (a) : (b))
+
+ChainSeg_T *
+ChainSegAlloc(
+    uint uCount
+    )
+{
+    uint i;
+    ChainSeg_T *pList = NULL;
+    ChainSeg_T *pSeg;
+
+    /* Allocate all segments up front so a failure changes nothing */
+    for (i = 0; i < uCount; i = i + 1)
+    {
+        pSeg = uTaskAlloc(PoolMax());
+
+        if (pSeg == NULL)
+        {
+            ChainSegFree(pList);
+            return NULL;
+        }
+
+        pSeg->pNext = pList;
+        pSeg->uOff  = 0;
+        pSeg->uLen  = 0;
+        pList = pSeg;
+    }
+
+    return pList;
+}
+
+void
+ChainSegFree(
+    ChainSeg_T *pSeg
+    )
+{
+    ChainSeg_T *pNext;
+
+    while (pSeg)
+    {
+        pNext = pSeg->pNext;
+        uTaskFree(pSeg);
+        pSeg = pNext;
+    }
+}
+
+void *
+uTaskChainAlloc(
+    void
+    )
+{
+    Chain_T *pChain;
+    int PrevState;
+
+    pChain = uTaskAlloc(sizeof(Chain_T));
+
+    if (pChain)
+    {
+        pChain->pHead = NULL;
+        pChain->pTail = NULL;
+        pChain->uLen  = 0;
+
+        /* Mark the header so the last uTaskFree frees the segments */
+        PrevState = uTaskInterruptDisable();
+        PoolChainMark(pChain);
+        uTaskInterruptRestore(PrevState);
+    }
+
+    return pChain;
+}
+
+int
+uTaskChainAppend(
+    IN void             *pChainMem,
+    IN const void       *pData,
+    IN int              Len
+    )
+{
+    Chain_T *pChain = pChainMem;
+    ChainSeg_T *pTail = pChain->pTail;
+    ChainSeg_T *pList = NULL;
+    ChainSeg_T *pSeg;
+    const uint8 *pSrc = pData;
+    uint uRoom = 0;
+    uint uCopy;
+    uint uLen;
+
+    if (Len < 0)
+    {
+        return UTASK_E_FAIL;
+    }
+
+    uLen = (uint)Len;
+
+    /* Space left after the data in the tail segment */
+    if (pTail)
+    {
+        uRoom = CHAIN_SEG_CAP - (pTail->uOff + pTail->uLen);
+    }
+
+    if (uLen > uRoom)
+    {
+        pList = ChainSegAlloc((uLen - uRoom + CHAIN_SEG_CAP - 1) / CHAIN_SEG_CAP);
+
+        if (pList == NULL)
+        {
+            return UTASK_E_FAIL;
+        }
+    }
+
+    pChain->uLen = pChain->uLen + uLen;
+
+    /* Fill the tail segment, then the new segments in order */
+    if (pTail && uRoom)
+    {
+        uCopy = CHAIN_MIN(uLen, uRoom);
+        memcpy(CHAIN_SEG_DATA(pTail) + pTail->uOff + pTail->uLen, pSrc, uCopy);
+        pTail->uLen = (uint16)(pTail->uLen + uCopy);
+        pSrc = pSrc + uCopy;
+        uLen = uLen - uCopy;
+    }
+
+    for (pSeg = pList; pSeg; pSeg = pSeg->pNext)
+    {
+        uCopy = CHAIN_MIN(uLen, CHAIN_SEG_CAP);
+        memcpy(CHAIN_SEG_DATA(pSeg), pSrc, uCopy);
+        pSeg->uLen = (uint16)uCopy;
+        pSrc = pSrc + uCopy;
+        uLen = uLen - uCopy;
+
+        if (pTail)
+        {
+            pTail->pNext = pSeg;
+        }
+        else
+        {
+            pChain->pHead = pSeg;
+        }
+        pTail = pSeg;
+    }
+
+    pChain->pTail = pTail;
+
+    return UTASK_S_OK;
+}
+
+int
+uTaskChainPrepend(
+    IN void             *pChainMem,
+    IN const void       *pData,
+    IN int              Len
+    )
+{
+    Chain_T *pChain = pChainMem;
+    ChainSeg_T *pHead = pChain->pHead;
+    ChainSeg_T *pList = NULL;
+    ChainSeg_T *pSeg;
+    ChainSeg_T *pLast = NULL;
+    const uint8 *pSrc = pData;
+    uint uRoom = 0;
+    uint uNew = 0;
+    uint uCopy;
+
+    if (Len < 0)
+    {
+        return UTASK_E_FAIL;
+    }
+
+    /* Space before the data in the head segment */
+    if (pHead)
+    {
+        uRoom = CHAIN_MIN((uint)Len, pHead->uOff);
+    }
+
+    uNew = (uint)Len - uRoom;
+
+    if (uNew)
+    {
+        pList = ChainSegAlloc((uNew + CHAIN_SEG_CAP - 1) / CHAIN_SEG_CAP);
+
+        if (pList == NULL)
+        {
+            return UTASK_E_FAIL;
+        }
+    }
+
+    pChain->uLen = pChain->uLen + (uint)Len;
+
+    /*
+     * The first uNew bytes go to the new segments, the first of which is
+     * filled to its end so later prepends can use the space before it.
+     */
+    for (pSeg = pList; pSeg; pSeg = pSeg->pNext)
+    {
+        uCopy = uNew % CHAIN_SEG_CAP;
+
+        if (uCopy == 0)
+        {
+            uCopy = CHAIN_SEG_CAP;
+        }
+
+        pSeg->uOff = (uint16)(CHAIN_SEG_CAP - uCopy);
+        pSeg->uLen = (uint16)uCopy;
+        memcpy(CHAIN_SEG_DATA(pSeg) + pSeg->uOff, pSrc, uCopy);
+        pSrc = pSrc + uCopy;
+        uNew = uNew - uCopy;
+        pLast = pSeg;
+    }
+
+    /* The remaining bytes go in front of the data of the old head */
+    if (uRoom)
+    {
+        pHead->uOff = (uint16)(pHead->uOff - uRoom);
+        pHead->uLen = (uint16)(pHead->uLen + uRoom);
+        memcpy(CHAIN_SEG_DATA(pHead) + pHead->uOff, pSrc, uRoom);
+    }
+
+    if (pLast)
+    {
+        pLast->pNext = pHead;
+        pChain->pHead = pList;
+
+        if (pChain->pTail == NULL)
+        {
+            pChain->pTail = pLast;
+        }
+    }
+
+    return UTASK_S_OK;
+}
+
+int
+uTaskChainPeel(
+    IN void             *pChainMem,
+    IN int              Len
+    )
+{
+    Chain_T *pChain = pChainMem;
+    ChainSeg_T *pHead;
+    uint uDrop;
+    int Peeled = 0;
+
+    while (Len > 0 && pChain->pHead)
+    {
+        pHead = pChain->pHead;
+        uDrop = CHAIN_MIN((uint)Len, pHead->uLen);
+
+        pHead->uOff = (uint16)(pHead->uOff + uDrop);
+        pHead->uLen = (uint16)(pHead->uLen - uDrop);
+        pChain->uLen = pChain->uLen - uDrop;
+        Len = Len - (int)uDrop;
+        Peeled = Peeled + (int)uDrop;
+
+        /* Free segments as they empty */
+        if (pHead->uLen == 0)
+        {
+            pChain->pHead = pHead->pNext;
+
+            if (pChain->pHead == NULL)
+            {
+                pChain->pTail = NULL;
+            }
+
+            uTaskFree(pHead);
+        }
+    }
+
+    return Peeled;
+}
+
+int
+uTaskChainLength(
+    IN void             *pChainMem
+    )
+{
+    return (int)((Chain_T *)pChainMem)->uLen;
+}
+
+void *
+uTaskChainData(
+    IN void             *pChainMem,
+    IN OUT void         **ppPos,
+    OUT int             *pLen
+    )
+{
+    ChainSeg_T *pSeg;
+
+    /* Continue after the segment returned last time */
+    if (*ppPos)
+    {
+        pSeg = ((ChainSeg_T *)*ppPos)->pNext;
+    }
+    else
+    {
+        pSeg = ((Chain_T *)pChainMem)->pHead;
+    }
+
+    *ppPos = pSeg;
+
+    if (pSeg == NULL)
+    {
+        *pLen = 0;
+        return NULL;
+    }
+
+    *pLen = pSeg->uLen;
+
+    return CHAIN_SEG_DATA(pSeg) + pSeg->uOff;
+}
+
+#endif
+
+/******************************************************************************/
+
+#if UTASK_STREAM_USE
+
+void
+uTaskStreamInit(
+    OUT uTaskStream_T   *pStream,
+    IN void             *pBuf,
+    IN int              Size,
+    IN uTask_T          *pTask,
+    IN int              Id
+    )
+{
+    memset(pStream, 0, sizeof(*pStream));
+
+    pStream->pBuf   = pBuf;
+    pStream->uSize  = (uint)Size;
+    pStream->pTask  = pTask;
+    pStream->Id     = Id;
+}
+
+void *
+uTaskStreamReserveIsr(
+    IN uTaskStream_T    *pStream,
+    IN int              Len
+    )
+{
+    uint uLen = (uint)Len;
+
+    if (Len <= 0)
+    {
+        return NULL;
+    }
+
+    /* Region B grows up to the start of region A */
+    if (pStream->BUse)
+    {
+        if (uLen > pStream->uA - pStream->uBEnd)
+        {
+            return NULL;
+        }
+        pStream->uResv = pStream->uBEnd;
+    }
+    /* Region A grows to the end of the buffer */
+    else if (uLen <= pStream->uSize - pStream->uAEnd)
+    {
+        pStream->uResv = pStream->uAEnd;
+    }
+    /* Else start region B in the space freed before region A */
+    else if (uLen <= pStream->uA)
+    {
+        pStream->uResv = 0;
+        pStream->uBEnd = 0;
+        pStream->BUse = 1;
+    }
+    else
+    {
+        return NULL;
+    }
+
+    return pStream->pBuf + pStream->uResv;
+}
+
+void
+uTaskStreamCommitIsr(
+    IN uTaskStream_T    *pStream,
+    IN int              Len
+    )
+{
+    if (Len <= 0)
+    {
+        return;
+    }
+
+    if (pStream->BUse)
+    {
+        pStream->uBEnd = pStream->uResv + (uint)Len;
+    }
+    else
+    {
+        pStream->uAEnd = pStream->uResv + (uint)Len;
+    }
+
+    /* One message per batch, the reader rearms it once it reads empty */
+    if (!pStream->Notify)
+    {
+        if (uTaskMessageSendIsr(pStream->pTask, pStream->Id, pStream) == UTASK_S_OK)
+        {
+            pStream->Notify = 1;
+        }
+    }
+}
+
+int
+uTaskStreamWriteIsr(
+    IN uTaskStream_T    *pStream,
+    IN const void       *pData,
+    IN int              Len
+    )
+{
+    void *p;
+
+    p = uTaskStreamReserveIsr(pStream, Len);
+
+    if (p == NULL)
+    {
+        return UTASK_E_FAIL;
+    }
+
+    memcpy(p, pData, (uint)Len);
+
+    uTaskStreamCommitIsr(pStream, Len);
+
+    return UTASK_S_OK;
+}
+
+void *
+uTaskStreamRead(
+    IN uTaskStream_T    *pStream,
+    OUT int             *pLen
+    )
+{
+    void *p = NULL;
+
+    int PrevState = uTaskInterruptDisable();
+
+    *pLen = (int)(pStream->uAEnd - pStream->uA);
+
+    if (*pLen)
+    {
+        p = pStream->pBuf + pStream->uA;
+    }
+    else
+    {
+        /* Empty, the next commit sends a new message */
+        pStream->Notify = 0;
+    }
+
+    uTaskInterruptRestore(PrevState);
+
+    return p;
+}
+
+void
+uTaskStreamConsume(
+    IN uTaskStream_T    *pStream,
+    IN int              Len
+    )
+{
+    int PrevState = uTaskInterruptDisable();
+
+    pStream->uA = pStream->uA + (uint)Len;
+
+    /* Region A is empty, region B becomes region A */
+    if (pStream->uA >= pStream->uAEnd)
+    {
+        if (pStream->BUse)
+        {
+            pStream->uAEnd = pStream->uBEnd;
+            pStream->BUse = 0;
+        }
+        else
+        {
+            pStream->uAEnd = 0;
+        }
+
+        pStream->uA = 0;
+        pStream->uBEnd = 0;
+    }
+
+    uTaskInterruptRestore(PrevState);
+}
+
+#endif
+
+/******************************************************************************/
+
+#if UTASK_TLSF_SIZE
+
+/*
+ * Two level segregated fit allocator.  Free blocks are kept in lists indexed
+ * by the highest set bit of their size (first level) and the next
+ * TLSF_SL_LOG2 bits (second level).  A bitmap per level records which lists
+ * are non-empty, so a fitting list is found with two bit scans and alloc and
+ * free take the same bounded time whatever the state of the region.
+ */
+/* Blocks get the pool block alignment, at least 8 */
+#if UTASK_POOL_ALIGN > 128
+#error UTASK_POOL_ALIGN must be at most 128 with UTASK_TLSF_SIZE
+#elif UTASK_POOL_ALIGN > 32
+#define TLSF_ALIGN_LOG2     (UTASK_POOL_ALIGN > 64 ? 7 : 6)
+#elif UTASK_POOL_ALIGN > 8
+#define TLSF_ALIGN_LOG2     (UTASK_POOL_ALIGN > 16 ? 5 : 4)
+#else
+#define TLSF_ALIGN_LOG2     3
+#endif
+#define TLSF_ALIGN          (1 << TLSF_ALIGN_LOG2)
+#define TLSF_SL_LOG2        4
+#define TLSF_SL_COUNT       (1 << TLSF_SL_LOG2)
+#define TLSF_FL_SHIFT       (TLSF_SL_LOG2 + TLSF_ALIGN_LOG2)
+#define TLSF_SMALL_SIZE     (1 << TLSF_FL_SHIFT)
+
+/* Enough first level lists for the largest block the region can hold */
+#if UTASK_TLSF_SIZE > 0x1000000
+#define TLSF_SIZE_LOG2      31
+#elif UTASK_TLSF_SIZE > 0x100000
+#define TLSF_SIZE_LOG2      24
+#elif UTASK_TLSF_SIZE > 0x10000
+#define TLSF_SIZE_LOG2      20
+#elif UTASK_TLSF_SIZE > 0x1000
+#define TLSF_SIZE_LOG2      16
+#else
+#define TLSF_SIZE_LOG2      12
+#endif
+
+#define TLSF_FL_COUNT       (TLSF_SIZE_LOG2 - TLSF_FL_SHIFT + 1)
+
+/* Low bit of the block size marks a free block */
+#define TLSF_FREE           1u
+
+#if defined(__GNUC__)
+#define TLSF_MEM_ALIGN      __attribute__((aligned(TLSF_ALIGN)))
+#else
+#define TLSF_MEM_ALIGN
+#endif
+
+#if defined(__GNUC__)
+#define TLSF_FFS(w)         ((int)__builtin_ctz(w))
+#define TLSF_FLS(w)         ((int)(sizeof(uint)*8 - 1) - (int)__builtin_clz(w))
+#else
+#define TLSF_FFS(w)         TlsfFfs(w)
+#define TLSF_FLS(w)         TlsfFls(w)
+#endif
+
+typedef struct TlsfBlock_T
+{
+    struct TlsfBlock_T  *pPrevPhys;
+    uint                uSize;
+    struct TlsfBlock_T  *pNextFree;
+    struct TlsfBlock_T  *pPrevFree;
+} TlsfBlock_T;
+
+/* The used zero size block ending the region has only the physical links */
+typedef struct
+{
+    struct TlsfBlock_T  *pPrevPhys;
+    uint                uSize;
+} TlsfHdr_T;
+
+/*
+ * Used blocks keep only the physical links, the payload starts after them
+ * rounded up to TLSF_ALIGN.  The free links start at pNextFree, in the
+ * payload or in the header padding, so a block is at least TLSF_MIN_SIZE.
+ */
+#define TLSF_HDR_SIZE\
+    (((uint)offsetof(TlsfBlock_T, pNextFree) + (TLSF_ALIGN - 1)) & ~(TLSF_ALIGN - 1))
+#define TLSF_MIN_SIZE\
+    ((uint)sizeof(TlsfBlock_T) > TLSF_HDR_SIZE + TLSF_ALIGN ?\
+        (uint)sizeof(TlsfBlock_T) - TLSF_HDR_SIZE : (uint)TLSF_ALIGN)
+
+#define TLSF_SIZE(b)        ((b)->uSize & ~TLSF_FREE)
+#define TLSF_NEXT(b)        ((TlsfBlock_T *)((uint8 *)(b) + TLSF_HDR_SIZE + TLSF_SIZE(b)))
+
+typedef struct
+{
+    uint                FlMap;
+    uint                SlMap[TLSF_FL_COUNT];
+    TlsfBlock_T         *pFree[TLSF_FL_COUNT][TLSF_SL_COUNT];
+} Tlsf_T;
+
+static Tlsf_T gTlsf;
+
+static uint8 gTlsfMem[UTASK_TLSF_SIZE] TLSF_MEM_ALIGN;
+
+#if !defined(__GNUC__)
+
+int
+TlsfFfs(
+    uint w
+    )
+{
+    int n = 0;
+
+    while ((w & 1) == 0)
+    {
+        w = w >> 1;
+        n = n + 1;
+    }
+
+    return n;
+}
+
+int
+TlsfFls(
+    uint w
+    )
+{
+    int n = -1;
+
+    while (w)
+    {
+        w = w >> 1;
+        n = n + 1;
+    }
+
+    return n;
+}
+
+#endif
+
+void
+TlsfMapping(
+    uint uSize,
+    int *pFl,
+    int *pSl
+    )
+{
+    int Fl;
+
+    if (uSize < TLSF_SMALL_SIZE)
+    {
+        /* Small blocks are spread linearly over the first list */
+        *pFl = 0;
+        *pSl = (int)(uSize / (TLSF_SMALL_SIZE / TLSF_SL_COUNT));
+    }
+    else
+    {
+        Fl = TLSF_FLS(uSize);
+        *pSl = (int)(uSize >> (Fl - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+        *pFl = Fl - (TLSF_FL_SHIFT - 1);
+    }
+}
+
+void
+TlsfInsert(
+    TlsfBlock_T *pBlock
+    )
+{
+    int Fl;
+    int Sl;
+
+    TlsfMapping(TLSF_SIZE(pBlock), &Fl, &Sl);
+
+    /* Add to the head of its list and mark the list non-empty */
+    pBlock->pPrevFree = NULL;
+    pBlock->pNextFree = gTlsf.pFree[Fl][Sl];
+
+    if (pBlock->pNextFree)
+    {
+        pBlock->pNextFree->pPrevFree = pBlock;
+    }
+
+    gTlsf.pFree[Fl][Sl] = pBlock;
+    gTlsf.FlMap = gTlsf.FlMap | (1u << Fl);
+    gTlsf.SlMap[Fl] = gTlsf.SlMap[Fl] | (1u << Sl);
+    pBlock->uSize = pBlock->uSize | TLSF_FREE;
+}
+
+void
+TlsfRemove(
+    TlsfBlock_T *pBlock
+    )
+{
+    int Fl;
+    int Sl;
+
+    TlsfMapping(TLSF_SIZE(pBlock), &Fl, &Sl);
+
+    if (pBlock->pNextFree)
+    {
+        pBlock->pNextFree->pPrevFree = pBlock->pPrevFree;
+    }
+
+    if (pBlock->pPrevFree)
+    {
+        pBlock->pPrevFree->pNextFree = pBlock->pNextFree;
+    }
+    else
+    {
+        /* Was the head of its list, clear the bitmaps if now empty */
+        gTlsf.pFree[Fl][Sl] = pBlock->pNextFree;
+
+        if (gTlsf.pFree[Fl][Sl] == NULL)
+        {
+            gTlsf.SlMap[Fl] = gTlsf.SlMap[Fl] & ~(1u << Sl);
+
+            if (gTlsf.SlMap[Fl] == 0)
+            {
+                gTlsf.FlMap = gTlsf.FlMap & ~(1u << Fl);
+            }
+        }
+    }
+
+    pBlock->uSize = pBlock->uSize & ~TLSF_FREE;
+}
+
+void
+TlsfInit(
+    void
+    )
+{
+    TlsfBlock_T *pBlock;
+    TlsfHdr_T *pEnd;
+
+    DBG_MSG(DBG_TRACE, "%s\n", __FUNCTION__);
+
+    memset(&gTlsf, 0, sizeof(gTlsf));
+
+    /* One free block spanning the region, ended by a used zero size block */
+    pBlock = (TlsfBlock_T *)gTlsfMem;
+    pBlock->pPrevPhys = NULL;
+    pBlock->uSize = (UTASK_TLSF_SIZE - 2 * TLSF_HDR_SIZE) & ~(TLSF_ALIGN - 1);
+
+    /* Only its header fits at the end of the region */
+    pEnd = (TlsfHdr_T *)TLSF_NEXT(pBlock);
+    pEnd->pPrevPhys = pBlock;
+    pEnd->uSize = 0;
+
+    TlsfInsert(pBlock);
+}
+
+void *
+TlsfAlloc(
+    uint uSize
+    )
+{
+    int Fl;
+    int Sl;
+    uint uMap;
+    uint uSearch;
+    TlsfBlock_T *pBlock;
+    TlsfBlock_T *pRest;
+
+    if (uSize == 0 || uSize > UTASK_TLSF_SIZE)
+    {
+        return NULL;
+    }
+
+    uSize = (uSize + (TLSF_ALIGN - 1)) & ~(TLSF_ALIGN - 1);
+
+    if (uSize < TLSF_MIN_SIZE)
+    {
+        uSize = TLSF_MIN_SIZE;
+    }
+
+    /* Round up to the next list so any block found is large enough */
+    uSearch = uSize;
+
+    if (uSearch >= TLSF_SMALL_SIZE)
+    {
+        uSearch = uSearch + (1u << (TLSF_FLS(uSearch) - TLSF_SL_LOG2)) - 1;
+    }
+
+    TlsfMapping(uSearch, &Fl, &Sl);
+
+    if (Fl >= TLSF_FL_COUNT)
+    {
+        return NULL;
+    }
+
+    /* A list in this first level, else the smallest larger first level */
+    uMap = gTlsf.SlMap[Fl] & (~0u << Sl);
+
+    if (uMap == 0)
+    {
+        uMap = (Fl + 1 < TLSF_FL_COUNT) ? gTlsf.FlMap & (~0u << (Fl + 1)) : 0;
+
+        if (uMap == 0)
+        {
+            DBG_MSG(DBG_ERROR, "Tlsf exhaustion\n");
+            return NULL;
+        }
+
+        Fl = TLSF_FFS(uMap);
+        uMap = gTlsf.SlMap[Fl];
+    }
+
+    Sl = TLSF_FFS(uMap);
+    pBlock = gTlsf.pFree[Fl][Sl];
+
+    TlsfRemove(pBlock);
+
+    /* Split off the tail if it can hold a block of its own */
+    if (pBlock->uSize >= uSize + TLSF_HDR_SIZE + TLSF_MIN_SIZE)
+    {
+        pRest = (TlsfBlock_T *)((uint8 *)pBlock + TLSF_HDR_SIZE + uSize);
+        pRest->uSize = pBlock->uSize - uSize - TLSF_HDR_SIZE;
+        pRest->pPrevPhys = pBlock;
+        TLSF_NEXT(pRest)->pPrevPhys = pRest;
+        pBlock->uSize = uSize;
+
+        TlsfInsert(pRest);
+    }
+
+    return (uint8 *)pBlock + TLSF_HDR_SIZE;
+}
+
+void
+TlsfFree(
+    void *pMem
+    )
+{
+    TlsfBlock_T *pBlock;
+    TlsfBlock_T *pNear;
+
+    pBlock = (TlsfBlock_T *)((uint8 *)pMem - TLSF_HDR_SIZE);
+
+    if (pBlock->uSize & TLSF_FREE)
+    {
+        DBG_MSG(DBG_WARN, "Tlsf block %p double free\n", pMem);
+        return;
+    }
+
+    /* Merge with the previous block if it is free */
+    pNear = pBlock->pPrevPhys;
+
+    if (pNear && (pNear->uSize & TLSF_FREE))
+    {
+        TlsfRemove(pNear);
+        pNear->uSize = pNear->uSize + TLSF_HDR_SIZE + pBlock->uSize;
+        pBlock = pNear;
+        TLSF_NEXT(pBlock)->pPrevPhys = pBlock;
+    }
+
+    /* Merge with the next block if it is free */
+    pNear = TLSF_NEXT(pBlock);
+
+    if (pNear->uSize & TLSF_FREE)
+    {
+        TlsfRemove(pNear);
+        pBlock->uSize = pBlock->uSize + TLSF_HDR_SIZE + pNear->uSize;
+        TLSF_NEXT(pBlock)->pPrevPhys = pBlock;
+    }
+
+    TlsfInsert(pBlock);
+}
+
+int
+TlsfFind(
+    void *pMem
+    )
+{
+    return (uint8 *)pMem >= gTlsfMem && (uint8 *)pMem < gTlsfMem + UTASK_TLSF_SIZE;
+}
+
+#else
+
+void
+TlsfInit(
+    void
+    )
+{
+}
+
+void *
+TlsfAlloc(
+    uint uSize
+    )
+{
+    (void)uSize;
+    return NULL;
+}
+
+void
+TlsfFree(
+    void *pMem
+    )
+{
+    (void)pMem;
+}
+
+int
+TlsfFind(
+    void *pMem
+    )
+{
+    (void)pMem;
+    return 0;
+}
+
+#endif
+
+/******************************************************************************/
+
+#if UTASK_CALL_SLOTS
+
+#if UTASK_CALL_SLOTS > 0xFFFF
+#error UTASK_CALL_SLOTS must be at most 65535
+#endif
+
+/* A handle holds the slot index in the low 16 bits and a generation above */
+#define CALL_INDEX(h)       ((h) & 0xFFFF)
+#define CALL_GEN_MAX        0x7FFF
+
+/*
+ * A task pinned on its own strand keeps its Affinity in the task, not the
+ * strand, so a slot for it keeps its own strand and the Affinity, the
+ * worker runs one handler at a time.  Otherwise the slot joins the strand.
+ */
+#define CALL_STRAND(t)\
+    ((t)->pStrand || EXEC_HOME((t)->Affinity) < 0 ? EXEC_STRAND(t) : NULL)
+
+typedef struct
+{
+    uTask_T             Req;        /* Delivers the request, must be first */
+    uTask_T             Rsp;        /* Delivers the reply or the timeout */
+    int                 Handle;     /* 0 while the slot is free */
+    int                 Next;       /* Next free slot, -1 for none */
+    unsigned short      Gen;
+    unsigned short      Replied;    /* A reply is on its way */
+    uTask_T             *pTarget;
+    int                 Id;
+    uTask_T             *pReplyTask;
+    int                 ReplyId;
+    uTaskCore_T         *pCore;     /* Instance whose queue holds pTimer */
+    Tcb_T               *pTimer;    /* Timeout, NULL if there is none */
+} CallSlot_T;
+
+static CallSlot_T gCall[UTASK_CALL_SLOTS];
+static int gCallFree;
+
+/* Handle of the call the running handler was given */
+static UTASK_THREAD_LOCAL int gCallCurrent;
+
+int
+uTaskCall(
+    IN uTask_T          *pTarget,
+    IN int              Id,
+    IN void             *pReq,
+    IN uTask_T          *pReplyTask,
+    IN int              ReplyId,
+    IN unsigned long    Timeout
+    )
+{
+    uTaskCore_T *pCore = CoreSelf();
+    CallSlot_T *pSlot = NULL;
+    Tcb_T *pTimer = NULL;
+    int PrevState;
+    int Index;
+    int Handle;
+
+    if (!pTarget || !pTarget->Handler || !pReplyTask || !pReplyTask->Handler)
+    {
+        return UTASK_E_FAIL;
+    }
+
+    PrevState = uTaskInterruptDisable();
+
+    Index = gCallFree;
+
+    if (Index >= 0)
+    {
+        pSlot = &gCall[Index];
+        gCallFree = pSlot->Next;
+
+        /* A new generation makes answers to the last call stale */
+        pSlot->Gen = (unsigned short)(pSlot->Gen % CALL_GEN_MAX + 1);
+        pSlot->Handle = ((int)pSlot->Gen << 16) | Index;
+        pSlot->Replied = 0;
+    }
+
+    uTaskInterruptRestore(PrevState);
+
+    if (Index < 0)
+    {
+        DBG_MSG(DBG_ERROR, "Call slot exhaustion\n");
+        return UTASK_E_FAIL;
+    }
+
+    Handle = pSlot->Handle;
+
+    pSlot->pTarget      = pTarget;
+    pSlot->Id           = Id;
+    pSlot->pReplyTask   = pReplyTask;
+    pSlot->ReplyId      = ReplyId;
+    pSlot->pCore        = pCore;
+
+#if UTASK_EXEC_WORKERS
+    /* Answer and request run on the strands and workers of the real tasks */
+    pSlot->Req.Affinity = EXEC_AFFINITY(pTarget);
+    pSlot->Rsp.Affinity = EXEC_AFFINITY(pReplyTask);
+    pSlot->Req.pStrand = CALL_STRAND(pTarget);
+    pSlot->Rsp.pStrand = CALL_STRAND(pReplyTask);
+#endif
+
+    /* The timer is a tcb of our own so a reply can unlink it directly */
+    if (Timeout)
+    {
+        pTimer = TcbAlloc(pCore);
+
+        if (pTimer == NULL)
+        {
+            DBG_MSG(DBG_ERROR, "Tcb exhaustion\n");
+            CallFree(Index);
+            return UTASK_E_FAIL;
+        }
+
+        pTimer->Flags   = TCB_FLAGS_APP;
+        pTimer->pTask   = &pSlot->Rsp;
+        pTimer->Id      = -Handle;
+        pTimer->pMsg    = NULL;
+        pTimer->Expire  = Timeout + uTaskCoreGetTick(pCore);
+
+        TcbEnqueue(pCore, pTimer);
+    }
+
+    pSlot->pTimer = pTimer;
+
+    if (uTaskMessageSend(&pSlot->Req, Handle, pReq, UTASK_IMMEDIATE) !=
+        UTASK_S_OK)
+    {
+        if (pTimer)
+        {
+            TcbRemove(pCore, pTimer);
+            TcbFree(pCore, pTimer);
+        }
+        CallFree(Index);
+        return UTASK_E_FAIL;
+    }
+
+    return Handle;
+}
+
+int
+uTaskReply(
+    IN int              Call,
+    IN void             *pReply
+    )
+{
+    int Index = CALL_INDEX(Call);
+    int PrevState;
+    int Status;
+    int Live;
+
+    if (pReply == NULL || Call <= 0 || Index >= UTASK_CALL_SLOTS)
+    {
+        return UTASK_E_FAIL;
+    }
+
+    /* Only the first reply is sent, even before it has been delivered */
+    PrevState = uTaskInterruptDisable();
+    Live = (gCall[Index].Handle == Call && !gCall[Index].Replied);
+    if (Live)
+    {
+        gCall[Index].Replied = 1;
+    }
+    uTaskInterruptRestore(PrevState);
+
+    /* Answered or timed out, CallRsp also drops a reply that loses a race */
+    if (!Live)
+    {
+        return UTASK_E_FAIL;
+    }
+
+    Status = uTaskMessageSend(&gCall[Index].Rsp, Call, pReply, UTASK_IMMEDIATE);
+
+    /* Without a tcb the call can still be answered */
+    if (Status != UTASK_S_OK)
+    {
+        PrevState = uTaskInterruptDisable();
+        if (gCall[Index].Handle == Call)
+        {
+            gCall[Index].Replied = 0;
+        }
+        uTaskInterruptRestore(PrevState);
+    }
+
+    return Status;
+}
+
+int
+uTaskCallCurrent(
+    void
+    )
+{
+    return gCallCurrent;
+}
+
+void
+CallInit(
+    void
+    )
+{
+    int i;
+
+    for (i = 0; i < UTASK_CALL_SLOTS; i = i + 1)
+    {
+        memset(&gCall[i], 0, sizeof(gCall[i]));
+
+        gCall[i].Req.Handler = CallReq;
+        gCall[i].Rsp.Handler = CallRsp;
+        gCall[i].Next = i + 1;
+    }
+
+    gCall[UTASK_CALL_SLOTS-1].Next = -1;
+    gCallFree = 0;
+}
+
+void
+CallFree(
+    IN int Index
+    )
+{
+    int PrevState = uTaskInterruptDisable();
+
+    gCall[Index].Handle = 0;
+    gCall[Index].Next = gCallFree;
+    gCallFree = Index;
+
+    uTaskInterruptRestore(PrevState);
+}
+
+/* Deliver a request to the target, unless the call is over */
+void
+CallReq(
+    IN uTask_T *pTask,
+    IN int Id,
+    IN void *pMsg
+    )
+{
+    CallSlot_T *pSlot = (CallSlot_T *)pTask;
+    uTask_T *pTarget = NULL;
+    int TargetId = 0;
+    int PrevState;
+    int Prev;
+
+    PrevState = uTaskInterruptDisable();
+
+    if (pSlot->Handle == Id)
+    {
+        pTarget = pSlot->pTarget;
+        TargetId = pSlot->Id;
+    }
+
+    uTaskInterruptRestore(PrevState);
+
+    /* The call timed out before its request was due */
+    if (pTarget == NULL)
+    {
+        DBG_MSG(DBG_WARN, "Stale call request %x\n", Id);
+        return;
+    }
+
+    Prev = gCallCurrent;
+    gCallCurrent = Id;
+
+    pTarget->Handler(pTarget, TargetId, pMsg);
+
+    gCallCurrent = Prev;
+}
+
+/*
+ * Deliver the first answer of a call, Id is the handle for a reply and the
+ * negated handle for the timeout.  Later answers find the slot moved on.
+ */
+void
+CallRsp(
+    IN uTask_T *pTask,
+    IN int Id,
+    IN void *pMsg
+    )
+{
+    CallSlot_T *pSlot =
+        (CallSlot_T *)((uint8 *)pTask - offsetof(CallSlot_T, Rsp));
+    uTask_T *pReplyTask = NULL;
+    uTaskCore_T *pCore = NULL;
+    Tcb_T *pTimer = NULL;
+    int ReplyId = 0;
+    int Handle;
+    int PrevState;
+    int Prev;
+
+    PrevState = uTaskInterruptDisable();
+
+    Handle = pSlot->Handle;
+
+    if (Handle && (Id == Handle || Id == -Handle))
+    {
+        pReplyTask = pSlot->pReplyTask;
+        ReplyId = pSlot->ReplyId;
+
+        /* The timeout is being delivered, a reply still has it queued */
+        if (Id == Handle)
+        {
+            pTimer = pSlot->pTimer;
+            pCore = pSlot->pCore;
+        }
+
+        pSlot->Handle = 0;
+        pSlot->Next = gCallFree;
+        gCallFree = (int)(pSlot - gCall);
+    }
+
+    uTaskInterruptRestore(PrevState);
+
+    if (pReplyTask == NULL)
+    {
+        DBG_MSG(DBG_WARN, "Stale call answer %x\n", Id);
+        return;
+    }
+
+    /* Cancel the timeout in place, one left queued expires as stale */
+    if (pTimer)
+    {
+        TcbCancel(pCore, pTimer);
+    }
+
+    Prev = gCallCurrent;
+    gCallCurrent = Handle;
+
+    pReplyTask->Handler(pReplyTask, ReplyId, pMsg);
+
+    gCallCurrent = Prev;
+}
+
+#else
+
+void
+CallInit(
+    void
+    )
+{
+}
+
+#endif
+
+/******************************************************************************/
+
+#if UTASK_CHAN_USE
+
+void
+uTaskChanInit(
+    OUT uTaskChan_T     *pChan,
+    IN void             *pBuf,
+    IN int              ItemSize,
+    IN int              Count,
+    IN uTask_T          *pTask,
+    IN int              Id
+    )
+{
+    memset(pChan, 0, sizeof(*pChan));
+
+    pChan->pBuf     = pBuf;
+    pChan->uItem    = (uint)ItemSize;
+    pChan->uCount   = (uint)Count;
+    pChan->pTask    = pTask;
+    pChan->Id       = Id;
+}
+
+int
+uTaskChanSend(
+    IN uTaskChan_T      *pChan,
+    IN const void       *pItem
+    )
+{
+    uint uTail;
+    int Wake = 0;
+    int PrevState;
+
+    PrevState = uTaskInterruptDisable();
+
+    if (pChan->uUsed == pChan->uCount)
+    {
+        uTaskInterruptRestore(PrevState);
+        return UTASK_E_FAIL;
+    }
+
+    uTail = pChan->uHead + pChan->uUsed;
+
+    if (uTail >= pChan->uCount)
+    {
+        uTail = uTail - pChan->uCount;
+    }
+
+    memcpy(pChan->pBuf + uTail * pChan->uItem, pItem, pChan->uItem);
+
+    pChan->uUsed = pChan->uUsed + 1;
+
+    /* One message per batch, the reader rearms it once it reads empty */
+    if (!pChan->Notify)
+    {
+        pChan->Notify = 1;
+        Wake = 1;
+    }
+
+    uTaskInterruptRestore(PrevState);
+
+    if (Wake)
+    {
+        if (uTaskMessageSend(pChan->pTask, pChan->Id, pChan, UTASK_IMMEDIATE) !=
+            UTASK_S_OK)
+        {
+            /* Let the next send try again, the item stays queued */
+            PrevState = uTaskInterruptDisable();
+            pChan->Notify = 0;
+            uTaskInterruptRestore(PrevState);
+        }
+    }
+
+    return UTASK_S_OK;
+}
+
+int
+uTaskChanRecv(
+    IN uTaskChan_T      *pChan,
+    OUT void            *pItem
+    )
+{
+    int PrevState = uTaskInterruptDisable();
+
+    if (pChan->uUsed == 0)
+    {
+        /* Empty, the next send sends a new message */
+        pChan->Notify = 0;
+
+        uTaskInterruptRestore(PrevState);
+        return UTASK_E_FAIL;
+    }
+
+    memcpy(pItem, pChan->pBuf + pChan->uHead * pChan->uItem, pChan->uItem);
+
+    pChan->uHead = pChan->uHead + 1;
+
+    if (pChan->uHead == pChan->uCount)
+    {
+        pChan->uHead = 0;
+    }
+
+    pChan->uUsed = pChan->uUsed - 1;
+
+    uTaskInterruptRestore(PrevState);
+
+    return UTASK_S_OK;
+}
+
+int
+uTaskChanCount(
+    IN uTaskChan_T      *pChan
+    )
+{
+    int Count;
+    int PrevState = uTaskInterruptDisable();
+
+    Count = (int)pChan->uUsed;
+
+    uTaskInterruptRestore(PrevState);
+
+    return Count;
+}
+
+#endif
+
+/******************************************************************************/
+
+#if UTASK_TOPIC_USE
+
+#if !UTASK_POOL_REFCOUNT
+#error UTASK_TOPIC_USE requires UTASK_POOL_REFCOUNT
+#endif
+
+void
+uTaskTopicInit(
+    OUT uTaskTopic_T    *pTopic
+    )
+{
+    pTopic->pHead = NULL;
+    pTopic->Count = 0;
+}
+
+int
+uTaskSubscribe(
+    IN OUT uTaskTopic_T *pTopic,
+    OUT uTaskSub_T      *pSub,
+    IN uTask_T          *pTask,
+    IN int              Id
+    )
+{
+    uTaskSub_T **ppEntry;
+
+    if (pTask == NULL || pTask->Handler == NULL)
+    {
+        return UTASK_E_FAIL;
+    }
+
+    /* Append, so subscribers are sent to in the order they subscribed */
+    for (ppEntry = &pTopic->pHead; *ppEntry; ppEntry = &(*ppEntry)->pNext)
+    {
+        if (*ppEntry == pSub)
+        {
+            return UTASK_E_FAIL;
+        }
+    }
+
+    pSub->pNext = NULL;
+    pSub->pTask = pTask;
+    pSub->Id    = Id;
+
+    *ppEntry = pSub;
+    pTopic->Count = pTopic->Count + 1;
+
+    return UTASK_S_OK;
+}
+
+int
+uTaskUnsubscribe(
+    IN OUT uTaskTopic_T *pTopic,
+    IN uTaskSub_T       *pSub
+    )
+{
+    uTaskSub_T **ppEntry;
+
+    for (ppEntry = &pTopic->pHead; *ppEntry; ppEntry = &(*ppEntry)->pNext)
+    {
+        if (*ppEntry == pSub)
+        {
+            *ppEntry = pSub->pNext;
+            pSub->pNext = NULL;
+            pTopic->Count = pTopic->Count - 1;
+            return UTASK_S_OK;
+        }
+    }
+
+    return UTASK_E_FAIL;
+}
+
+int
+uTaskPublish(
+    IN uTaskTopic_T     *pTopic,
+    IN void             *pMsg,
+    IN unsigned long    Time
+    )
+{
+    uTaskCore_T *pCore = CoreSelf();
+    uTaskSub_T *pSub;
+    Tcb_T *pFirst = NULL;
+    Tcb_T *pLast = NULL;
+    Tcb_T *pTcb;
+    unsigned long Expire;
+    int Count = pTopic->Count;
+    int Direct = 1;
+    int Sent = 0;
+    int i;
+
+    /* One reference per subscriber, the caller's reference is the first */
+    for (i = 1; i < Count; i = i + 1)
+    {
+        if (uTaskMsgRetain(pMsg) != UTASK_S_OK)
+        {
+            /* Undo the references taken so far */
+            for ( ; i > 1; i = i - 1)
+            {
+                uTaskFree(pMsg);
+            }
+            return 0;
+        }
+    }
+
+#if UTASK_INTAKE_SIZE
+    /* Other threads leave the tcb queue to the loop */
+    if (gpLoopCore != pCore)
+    {
+        Direct = 0;
+    }
+#endif
+#if UTASK_EXEC_WORKERS
+    /* A worker hands messages due now straight to the tasks */
+    if (Time == 0 && gExecSelf)
+    {
+        Direct = 0;
+    }
+#endif
+
+    Expire = Time + uTaskCoreGetTick(pCore);
+
+    for (pSub = pTopic->pHead; pSub; pSub = pSub->pNext)
+    {
+        if (!Direct)
+        {
+            if (uTaskCoreMessageSend(pCore, pSub->pTask, pSub->Id, pMsg, Time) ==
+                UTASK_S_OK)
+            {
+                Sent = Sent + 1;
+            }
+            continue;
+        }
+
+        pTcb = TcbAlloc(pCore);
+
+        if (pTcb == NULL)
+        {
+            DBG_MSG(DBG_ERROR, "Tcb exhaustion\n");
+            break;
+        }
+
+        pTcb->Flags     = TCB_FLAGS_APP;
+        pTcb->pTask     = pSub->pTask;
+        pTcb->Id        = pSub->Id;
+        pTcb->pMsg      = pMsg;
+        pTcb->Expire    = Expire;
+
+        /* Link the run in subscription order */
+        pTcb->pNext = NULL;
+        pTcb->pPrev = pLast;
+
+        if (pLast)
+        {
+            pLast->pNext = pTcb;
+        }
+        else
+        {
+            pFirst = pTcb;
+        }
+        pLast = pTcb;
+
+        Sent = Sent + 1;
+    }
+
+    /* The whole run enters the queue with one sorted insert */
+    if (pFirst)
+    {
+        TcbEnqueueRun(pCore, pFirst, pLast);
+    }
+
+    /* Drop the references of failed sends, keeping the caller's if none */
+    for (i = (Sent ? Sent : 1); i < Count; i = i + 1)
+    {
+        uTaskFree(pMsg);
+    }
+
+    return Sent;
+}
+
+#endif
+
+/******************************************************************************/
+
+#if UTASK_EVENT_USE
+
+#if defined(__GNUC__)
+#define EVENT_OR(p, m)      __atomic_fetch_or((p), (m), __ATOMIC_RELEASE)
+#define EVENT_AND(p, m)     __atomic_fetch_and((p), (m), __ATOMIC_RELEASE)
+#define EVENT_LOAD(p)       __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#else
+#define EVENT_OR(p, m)      EventOr((p), (m))
+#define EVENT_AND(p, m)     EventAnd((p), (m))
+#define EVENT_LOAD(p)       (*(volatile unsigned long *)(p))
+#endif
+
+/* Sequence numbers stay positive, they are sent as the timer's Id */
+#define EVENT_SEQ(n)        (((n) + 1) & 0x7FFFFFFF)
+
+void
+uTaskEventInit(
+    OUT uTaskEvent_T        *pEvent
+    )
+{
+    memset(pEvent, 0, sizeof(*pEvent));
+
+    pEvent->Check.Handler = EventIsr;
+}
+
+void
+uTaskEventSet(
+    IN uTaskEvent_T         *pEvent,
+    IN unsigned long        Mask
+    )
+{
+    EVENT_OR(&pEvent->Flags, Mask);
+
+    EventCheck(pEvent);
+}
+
+void
+uTaskEventSetIsr(
+    IN uTaskEvent_T         *pEvent,
+    IN unsigned long        Mask
+    )
+{
+    EVENT_OR(&pEvent->Flags, Mask);
+
+    /* One check message at a time, and none if nobody waits */
+    if (pEvent->pWait && !pEvent->Pending)
+    {
+        pEvent->Pending = 1;
+
+        if (uTaskMessageSendIsr(&pEvent->Check, 0, pEvent) != UTASK_S_OK)
+        {
+            /* The next set or wait checks the flags again */
+            pEvent->Pending = 0;
+        }
+    }
+}
+
+void
+uTaskEventClear(
+    IN uTaskEvent_T         *pEvent,
+    IN unsigned long        Mask
+    )
+{
+    EVENT_AND(&pEvent->Flags, ~Mask);
+}
+
+unsigned long
+uTaskEventGet(
+    IN uTaskEvent_T         *pEvent
+    )
+{
+    return EVENT_LOAD(&pEvent->Flags);
+}
+
+int
+uTaskEventWait(
+    IN uTaskEvent_T         *pEvent,
+    OUT uTaskEventWait_T    *pWait,
+    IN unsigned long        Mask,
+    IN int                  Mode,
+    IN uTask_T              *pTask,
+    IN int                  Id,
+    IN unsigned long        Timeout
+    )
+{
+    uTaskCore_T *pCore = CoreSelf();
+    uTaskEventWait_T **ppEntry;
+    Tcb_T *pTcb;
+    int Seq = EVENT_SEQ(pWait->Seq);
+    int PrevState;
+
+    if (Mask == 0 || pTask == NULL || pTask->Handler == NULL || pWait->pEvent)
+    {
+        return UTASK_E_FAIL;
+    }
+
+#if UTASK_EXEC_WORKERS
+    /* Workers deliver with a new message, the tcb is only the timer */
+    if (Timeout)
+#endif
+    {
+        pTcb = TcbAlloc(pCore);
+
+        if (pTcb == NULL)
+        {
+            DBG_MSG(DBG_ERROR, "Tcb exhaustion\n");
+            return UTASK_E_FAIL;
+        }
+    }
+
+    pWait->pNext            = NULL;
+    pWait->Timer.Handler    = EventTimeout;
+    pWait->pTask            = pTask;
+    pWait->Id               = Id;
+    pWait->Mask             = Mask;
+    pWait->Mode             = Mode;
+    pWait->Result           = 0;
+    pWait->Queued           = 0;
+    pWait->pTcb             = pTcb;
+    pWait->pCore            = pCore;
+
+#if UTASK_EXEC_WORKERS
+    /* The timeout runs on the strand of the waiting task */
+    pWait->Timer.pStrand = EXEC_STRAND(pTask);
+#endif
+
+    if (Timeout)
+    {
+        pTcb->Flags     = TCB_FLAGS_APP;
+        pTcb->pTask     = &pWait->Timer;
+        pTcb->Id        = Seq;
+        pTcb->pMsg      = pWait;
+        pTcb->Expire    = Timeout + uTaskCoreGetTick(pCore);
+
+        TcbEnqueue(pCore, pTcb);
+
+        pWait->Queued = 1;
+    }
+
+    PrevState = uTaskInterruptDisable();
+
+    for (ppEntry = &pEvent->pWait; *ppEntry; ppEntry = &(*ppEntry)->pNext)
+    {
+    }
+
+    /* Stale timers of earlier waits read the sequence on other workers */
+    *ppEntry = pWait;
+    pWait->pEvent = pEvent;
+    pWait->Seq = Seq;
+
+    uTaskInterruptRestore(PrevState);
+
+    /* The flags may satisfy the wait already */
+    EventCheck(pEvent);
+
+    return UTASK_S_OK;
+}
+
+int
+uTaskEventCancel(
+    IN uTaskEventWait_T     *pWait
+    )
+{
+    uTaskEventWait_T **ppEntry;
+    uTaskEvent_T *pEvent;
+    Tcb_T *pTcb;
+    int PrevState;
+
+    PrevState = uTaskInterruptDisable();
+
+    pEvent = pWait->pEvent;
+
+    if (pEvent)
+    {
+        for (ppEntry = &pEvent->pWait; *ppEntry != pWait;
+             ppEntry = &(*ppEntry)->pNext)
+        {
+        }
+
+        *ppEntry = pWait->pNext;
+        pWait->pNext = NULL;
+        pWait->pEvent = NULL;
+        pWait->Seq = EVENT_SEQ(pWait->Seq);
+    }
+
+    uTaskInterruptRestore(PrevState);
+
+    if (pEvent == NULL)
+    {
+        return UTASK_E_FAIL;
+    }
+
+    pTcb = pWait->pTcb;
+    pWait->pTcb = NULL;
+
+    /* A timer left queued expires as stale */
+    if (pTcb && pWait->Queued)
+    {
+        TcbCancel(pWait->pCore, pTcb);
+    }
+    else if (pTcb)
+    {
+        TcbFree(pWait->pCore, pTcb);
+    }
+
+    pWait->Queued = 0;
+
+    return UTASK_S_OK;
+}
+
+unsigned long
+uTaskEventResult(
+    IN uTaskEventWait_T     *pWait
+    )
+{
+    return pWait->Result;
+}
+
+/* End every wait the flags satisfy, in the order they waited */
+void
+EventCheck(
+    IN uTaskEvent_T *pEvent
+    )
+{
+    uTaskEventWait_T *pDone = NULL;
+    uTaskEventWait_T **ppDone = &pDone;
+    uTaskEventWait_T **ppEntry;
+    uTaskEventWait_T *pWait;
+    unsigned long Flags;
+    int Match;
+    int PrevState;
+
+    PrevState = uTaskInterruptDisable();
+
+    ppEntry = &pEvent->pWait;
+
+    while ((pWait = *ppEntry) != NULL)
+    {
+        Flags = EVENT_LOAD(&pEvent->Flags) & pWait->Mask;
+
+        if (pWait->Mode & UTASK_EVENT_ALL)
+        {
+            Match = (Flags == pWait->Mask);
+        }
+        else
+        {
+            Match = (Flags != 0);
+        }
+
+        if (!Match)
+        {
+            ppEntry = &pWait->pNext;
+            continue;
+        }
+
+        /* Move the wait to the done list, a queued timer is stale now */
+        *ppEntry = pWait->pNext;
+        pWait->pNext = NULL;
+        pWait->pEvent = NULL;
+        pWait->Result = Flags;
+        pWait->Seq = EVENT_SEQ(pWait->Seq);
+
+        *ppDone = pWait;
+        ppDone = &pWait->pNext;
+
+        /* Later waiters see the flags this wait consumed as clear */
+        if (pWait->Mode & UTASK_EVENT_CLEAR)
+        {
+            EVENT_AND(&pEvent->Flags, ~pWait->Mask);
+        }
+    }
+
+    uTaskInterruptRestore(PrevState);
+
+    while (pDone)
+    {
+        pWait = pDone;
+        pDone = pWait->pNext;
+        pWait->pNext = NULL;
+
+        EventEnd(pWait);
+    }
+}
+
+/* Send the one message of an ended wait */
+void
+EventEnd(
+    IN uTaskEventWait_T *pWait
+    )
+{
+    uTaskCore_T *pCore = pWait->pCore;
+    Tcb_T *pTcb = pWait->pTcb;
+
+    pWait->pTcb = NULL;
+
+#if UTASK_EXEC_WORKERS
+    /* Workers send a new message, a timer left queued expires as stale */
+    if (pWait->Queued)
+    {
+        TcbCancel(pCore, pTcb);
+    }
+
+    if (uTaskMessageSend(pWait->pTask, pWait->Id, pWait, UTASK_IMMEDIATE) !=
+        UTASK_S_OK)
+    {
+        DBG_MSG(DBG_ERROR, "Event wait %p lost\n", pWait);
+    }
+#else
+    /* The wait's own tcb carries the message, so this cannot fail */
+    if (pWait->Queued)
+    {
+        TcbRemove(pCore, pTcb);
+    }
+
+    pTcb->Flags     = TCB_FLAGS_APP;
+    pTcb->pTask     = pWait->pTask;
+    pTcb->Id        = pWait->Id;
+    pTcb->pMsg      = pWait;
+    pTcb->Expire    = uTaskCoreGetTick(pCore);
+
+    TcbEnqueue(pCore, pTcb);
+#endif
+
+    pWait->Queued = 0;
+}
+
+/* Check the waiters after flags were set from an isr */
+void
+EventIsr(
+    IN uTask_T *pTask,
+    IN int Id,
+    IN void *pMsg
+    )
+{
+    uTaskEvent_T *pEvent = (uTaskEvent_T *)pMsg;
+    int PrevState;
+
+    UNUSED_PARAM(pTask);
+    UNUSED_PARAM(Id);
+
+    PrevState = uTaskInterruptDisable();
+    pEvent->Pending = 0;
+    uTaskInterruptRestore(PrevState);
+
+    EventCheck(pEvent);
+}
+
+/* End a wait that timed out, unless it ended since the timer was armed */
+void
+EventTimeout(
+    IN uTask_T *pTask,
+    IN int Id,
+    IN void *pMsg
+    )
+{
+    uTaskEventWait_T *pWait = (uTaskEventWait_T *)pMsg;
+    uTaskEventWait_T **ppEntry;
+    uTaskEvent_T *pEvent;
+    int PrevState;
+
+    UNUSED_PARAM(pTask);
+
+    PrevState = uTaskInterruptDisable();
+
+    pEvent = pWait->pEvent;
+
+    if (pEvent && pWait->Seq == Id)
+    {
+        for (ppEntry = &pEvent->pWait; *ppEntry != pWait;
+             ppEntry = &(*ppEntry)->pNext)
+        {
+        }
+
+        *ppEntry = pWait->pNext;
+        pWait->pNext = NULL;
+        pWait->pEvent = NULL;
+        pWait->Result = 0;
+        pWait->Seq = EVENT_SEQ(pWait->Seq);
+
+        /* The loop frees the tcb after this returns */
+        pWait->pTcb = NULL;
+        pWait->Queued = 0;
+    }
+    else
+    {
+        pEvent = NULL;
+    }
+
+    uTaskInterruptRestore(PrevState);
+
+    if (pEvent == NULL)
+    {
+        DBG_MSG(DBG_WARN, "Stale event timeout %p\n", pWait);
+        return;
+    }
+
+    pWait->pTask->Handler(pWait->pTask, pWait->Id, pWait);
+}
+
+#if !defined(__GNUC__)
+
+unsigned long
+EventOr(
+    IN unsigned long *pFlags,
+    IN unsigned long Mask
+    )
+{
+    unsigned long Prev;
+    int PrevState = uTaskInterruptDisable();
+
+    Prev = *pFlags;
+    *pFlags = Prev | Mask;
+
+    uTaskInterruptRestore(PrevState);
+
+    return Prev;
+}
+
+unsigned long
+EventAnd(
+    IN unsigned long *pFlags,
+    IN unsigned long Mask
+    )
+{
+    unsigned long Prev;
+    int PrevState = uTaskInterruptDisable();
+
+    Prev = *pFlags;
+    *pFlags = Prev & Mask;
+
+    uTaskInterruptRestore(PrevState);
+
+    return Prev;
+}
+
+#endif
+
+#endif
+
+/******************************************************************************/
+
+#if UTASK_SEM_USE
+
+void
+uTaskSemInit(
+    OUT uTaskSem_T          *pSem,
+    IN int                  Count,
+    IN int                  Order
+    )
+{
+    pSem->Count = Count;
+    pSem->Order = Order;
+    pSem->pWait = NULL;
+}
 
-    /* Traverse the queue */
-    for (pEntry = gCore.pHead; pEntry; )
+int
+uTaskSemAcquire(
+    IN uTaskSem_T           *pSem,
+    OUT uTaskSemWait_T      *pWait,
+    IN uTask_T              *pTask,
+    IN int                  Id,
+    IN int                  Prio
+    )
+{
+    return SemTake(pSem, pWait, pTask, Id, Prio, NULL);
+}
+
+int
+uTaskSemTryAcquire(
+    IN uTaskSem_T           *pSem
+    )
+{
+    int Result = UTASK_E_FAIL;
+    int PrevState;
+
+    PrevState = uTaskInterruptDisable();
+
+    if (pSem->Count > 0)
     {
-        pTemp = pEntry;
-        pEntry = pEntry->pNext;
+        pSem->Count = pSem->Count - 1;
+        Result = UTASK_S_OK;
+    }
 
-        if (pTemp->pTask == pTask && pTemp->Id == Id)
+    uTaskInterruptRestore(PrevState);
+
+    return Result;
+}
+
+void
+uTaskSemRelease(
+    IN uTaskSem_T           *pSem
+    )
+{
+    uTaskSemWait_T *pWait = SemGive(pSem, NULL);
+
+    if (pWait)
+    {
+        SemGrant(pWait);
+    }
+}
+
+int
+uTaskSemCancel(
+    IN uTaskSemWait_T       *pWait
+    )
+{
+    uTaskSemWait_T **ppEntry;
+    uTaskSem_T *pSem;
+    Tcb_T *pTcb;
+    int PrevState;
+
+    PrevState = uTaskInterruptDisable();
+
+    pSem = pWait->pSem;
+
+    if (pSem)
+    {
+        for (ppEntry = &pSem->pWait; *ppEntry != pWait;
+             ppEntry = &(*ppEntry)->pNext)
         {
-            /* Count the number of cancelled items */
-            i = i + 1;
+        }
 
-            /* Entry found only one Tcb in queue */
-            if (pTemp == gCore.pHead && pTemp == gCore.pTail)
-            {
-                gCore.pHead = NULL;
-                gCore.pTail = NULL;
-            }
-            /* Entry found at head of the queue */
-            else if (pTemp == gCore.pHead)
-            {
-                gCore.pHead = gCore.pHead->pNext;
-                gCore.pHead->pPrev = NULL;
-            }
-            /* Entry found at tail of the queue */
-            else if (pTemp == gCore.pTail)
+        *ppEntry = pWait->pNext;
+        pWait->pNext = NULL;
+        pWait->pSem = NULL;
+    }
+
+    uTaskInterruptRestore(PrevState);
+
+    if (pSem == NULL)
+    {
+        return UTASK_E_FAIL;
+    }
+
+    pTcb = pWait->pTcb;
+    pWait->pTcb = NULL;
+
+#if UTASK_EXEC_WORKERS
+    /* A tcb of another worker goes back to its remote list */
+    TcbFree(CoreSelf(), pTcb);
+#else
+    TcbFree(pWait->pCore, pTcb);
+#endif
+
+    return UTASK_S_OK;
+}
+
+int
+uTaskSemCount(
+    IN uTaskSem_T           *pSem
+    )
+{
+    return pSem->Count;
+}
+
+void
+uTaskMutexInit(
+    OUT uTaskMutex_T        *pMutex,
+    IN int                  Order
+    )
+{
+    uTaskSemInit(&pMutex->Sem, 1, Order);
+
+    pMutex->pOwner = NULL;
+}
+
+int
+uTaskMutexLock(
+    IN uTaskMutex_T         *pMutex,
+    OUT uTaskSemWait_T      *pWait,
+    IN uTask_T              *pTask,
+    IN int                  Id,
+    IN int                  Prio
+    )
+{
+    return SemTake(&pMutex->Sem, pWait, pTask, Id, Prio, &pMutex->pOwner);
+}
+
+int
+uTaskMutexUnlock(
+    IN uTaskMutex_T         *pMutex,
+    IN uTask_T              *pTask
+    )
+{
+    uTaskSemWait_T *pWait;
+    int PrevState;
+
+    PrevState = uTaskInterruptDisable();
+
+    if (pTask == NULL || pMutex->pOwner != pTask)
+    {
+        uTaskInterruptRestore(PrevState);
+
+        DBG_MSG(DBG_WARN, "Mutex %p not owned by %p\n", pMutex, pTask);
+        return UTASK_E_FAIL;
+    }
+
+    pWait = SemGive(&pMutex->Sem, &pMutex->pOwner);
+
+    uTaskInterruptRestore(PrevState);
+
+    if (pWait)
+    {
+        SemGrant(pWait);
+    }
+
+    return UTASK_S_OK;
+}
+
+uTask_T *
+uTaskMutexOwner(
+    IN uTaskMutex_T         *pMutex
+    )
+{
+    return pMutex->pOwner;
+}
+
+/*
+ * Take a unit of pSem or queue pWait for one.  With ppOwner, pSem is a
+ * mutex: it fails for its owner and makes pTask the owner when it is free.
+ */
+int
+SemTake(
+    IN uTaskSem_T *pSem,
+    IN uTaskSemWait_T *pWait,
+    IN uTask_T *pTask,
+    IN int Id,
+    IN int Prio,
+    OUT uTask_T **ppOwner
+    )
+{
+    uTaskCore_T *pCore = CoreSelf();
+    uTaskSemWait_T **ppEntry;
+    Tcb_T *pTcb = NULL;
+    int Result = UTASK_E_FAIL;
+    int PrevState;
+
+    if (pWait == NULL || pTask == NULL || pTask->Handler == NULL)
+    {
+        return UTASK_E_FAIL;
+    }
+
+    PrevState = uTaskInterruptDisable();
+
+    if (pWait->pSem || (ppOwner && *ppOwner == pTask))
+    {
+        /* Already waiting, or locking a mutex twice */
+    }
+    /* Waiters are only queued while no unit is free */
+    else if (pSem->Count > 0)
+    {
+        pSem->Count = pSem->Count - 1;
+
+        if (ppOwner)
+        {
+            *ppOwner = pTask;
+        }
+
+        Result = UTASK_S_OK;
+    }
+    else
+    {
+        /* The grant's tcb, taken now so the release cannot run out */
+        pTcb = TcbAlloc(pCore);
+
+        if (pTcb == NULL)
+        {
+            uTaskInterruptRestore(PrevState);
+
+            DBG_MSG(DBG_ERROR, "Tcb exhaustion\n");
+            return UTASK_E_FAIL;
+        }
+
+        pWait->pNext    = NULL;
+        pWait->pSem     = pSem;
+        pWait->pTask    = pTask;
+        pWait->Id       = Id;
+        pWait->Prio     = Prio;
+        pWait->pTcb     = pTcb;
+        pWait->pCore    = pCore;
+
+        ppEntry = &pSem->pWait;
+
+        if (pSem->Order == UTASK_SEM_PRIO)
+        {
+            /* Behind every waiter of the same or a higher priority */
+            while (*ppEntry && (*ppEntry)->Prio >= Prio)
             {
-                gCore.pTail = gCore.pTail->pPrev;
-                gCore.pTail->pNext = NULL;
+                ppEntry = &(*ppEntry)->pNext;
             }
-            /* Entry found in the middle of the queue */
-            else
+        }
+        else
+        {
+            while (*ppEntry)
             {
-                pTemp->pNext->pPrev = pTemp->pPrev;
-                pTemp->pPrev->pNext = pTemp->pNext;
+                ppEntry = &(*ppEntry)->pNext;
             }
-
-            TcbFree(pTemp);
         }
+
+        pWait->pNext = *ppEntry;
+        *ppEntry = pWait;
+
+        Result = UTASK_SEM_QUEUED;
     }
 
-    return i;
+    uTaskInterruptRestore(PrevState);
+
+    return Result;
 }
 
-void *
-uTaskAlloc(
-    IN int              uSize
+/*
+ * Return a unit to pSem, or hand it to the first waiter which is returned.
+ * With ppOwner the waiter's task becomes the mutex owner, NULL if none.
+ */
+uTaskSemWait_T *
+SemGive(
+    IN uTaskSem_T *pSem,
+    OUT uTask_T **ppOwner
     )
 {
-    void *p;
+    uTaskSemWait_T *pWait;
+    int PrevState;
 
-    /* Disable interrupts, allowing pool allocs during isr execution */
-    int PrevState = uTaskInterruptDisable();
+    PrevState = uTaskInterruptDisable();
 
-    /* Allocate the pool block, note this is not your normal alloc */
-    p = PoolAlloc(uSize);
+    pWait = pSem->pWait;
+
+    if (pWait)
+    {
+        pSem->pWait = pWait->pNext;
+        pWait->pNext = NULL;
+        pWait->pSem = NULL;
+    }
+    else
+    {
+        pSem->Count = pSem->Count + 1;
+    }
+
+    if (ppOwner)
+    {
+        *ppOwner = pWait ? pWait->pTask : NULL;
+    }
 
-    /* Restore the interrupt state */
     uTaskInterruptRestore(PrevState);
 
-    return p;
+    return pWait;
 }
 
+/* Send the grant of a wait that was handed a unit */
 void
-uTaskFree(
-    IN void             *pMem
+SemGrant(
+    IN uTaskSemWait_T *pWait
     )
 {
-    /* Disable interrupts, allowing pool frees during isr execution */
-    int PrevState = uTaskInterruptDisable();
-   /* 
-    * Release the pool block, caution if in an isr pool over write 
-    * detection cannot print if executing in isr context.
-    */
-    PoolFree(pMem);
+    uTaskCore_T *pCore = pWait->pCore;
+    Tcb_T *pTcb = pWait->pTcb;
+
+    /* The wait's own tcb carries the grant, so this cannot fail */
+    pWait->pTcb = NULL;
+
+    pTcb->Flags     = TCB_FLAGS_APP;
+    pTcb->pTask     = pWait->pTask;
+    pTcb->Id        = pWait->Id;
+    pTcb->pMsg      = pWait;
+    pTcb->Expire    = uTaskCoreGetTick(pCore);
+
+#if UTASK_EXEC_WORKERS
+    /*
+     * A worker hands the grant to the strand of the waiting task, the tcb
+     * may belong to another worker, it goes back there when it is freed.
+     */
+    if (gExecSelf)
+    {
+        ExecReady(gExecSelf-1, pTcb);
+        return;
+    }
+#endif
 
-    /* Restore the interrupt state */
-    uTaskInterruptRestore(PrevState);
+    TcbEnqueue(pCore, pTcb);
 }
 
+#endif
+
 /******************************************************************************/
 
-void
-TcbInit(
-    void
+#if UTASK_HSM_DEPTH
+
+int
+uTaskHsmInit(
+    OUT uTaskHsm_T              *pHsm,
+    IN const uTaskHsmState_T    *pState,
+    IN int                      Count,
+    IN int                      Initial,
+    IN void                     *pCtx
     )
 {
+    const uTaskHsmRule_T *pRule;
+    int State;
+    int Depth;
     int i;
-    Tcb_T *p;
 
-    p = gCore.Tcb;
+    if (pState == NULL || Initial < 0 || Initial >= Count)
+    {
+        return UTASK_E_FAIL;
+    }
 
-    /* Create Tcb free list */
-    for (i = 0; i < COUNTOF(gCore.Tcb); i = i + 1)
+    /* Check the tables once, so transitions can trust them */
+    for (State = 0; State < Count; State = State + 1)
     {
-        TcbFree(p);
-        p = p + 1;
+        Depth = 0;
+
+        for (i = State; i != UTASK_HSM_NONE; i = pState[i].Parent)
+        {
+            if (i < 0 || i >= Count || Depth == UTASK_HSM_DEPTH)
+            {
+                DBG_MSG(DBG_ERROR, "Hsm state %d too deep\n", State);
+                return UTASK_E_FAIL;
+            }
+
+            Depth = Depth + 1;
+        }
+
+        if (pState[State].Init != UTASK_HSM_NONE &&
+            (pState[State].Init < 0 || pState[State].Init >= Count ||
+             pState[pState[State].Init].Parent != State))
+        {
+            DBG_MSG(DBG_ERROR, "Hsm state %d bad init\n", State);
+            return UTASK_E_FAIL;
+        }
+
+        for (i = 0; i < pState[State].RuleCount; i = i + 1)
+        {
+            pRule = &pState[State].pRule[i];
+
+            if (pRule->Next == UTASK_HSM_NONE)
+            {
+                continue;
+            }
+
+            if (pRule->Next < 0 || pRule->Next >= Count ||
+                !HsmEncloses(pState, pRule->Lca, State) ||
+                !HsmEncloses(pState, pRule->Lca, pRule->Next))
+            {
+                DBG_MSG(DBG_ERROR, "Hsm state %d bad rule %d\n", State, i);
+                return UTASK_E_FAIL;
+            }
+        }
     }
+
+    memset(&pHsm->Task, 0, sizeof(pHsm->Task));
+
+    pHsm->Task.Handler  = HsmDispatch;
+    pHsm->pState        = pState;
+    pHsm->Count         = Count;
+    pHsm->Current       = UTASK_HSM_NONE;
+    pHsm->pCtx          = pCtx;
+
+    HsmEnter(pHsm, UTASK_HSM_NONE, Initial);
+
+    return UTASK_S_OK;
 }
 
-Tcb_T *
-TcbAlloc(
-    void
+uTask_T *
+uTaskHsmTask(
+    IN uTaskHsm_T               *pHsm
     )
 {
-    Tcb_T *pTcb;
+    return &pHsm->Task;
+}
 
-    /* Remove item from head of free list */
-    pTcb = gCore.pFree;
-    gCore.pFree = gCore.pFree->pNext;
-    pTcb->pNext = NULL;
-    return pTcb;
+int
+uTaskHsmState(
+    IN uTaskHsm_T               *pHsm
+    )
+{
+    return pHsm->Current;
 }
 
-void
-TcbFree(
-    IN Tcb_T *pTcb
+int
+uTaskHsmIn(
+    IN uTaskHsm_T               *pHsm,
+    IN int                      State
     )
 {
-    /* Add item to head of free list */
-    pTcb->pNext = gCore.pFree;
-    gCore.pFree = pTcb;
-    pTcb->pPrev = NULL;
+    return State != UTASK_HSM_NONE &&
+           HsmEncloses(pHsm->pState, State, pHsm->Current);
 }
 
-/* Items enter at the tail head and leave at the head */
-Tcb_T *
-TcbFront(
-    void
+void *
+uTaskHsmContext(
+    IN uTaskHsm_T               *pHsm
     )
 {
-    /* Return item at head */
-    return gCore.pHead;
+    return pHsm->pCtx;
 }
 
-/* Add at head */
+/* Find the rule for Id from the innermost active state out and take it */
 void
-TcbEnqueue(
-    IN Tcb_T *pTcb
+HsmDispatch(
+    IN uTask_T *pTask,
+    IN int Id,
+    IN void *pMsg
     )
 {
-    Tcb_T *pEntry;
-
-    /* The queue is empty update head and tail */
-    if (gCore.pHead == NULL && gCore.pTail == NULL)
-    {
-        gCore.pHead = pTcb;
-        gCore.pTail = pTcb;
-        pTcb->pNext = NULL;
-        pTcb->pPrev = NULL;
-        return;
-    }
+    uTaskHsm_T *pHsm = (uTaskHsm_T *)pTask;
+    const uTaskHsmState_T *pState = pHsm->pState;
+    const uTaskHsmRule_T *pRule;
+    int State;
+    int i;
 
-    /* Traverse the queue */
-    for (pEntry = gCore.pHead; pEntry; pEntry = pEntry->pNext)
+    for (State = pHsm->Current; State != UTASK_HSM_NONE;
+         State = pState[State].Parent)
     {
-        /* Is the current pEntry after the new pTcb entry */
-        if (TIME_AFTER(pEntry->Expire, pTcb->Expire))
+        for (i = 0; i < pState[State].RuleCount; i = i + 1)
         {
-            /* Insert new pTcb entry before current pEntry */
-            if (pEntry->pPrev)
+            pRule = &pState[State].pRule[i];
+
+            if (pRule->Id != Id ||
+                (pRule->Action && pRule->Action(pHsm, Id, pMsg) != UTASK_S_OK))
             {
-                pEntry->pPrev->pNext = pTcb;
-                pTcb->pPrev = pEntry->pPrev;
-                pEntry->pPrev = pTcb;
-                pTcb->pNext = pEntry;
+                continue;
+            }
+
+            if (pRule->Next == UTASK_HSM_NONE)
+            {
+                return;
             }
-            else
+
+            /* Leave the active states below the common ancestor */
+            while (pHsm->Current != pRule->Lca)
             {
-                pEntry->pPrev = pTcb;
-                pTcb->pNext = pEntry;
-                pTcb->pPrev = NULL;
-                gCore.pHead = pTcb;
+                State = pHsm->Current;
+                pHsm->Current = pState[State].Parent;
+
+                if (pState[State].Exit)
+                {
+                    pState[State].Exit(pHsm);
+                }
             }
+
+            HsmEnter(pHsm, pRule->Lca, pRule->Next);
             return;
         }
     }
 
-    /* The queue end was found, insert at tail */
-    gCore.pTail->pNext = pTcb;
-    pTcb->pPrev = gCore.pTail;
-    gCore.pTail = pTcb;
-    pTcb->pNext = NULL;
-    return;
+    DBG_MSG(DBG_TRACE, "Hsm %p state %d drops %d\n", pHsm, pHsm->Current, Id);
 }
 
-/* Remove at tail */
-Tcb_T *
-TcbDequeue(
-    void
+/* Enter the states below From down to To, then the Init children of To */
+void
+HsmEnter(
+    IN uTaskHsm_T *pHsm,
+    IN int From,
+    IN int To
     )
 {
-    Tcb_T *pTcb;
+    const uTaskHsmState_T *pState = pHsm->pState;
+    short Path[UTASK_HSM_DEPTH];
+    int Count = 0;
+    int State;
 
-    /* Case 1, Head and Tail point to nothing */
-    if (gCore.pHead == NULL && gCore.pTail == NULL)
+    for (State = To; State != From; State = pState[State].Parent)
     {
-        pTcb = NULL;
+        Path[Count] = (short)State;
+        Count = Count + 1;
     }
 
-    /* Case 2, Head and Tail point to same element */
-    else if (gCore.pHead == gCore.pTail)
+    while (Count > 0)
     {
-        pTcb = gCore.pHead;
-        gCore.pHead = NULL;
-        gCore.pTail = NULL;
+        Count = Count - 1;
+        State = Path[Count];
+        pHsm->Current = State;
+
+        if (pState[State].Entry)
+        {
+            pState[State].Entry(pHsm);
+        }
     }
 
-    /* Case 3, Head and Tail point to different elements */
-    else
+    while (pState[pHsm->Current].Init != UTASK_HSM_NONE)
     {
-        pTcb = gCore.pHead;
-        gCore.pHead = gCore.pHead->pNext;
-        gCore.pHead->pPrev = NULL;
-    }
+        State = pState[pHsm->Current].Init;
+        pHsm->Current = State;
 
-    return pTcb;
+        if (pState[State].Entry)
+        {
+            pState[State].Entry(pHsm);
+        }
+    }
 }
 
-/******************************************************************************/
-
-/* If the sum of all block counts are zero we disable the pool */
-#if ((UTASK_POOL_COUNT1+UTASK_POOL_COUNT2+\
-      UTASK_POOL_COUNT3+UTASK_POOL_COUNT4) == 0)
-#undef UTASK_POOL_USE
-#endif
+/* Returns 1 if Outer is Inner or encloses it, UTASK_HSM_NONE encloses all */
+int
+HsmEncloses(
+    IN const uTaskHsmState_T *pState,
+    IN int Outer,
+    IN int Inner
+    )
+{
+    int State;
 
-#if UTASK_POOL_USE
+    for (State = Inner; State != UTASK_HSM_NONE; State = pState[State].Parent)
+    {
+        if (State == Outer)
+        {
+            return 1;
+        }
+    }
 
-#if UTASK_DEBUG && UTASK_POOL_DEBUG
+    return Outer == UTASK_HSM_NONE;
+}
 
-/*
- * For overwrite detection we increase the block size to include the
- * beginning signature, the actual size of the block and the end
- * signature.  The size of the block is needed because the caller could
- * request a block of 5 bytes, but the only block avaiable is a 64 byte
- * block.  If this happens we need the requested size to ensure the caller
- * is not writing passed the requested size, not just writing passed the
- * data avilable in the block.
- */
-#define UTASK_POOL_SIG_SIZE     (sizeof(uint16)+sizeof(uint16)+sizeof(uint))
-#define UTASK_POOL_SIG_BEG      0xDEAD
-#define UTASK_POOL_SIG_END      0xFFED
-#define UTASK_POOL_SIG_EMPTY    0xEE
+#endif
 
-#else
+/******************************************************************************/
 
-#define UTASK_POOL_SIG_SIZE     0
+#if UTASK_PORT_POSIX
 
+/* One more than the highest signal number, real time signals included */
+#if defined(_NSIG)
+#define PORT_SIGNALS        _NSIG
+#else
+#define PORT_SIGNALS        NSIG
 #endif
 
-#define UTASK_POOL_UP(n)\
-    ((((n)+(sizeof(PoolBlock_T) - 1)) & ~(sizeof(PoolBlock_T)-1))+UTASK_POOL_SIG_SIZE)
+static pthread_mutex_t gPortLock = PTHREAD_MUTEX_INITIALIZER;
+static UTASK_THREAD_LOCAL int gPortDepth;
+static pfuTaskIsr gPortIsr[PORT_SIGNALS];
+static pthread_t gPortThread;
+static int gPortTimer = -1;
+static int gPortSignal = -1;
+static int gPortStop = -1;
 
-typedef struct PoolBlock_T
+int
+uTaskInterruptDisable(
+    void
+    )
 {
-    struct PoolBlock_T  *pNext;
-} PoolBlock_T;
+    /* Only the outermost disable of this thread takes the lock */
+    if (gPortDepth == 0)
+    {
+        pthread_mutex_lock(&gPortLock);
+    }
 
-typedef struct
+    gPortDepth = gPortDepth + 1;
+
+    return gPortDepth - 1;
+}
+
+void
+uTaskInterruptRestore(
+    int PrevIntState
+    )
 {
-    uint                uCount;
-    uint                uSize;
-    void                *pBeg;
-    PoolBlock_T         *pHead;
-} PoolHead_T;
+    gPortDepth = PrevIntState;
 
-static uint8 gPoolMem
-[
-#if UTASK_POOL_COUNT1
-    (UTASK_POOL_COUNT1*UTASK_POOL_UP(UTASK_POOL_SIZE1)) +
-#endif
-#if UTASK_POOL_COUNT2
-    (UTASK_POOL_COUNT2*UTASK_POOL_UP(UTASK_POOL_SIZE2)) +
-#endif
-#if UTASK_POOL_COUNT4
-    (UTASK_POOL_COUNT3*UTASK_POOL_UP(UTASK_POOL_SIZE3)) +
-#endif
-#if UTASK_POOL_COUNT4
-    (UTASK_POOL_COUNT4*UTASK_POOL_UP(UTASK_POOL_SIZE4)) +
-#endif
-    0
-];
+    if (gPortDepth == 0)
+    {
+        pthread_mutex_unlock(&gPortLock);
+    }
+}
 
-static PoolHead_T gPool[] =
+int
+uTaskPortIsr(
+    IN int              Signo,
+    IN pfuTaskIsr       pIsr
+    )
 {
-#if UTASK_POOL_COUNT1
-    {UTASK_POOL_COUNT1, UTASK_POOL_SIZE1, NULL, NULL},
-#endif
-#if UTASK_POOL_COUNT2
-    {UTASK_POOL_COUNT2, UTASK_POOL_SIZE2, NULL, NULL},
-#endif
-#if UTASK_POOL_COUNT3
-    {UTASK_POOL_COUNT3, UTASK_POOL_SIZE3, NULL, NULL},
-#endif
-#if UTASK_POOL_COUNT4
-    {UTASK_POOL_COUNT4, UTASK_POOL_SIZE4, NULL, NULL},
-#endif
-};
+    if (Signo <= 0 || Signo >= PORT_SIGNALS || gPortThread)
+    {
+        return UTASK_E_FAIL;
+    }
 
-void
-PoolInit(
-    void
+    gPortIsr[Signo] = pIsr;
+
+    return UTASK_S_OK;
+}
+
+int
+uTaskPortStart(
+    IN unsigned long    TickUs
     )
 {
-    int i;
-    int j;
-    uint8 *p;
-    PoolHead_T Temp;
+    struct itimerspec Its;
+    sigset_t Set;
 
-    DBG_MSG(DBG_TRACE, "%s\n", __FUNCTION__);
+    DBG_MSG(DBG_TRACE, "%s %lu\n", __FUNCTION__, TickUs);
 
-    /* Sort the pool blocks into accending sizes */
-    for (i = COUNTOF(gPool) - 2; i >= 0; i = i - 1)
+#if UTASK_EXEC_WORKERS
+    /* Running workers could take the signals, they did not block them all */
+    if (__atomic_load_n(&gExecRunning, __ATOMIC_ACQUIRE))
     {
-        for (j = 0; j <= i; j = j + 1)
-        {
-            if (gPool[j].uSize > gPool[j+1].uSize)
-            {
-                Temp = gPool[j];
-                gPool[j] = gPool[j+1];
-                gPool[j+1] = Temp;
-            }
-        }
+        DBG_MSG(DBG_ERROR, "Port start with workers running\n");
+        return UTASK_E_FAIL;
     }
+#endif
 
-    /* Build the pool free blocks lists */
-    p = gPoolMem;
+    if (PortBlock(&Set) != UTASK_S_OK)
+    {
+        return UTASK_E_FAIL;
+    }
 
-    for (i = 0; i < COUNTOF(gPool); i = i + 1)
+    gPortSignal = signalfd(-1, &Set, SFD_CLOEXEC);
+    gPortStop = eventfd(0, EFD_CLOEXEC);
+
+    if (TickUs)
     {
-        if (gPool[i].uCount)
+        gPortTimer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+
+        if (gPortTimer >= 0)
         {
-            gPool[i].pBeg = p;
+            Its.it_interval.tv_sec  = TickUs / 1000000;
+            Its.it_interval.tv_nsec = (TickUs % 1000000) * 1000;
+            Its.it_value            = Its.it_interval;
 
-            for (j = 0; j < (int)gPool[i].uCount; j = j + 1)
+            if (timerfd_settime(gPortTimer, 0, &Its, NULL) != 0)
             {
-                ((PoolBlock_T *)p)->pNext = gPool[i].pHead;
-                gPool[i].pHead = (PoolBlock_T *)p;
-                p = p + UTASK_POOL_UP(gPool[i].uSize);
+                close(gPortTimer);
+                gPortTimer = -1;
             }
         }
     }
+
+    if (gPortSignal < 0 || gPortStop < 0 || (TickUs && gPortTimer < 0) ||
+        pthread_create(&gPortThread, NULL, PortThread, NULL) != 0)
+    {
+        DBG_MSG(DBG_ERROR, "Port start failed\n");
+        gPortThread = 0;
+        uTaskPortStop();
+        return UTASK_E_FAIL;
+    }
+
+    return UTASK_S_OK;
 }
 
-void *
-PoolAlloc(
-    uint uSize
+int
+uTaskPortRaise(
+    IN int              Signo
     )
 {
-    uint i;
-    void *p = NULL;
-
-    for (i = 0; i < COUNTOF(gPool); i = i + 1)
+    if (Signo <= 0 || Signo >= PORT_SIGNALS || gPortIsr[Signo] == NULL)
     {
-        if (uSize <= gPool[i].uSize)
-        {
-            if (gPool[i].pHead)
-            {
-                p = gPool[i].pHead;
-                gPool[i].pHead = gPool[i].pHead->pNext;
-
-#if UTASK_DEBUG && UTASK_POOL_DEBUG
-                /* Set the alloc size and beg and end signatures */
-                *(uint *)p = uSize;
-                *(uint16 *)((uint8 *)p+sizeof(uint)) = UTASK_POOL_SIG_BEG;
-                p = (uint8 *)p + sizeof(uint16) + sizeof(uint);
-                memset(p, UTASK_POOL_SIG_EMPTY, uSize);
-                *(uint16 *)((uint8 *)p + uSize) = UTASK_POOL_SIG_END;
-#endif
-            }
-            break;
-        }
+        return UTASK_E_FAIL;
     }
 
-    return p;
+    /* Process directed, the signalfd picks it up whatever thread raised it */
+    return kill(getpid(), Signo) == 0 ? UTASK_S_OK : UTASK_E_FAIL;
 }
 
 void
-PoolFree(
-    void *pMem
+uTaskPortStop(
+    void
     )
 {
-    uint8 *p = pMem;
-    uint i;
+    uint64_t One = 1;
 
-    /* Is this memory block in the pool */
-    if (p >= (uint8 *)gPoolMem &&
-        p <= ((uint8 *)gPoolMem + sizeof(gPoolMem)))
+    if (gPortThread)
     {
-        for (i = 0; i < COUNTOF(gPool); i = i + 1)
+        if (write(gPortStop, &One, sizeof(One)) == sizeof(One))
         {
-            if (p >= (uint8 *)gPool[i].pBeg &&
-                p <= ((uint8 *)gPool[i].pBeg + 
-                     (gPool[i].uCount * UTASK_POOL_UP(gPool[i].uSize))))
-            {
-#if UTASK_DEBUG && UTASK_POOL_DEBUG
-                uint uSize = *(uint *)((uint8 *)p - 
-                             (sizeof(uint) + sizeof(uint16)));
-
-                /* Validate the memory size */
-                if (uSize > gPool[i].uSize)
-                {
-                    /* Size overwrite */
-                    DBG_MSG(DBG_WARN, "Pool block %p size out of range\n", p);
-                }
-
-                if (*(uint16 *)((uint8 *)p - sizeof(uint16)) != UTASK_POOL_SIG_BEG)
-                {
-                    /* Beginning signature overwrite */
-                    DBG_MSG(DBG_WARN, "Pool block %p beg signature overwrite\n", p);
-                }
+            pthread_join(gPortThread, NULL);
+        }
+        gPortThread = 0;
+    }
 
-                if (*(uint16 *)((uint8 *)p + uSize) != UTASK_POOL_SIG_END)
-                {
-                    /* Ending signature overwrite */
-                    DBG_MSG(DBG_WARN, "Pool block %p end signature overwrite\n", p);
-                }
+    if (gPortTimer >= 0)
+    {
+        close(gPortTimer);
+        gPortTimer = -1;
+    }
 
-                p = (uint8 *)p - (sizeof(uint16) + sizeof(uint));
-#endif
-                ((PoolBlock_T *)p)->pNext = gPool[i].pHead;
-                gPool[i].pHead = (PoolBlock_T *)p;
+    if (gPortSignal >= 0)
+    {
+        close(gPortSignal);
+        gPortSignal = -1;
+    }
 
-                break;
-            }
-        }
+    if (gPortStop >= 0)
+    {
+        close(gPortStop);
+        gPortStop = -1;
     }
 }
 
-#else
-
-void
-PoolInit(
-    void
+/*
+ * Block the registered signals in this thread, they are only read from the
+ * signalfd and never delivered
+ */
+int
+PortBlock(
+    OUT sigset_t *pSet
     )
 {
+    int i;
+
+    sigemptyset(pSet);
+
+    for (i = 1; i < PORT_SIGNALS; i = i + 1)
+    {
+        if (gPortIsr[i])
+        {
+            sigaddset(pSet, i);
+        }
+    }
+
+    return pthread_sigmask(SIG_BLOCK, pSet, NULL) == 0 ?
+           UTASK_S_OK : UTASK_E_FAIL;
 }
 
+/* The interrupt thread, every isr runs with the port lock held */
 void *
-PoolAlloc(
-    uint uSize
+PortThread(
+    void *pArg
     )
 {
-    (void)uSize;
-    return NULL;
-}
+    struct signalfd_siginfo Info;
+    struct pollfd Fds[3];
+    uint64_t Count;
+    int PrevState;
 
-void
-PoolFree(
-    void *pMem
-    )
-{
-    (void)pMem;
+    UNUSED_PARAM(pArg);
+
+    Fds[0].fd = gPortStop;
+    Fds[1].fd = gPortSignal;
+    Fds[2].fd = gPortTimer;
+    Fds[0].events = Fds[1].events = Fds[2].events = POLLIN;
+
+    for ( ; ; )
+    {
+        if (poll(Fds, 3, -1) < 0)
+        {
+            continue;
+        }
+
+        if (Fds[0].revents)
+        {
+            break;
+        }
+
+        /* Ticks missed while the lock was held are all delivered */
+        if (Fds[2].revents &&
+            read(gPortTimer, &Count, sizeof(Count)) == sizeof(Count))
+        {
+            PrevState = uTaskInterruptDisable();
+
+            for ( ; Count; Count = Count - 1)
+            {
+                uTaskTick();
+            }
+
+            uTaskInterruptRestore(PrevState);
+        }
+
+        if (Fds[1].revents &&
+            read(gPortSignal, &Info, sizeof(Info)) == sizeof(Info) &&
+            Info.ssi_signo < PORT_SIGNALS && gPortIsr[Info.ssi_signo])
+        {
+            PrevState = uTaskInterruptDisable();
+            gPortIsr[Info.ssi_signo]((int)Info.ssi_signo);
+            uTaskInterruptRestore(PrevState);
+        }
+    }
+
+    return NULL;
 }
 
 #endif
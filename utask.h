@@ -80,8 +80,17 @@
 #ifndef UTASK_H
 #define UTASK_H
 
+/*
+ * Each setting below is only defined when it is not defined already, so a
+ * build can override it on the compiler command line, e.g.
+ * -DUTASK_TCB_SLOTS=64.  utask.c and every file including utask.h must be
+ * built with the same settings.
+ */
+
 /* Set this to a 1 to enable debug support */
+#ifndef UTASK_DEBUG
 #define UTASK_DEBUG             0
+#endif
 
 /*
  * A TCB is a task control block.  They are used by uTask to track and queue
@@ -89,17 +98,23 @@
  * the task queue.  If you plan on having a large number of outstanding task 
  * messages you should increase this number. 
  */
+#ifndef UTASK_TCB_SLOTS
 #define UTASK_TCB_SLOTS         32
+#endif
 
 /*
  * UTASK_ISR_QUEUE_SIZE is the number of outstanding ISR entries that can be
  * queued up.  ISR queue entries are added using the function
  * uTaskMessageSendISR from isr context.
  */
+#ifndef UTASK_ISR_QUEUE_SIZE
 #define UTASK_ISR_QUEUE_SIZE    8
+#endif
 
 /* Time macros */
+#ifndef UTASK_TICKS_PER_SEC
 #define UTASK_TICKS_PER_SEC     1000
+#endif
 #define UTASK_IMMEDIATE         0
 #define UTASK_SEC(s)            ((s)*UTASK_TICKS_PER_SEC)
 #define UTASK_MIN(m)            ((m)*60*UTASK_TICKS_PER_SEC)
@@ -120,33 +135,262 @@
  * Set to 1 to use the memory pool, set to 0 to exclude memory
  * pool code.
  */
+#ifndef UTASK_POOL_USE
 #define UTASK_POOL_USE          1
+#endif
 
 /*
  * Set to 1 to make the memory pool safe to use in isr context,
  * set to 0 to only use memory pool code in task context
  */
+#ifndef UTASK_POLL_ISR_SAFE
 #define UTASK_POLL_ISR_SAFE     1
+#endif
 
 /*
  * Set to 1 to enabled pool block head and tail checking.  It will
  * display debug message if memory block was under or overwritten.
  */
+#ifndef UTASK_POOL_DEBUG
 #define UTASK_POOL_DEBUG        1
+#endif
 
 /*
  * Set memory pool count and size of each fixed pool.  Note the size order
  * is not a requirement, the code will sort memory pools into size order
  * to aid in lookup efficiency.
  */
+#ifndef UTASK_POOL_COUNT1
 #define UTASK_POOL_COUNT1       16
+#endif
+#ifndef UTASK_POOL_SIZE1
 #define UTASK_POOL_SIZE1        8
+#endif
+#ifndef UTASK_POOL_COUNT2
 #define UTASK_POOL_COUNT2       8
+#endif
+#ifndef UTASK_POOL_SIZE2
 #define UTASK_POOL_SIZE2        16
+#endif
+#ifndef UTASK_POOL_COUNT3
 #define UTASK_POOL_COUNT3       4
+#endif
+#ifndef UTASK_POOL_SIZE3
 #define UTASK_POOL_SIZE3        32
+#endif
+#ifndef UTASK_POOL_COUNT4
 #define UTASK_POOL_COUNT4       2
+#endif
+#ifndef UTASK_POOL_SIZE4
 #define UTASK_POOL_SIZE4        64
+#endif
+
+/*
+ * Number of blocks in each pool held back for uTaskAllocIsr.  Once a pool is
+ * down to its reserve uTaskAlloc fails for that pool, so a busy task cannot
+ * starve an interrupt handler of blocks.
+ */
+#ifndef UTASK_POOL_RESERVE1
+#define UTASK_POOL_RESERVE1     0
+#endif
+#ifndef UTASK_POOL_RESERVE2
+#define UTASK_POOL_RESERVE2     0
+#endif
+#ifndef UTASK_POOL_RESERVE3
+#define UTASK_POOL_RESERVE3     0
+#endif
+#ifndef UTASK_POOL_RESERVE4
+#define UTASK_POOL_RESERVE4     0
+#endif
+
+/*
+ * Pool block alignment in bytes, it must be a power of 2 no smaller than a
+ * pointer, 0 uses pointer alignment.  Multi-core hosts should set this to
+ * the cache line size (usually 64) so a block never straddles two cache lines
+ * or shares a line with a block in use by another thread.  Blocks from the
+ * UTASK_TLSF_SIZE region get the same alignment, at least 8.  C++20
+ * coroutines in utask.hpp need at least __STDCPP_DEFAULT_NEW_ALIGNMENT__
+ * (16 on most 64 bit hosts), they are left out with a smaller alignment.
+ */
+#ifndef UTASK_POOL_ALIGN
+#define UTASK_POOL_ALIGN        0
+#endif
+
+/*
+ * Set to 1 on Linux hosts to place the pool memory in an mmap region advised
+ * to use huge pages.  uTaskCtor maps the region and touches every page, so
+ * allocations made after it returns do not take page faults.
+ */
+#ifndef UTASK_POOL_HUGEPAGE
+#define UTASK_POOL_HUGEPAGE     0
+#endif
+
+/*
+ * Size in bytes of the variable size region, set to 0 to exclude it.  When
+ * enabled uTaskAlloc requests larger than every pool block are allocated from
+ * this region with a two level segregated fit allocator, which allocates and
+ * frees in bounded time.  uTaskFree and the message loop release them like
+ * any other pool block.
+ */
+#ifndef UTASK_TLSF_SIZE
+#define UTASK_TLSF_SIZE         0
+#endif
+
+/*
+ * Set to 1 to track free pool blocks in a per pool bitmap instead of a free
+ * list threaded through the blocks.  Free blocks are never written, and
+ * freeing a block which is already free is detected and ignored.  Set to 0
+ * to use the free list.
+ */
+#ifndef UTASK_POOL_BITMAP
+#define UTASK_POOL_BITMAP       0
+#endif
+
+/*
+ * Set to 1 to keep a reference count for every pool block, see
+ * uTaskMsgRetain.  Costs one byte per pool block.
+ */
+#ifndef UTASK_POOL_REFCOUNT
+#define UTASK_POOL_REFCOUNT     1
+#endif
+
+/*
+ * Set to 1 to include message chains, see uTaskChainAlloc.  Requires the
+ * memory pool and UTASK_POOL_REFCOUNT.
+ */
+#ifndef UTASK_CHAIN_USE
+#define UTASK_CHAIN_USE         0
+#endif
+
+/*
+ * Set to 1 to include byte streams, see uTaskStreamInit.
+ */
+#ifndef UTASK_STREAM_USE
+#define UTASK_STREAM_USE        0
+#endif
+
+/*
+ * Set to 1 to include bounded item channels, see uTaskChanInit.
+ */
+#ifndef UTASK_CHAN_USE
+#define UTASK_CHAN_USE          0
+#endif
+
+/*
+ * Set to 1 to include event flag groups, see uTaskEventWait.
+ */
+#ifndef UTASK_EVENT_USE
+#define UTASK_EVENT_USE         0
+#endif
+
+/*
+ * Set to 1 to include semaphores and mutexes that grant by message, see
+ * uTaskSemAcquire.
+ */
+#ifndef UTASK_SEM_USE
+#define UTASK_SEM_USE           0
+#endif
+
+/*
+ * Set UTASK_HSM_DEPTH to the deepest nesting of hierarchical state machine
+ * states, see uTaskHsmInit, set to 0 to disable them.  A transition keeps
+ * the states it enters on the stack.
+ */
+#ifndef UTASK_HSM_DEPTH
+#define UTASK_HSM_DEPTH         0
+#endif
+
+/*
+ * Set to 1 to include publish/subscribe topics, see uTaskPublish.  Requires
+ * UTASK_POOL_REFCOUNT, subscribers share the published message.
+ */
+#ifndef UTASK_TOPIC_USE
+#define UTASK_TOPIC_USE         0
+#endif
+
+/*
+ * Set UTASK_POOL_MAG_SIZE to the number of free blocks each thread may cache
+ * per pool size, set to 0 to disable.  A thread's cache (magazine) is used
+ * by uTaskAlloc and uTaskFree without taking the interrupt lock, blocks move
+ * between a magazine and the shared pool UTASK_POOL_MAG_BATCH at a time.
+ * Only enable on multi-threaded host builds, a magazine is per thread and must
+ * not be used by an interrupt handler that preempts the owning thread.
+ */
+#ifndef UTASK_POOL_MAG_SIZE
+#define UTASK_POOL_MAG_SIZE     0
+#endif
+#ifndef UTASK_POOL_MAG_BATCH
+#define UTASK_POOL_MAG_BATCH    (UTASK_POOL_MAG_SIZE/2)
+#endif
+
+/*
+ * Set UTASK_EXEC_WORKERS to the largest number of worker threads the
+ * executor may run, set to 0 to exclude the executor.  See uTaskExecRun.
+ * The executor needs POSIX threads and the GCC __atomic builtins.
+ * UTASK_EXEC_BATCH is the number of messages a worker hands one task before
+ * it moves on to the next ready task.
+ */
+#ifndef UTASK_EXEC_WORKERS
+#define UTASK_EXEC_WORKERS      0
+#endif
+#ifndef UTASK_EXEC_BATCH
+#define UTASK_EXEC_BATCH        16
+#endif
+
+/*
+ * Set UTASK_INTAKE_SIZE to a power of 2 to let threads other than the one
+ * running an instance's loop call uTaskMessageSend, 0 disables.  Their
+ * sends go through a lock-free queue of this many entries that the loop
+ * moves into its tcb queue, sends fail while it is full.  Needs the GCC
+ * __atomic builtins.
+ */
+#ifndef UTASK_INTAKE_SIZE
+#define UTASK_INTAKE_SIZE       0
+#endif
+
+/*
+ * Set UTASK_IDLE_PARK to 1 to let an idle message loop sleep instead of
+ * spinning, Linux only.  A loop without work spins UTASK_IDLE_SPIN passes,
+ * yields the cpu UTASK_IDLE_YIELD passes, then parks on a futex until a
+ * send from an isr or another thread, or until uTaskTick reaches its next
+ * expiry.  Senders only make the wake system call when the loop is parked.
+ */
+#ifndef UTASK_IDLE_PARK
+#define UTASK_IDLE_PARK         0
+#endif
+#ifndef UTASK_IDLE_SPIN
+#define UTASK_IDLE_SPIN         1000
+#endif
+#ifndef UTASK_IDLE_YIELD
+#define UTASK_IDLE_YIELD        16
+#endif
+
+/*
+ * Set to 1 to use the POSIX reference port in utask.c instead of writing
+ * the PORT functions, Linux only.  It provides uTaskInterruptDisable and
+ * uTaskInterruptRestore as a mutex, a timerfd tick and an interrupt thread
+ * that runs signal handlers as isr's.  See uTaskPortStart.
+ */
+#ifndef UTASK_PORT_POSIX
+#define UTASK_PORT_POSIX        0
+#endif
+
+/*
+ * Number of correlation slots for uTaskCall, the calls that may be waiting
+ * for a reply at the same time.  Set to 0 to exclude calls.  At most 65535.
+ */
+#ifndef UTASK_CALL_SLOTS
+#define UTASK_CALL_SLOTS        0
+#endif
+
+/* Storage class used for per thread data */
+#ifndef UTASK_THREAD_LOCAL
+#define UTASK_THREAD_LOCAL      __thread
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /* Types used by uTask */
 struct uTask_T;
@@ -158,12 +402,266 @@ typedef void (*pfuTask)(
     void            *pMsg
     );
 
-/* uTask is a structure with only a handler */
+/* Pool usage as returned by uTaskPoolStats */
+typedef struct
+{
+    unsigned int    uSize;          /* Block size */
+    unsigned int    uCount;         /* Number of blocks */
+    unsigned int    uFree;          /* Blocks not allocated */
+    unsigned int    uReserve;       /* Blocks held back for isr allocs */
+    unsigned long   uReserveUsed;   /* Isr allocs served from the reserve */
+    unsigned long   uReserveEmpty;  /* Isr allocs failed with reserve empty */
+} uTaskPoolStats_T;
+
+/*
+ * Strand, the messages of the tasks on a strand are handled one at a time,
+ * private - do not access directly - use uTaskStrand api's
+ */
+typedef struct uTaskStrand_T
+{
+    struct uTaskTcb_T       *pReadyHead;    /* Messages ready to be handled */
+    struct uTaskTcb_T       *pReadyTail;
+    struct uTaskStrand_T    *pNextReady;    /* Link in a worker's queue */
+    int                     State;          /* Idle, queued or running */
+    int                     Lock;
+    int                     Home;           /* Pinned worker, -1 if none */
+    int                     Affinity;
+} uTaskStrand_T;
+
+/*
+ * uTask is a structure with only a handler.  With the executor, Affinity
+ * pins the task to worker Affinity-1, 0 lets it run on any worker.  The
+ * other fields are private to the executor and are left out when it is
+ * not used.
+ */
 typedef struct uTask_T
 {
     pfuTask Handler;
+#if UTASK_EXEC_WORKERS
+    int                 Affinity;
+    uTaskStrand_T       *pStrand;       /* Shared strand, NULL for Strand */
+    uTaskStrand_T       Strand;         /* The task's own strand */
+#endif
 } uTask_T;
 
+/*
+ * Task control block, private - do not access directly.  Declared here so
+ * callers of uTaskCoreCtor can provide the storage.
+ */
+typedef struct uTaskTcb_T
+{
+    struct uTaskTcb_T   *pNext;
+    struct uTaskTcb_T   *pPrev;
+    unsigned short      Flags;
+    uTask_T             *pTask;
+    int                 Id;
+    void                *pMsg;
+    unsigned long       Expire;
+#if UTASK_EXEC_WORKERS
+    struct uTaskCore_T  *pOwner;        /* Instance the block belongs to */
+#endif
+} uTaskTcb_T;
+
+/*
+ * A uTask scheduler instance, private - do not access directly - use the
+ * uTaskCore api's.  Each instance has its own message queue, isr queue and
+ * tick, the memory pool is shared by all instances.
+ */
+typedef struct uTaskCore_T
+{
+    unsigned short      Flags;
+    unsigned long       Tick;
+    uTaskTcb_T          *pFree;
+    uTaskTcb_T          *pHead;
+    uTaskTcb_T          *pTail;
+    struct
+    {
+        struct
+        {
+            int         front;
+            int         rear;
+            int         size;
+        } hdr;
+        uTaskTcb_T      items[UTASK_ISR_QUEUE_SIZE+1];
+    } IsrQ;
+#if UTASK_EXEC_WORKERS
+    uTaskTcb_T          *pRemote;       /* Blocks freed by other threads */
+#endif
+#if UTASK_IDLE_PARK
+    int                 Park;           /* Futex word of an idle loop */
+    unsigned long       ParkExpire;     /* Tick that ends a timed park */
+#endif
+#if UTASK_INTAKE_SIZE
+    struct
+    {
+        unsigned long   Head;           /* Next entry senders claim */
+        unsigned long   Tail;           /* Next entry the loop takes */
+        struct
+        {
+            unsigned long   Seq;
+            struct uTask_T  *pTask;
+            int             Id;
+            void            *pMsg;
+            unsigned long   Expire;
+        } items[UTASK_INTAKE_SIZE];
+    } Intake;                           /* Sends from other threads */
+#endif
+} uTaskCore_T;
+
+/* Byte stream, private - do not access directly - use uTaskStream api's */
+typedef struct
+{
+    unsigned char   *pBuf;
+    unsigned int    uSize;
+    unsigned int    uA;         /* Start of region A, the oldest data */
+    unsigned int    uAEnd;      /* End of region A */
+    unsigned int    uBEnd;      /* End of region B, which starts at 0 */
+    unsigned int    uResv;      /* Start of the reserved write space */
+    int             BUse;       /* Writes go to region B */
+    int             Notify;     /* A data message is outstanding */
+    struct uTask_T  *pTask;
+    int             Id;
+} uTaskStream_T;
+
+/* Item channel, private - do not access directly - use uTaskChan api's */
+typedef struct
+{
+    unsigned char   *pBuf;
+    unsigned int    uItem;      /* Bytes per item */
+    unsigned int    uCount;     /* Items the ring holds */
+    unsigned int    uHead;      /* Index of the oldest item */
+    unsigned int    uUsed;      /* Items in the ring */
+    int             Notify;     /* A wakeup message is outstanding */
+    struct uTask_T  *pTask;
+    int             Id;
+} uTaskChan_T;
+
+/* Event wait, private - do not access directly - use uTaskEvent api's */
+typedef struct uTaskEventWait_T
+{
+    struct uTaskEventWait_T *pNext;
+    struct uTaskEvent_T *pEvent;        /* Group waited on, NULL if none */
+    uTask_T             Timer;          /* Delivers the timeout */
+    uTask_T             *pTask;
+    int                 Id;
+    unsigned long       Mask;
+    int                 Mode;
+    unsigned long       Result;         /* Flags that ended the wait */
+    int                 Seq;            /* Makes timeouts of old waits stale */
+    int                 Queued;         /* pTcb is in the timer queue */
+    uTaskTcb_T          *pTcb;          /* Timer and delivery tcb */
+    uTaskCore_T         *pCore;         /* Instance pTcb belongs to */
+} uTaskEventWait_T;
+
+/* Event flag group, private - do not access directly - use uTaskEvent api's */
+typedef struct uTaskEvent_T
+{
+    unsigned long       Flags;
+    uTaskEventWait_T    *pWait;         /* Waiters in the order they waited */
+    uTask_T             Check;          /* Checks waiters after isr sets */
+    int                 Pending;        /* A check message is outstanding */
+} uTaskEvent_T;
+
+/* Semaphore wait, private - do not access directly - use uTaskSem api's */
+typedef struct uTaskSemWait_T
+{
+    struct uTaskSemWait_T   *pNext;
+    struct uTaskSem_T       *pSem;      /* Semaphore waited on, NULL if none */
+    uTask_T                 *pTask;
+    int                     Id;
+    int                     Prio;
+    uTaskTcb_T              *pTcb;      /* Carries the grant */
+    uTaskCore_T             *pCore;     /* Instance pTcb belongs to */
+} uTaskSemWait_T;
+
+/* Counting semaphore, private - do not access directly - use uTaskSem api's */
+typedef struct uTaskSem_T
+{
+    int                     Count;      /* Free units, 0 while tasks wait */
+    int                     Order;      /* UTASK_SEM_FIFO or UTASK_SEM_PRIO */
+    uTaskSemWait_T          *pWait;     /* Waiters in the order they are served */
+} uTaskSem_T;
+
+/* Mutex, private - do not access directly - use uTaskMutex api's */
+typedef struct
+{
+    uTaskSem_T              Sem;
+    uTask_T                 *pOwner;    /* Task holding the mutex, or NULL */
+} uTaskMutex_T;
+
+/*
+ * Subscription to a topic, private - do not access directly - use the
+ * uTaskSubscribe api's.  The subscriber provides the storage, usually static.
+ */
+typedef struct uTaskSub_T
+{
+    struct uTaskSub_T   *pNext;
+    struct uTask_T      *pTask;
+    int                 Id;
+} uTaskSub_T;
+
+/* Topic, private - do not access directly - use uTaskPublish api's */
+typedef struct
+{
+    uTaskSub_T      *pHead;
+    int             Count;
+} uTaskTopic_T;
+
+/* Coroutine state, private - do not access directly - use UTASK_PT macros */
+typedef struct
+{
+    unsigned short  Lc;         /* Line to resume at, 0 at the start */
+    unsigned short  Flags;      /* Waiting, with a timeout */
+    int             Wait;       /* Id the coroutine waits for */
+} uTaskPt_T;
+
+struct uTaskHsm_T;
+
+/* Entry and exit action of a state */
+typedef void (*pfuTaskHsmAction)(
+    struct uTaskHsm_T   *pHsm
+    );
+
+/*
+ * Action of a rule, returns UTASK_S_OK to take the rule or UTASK_E_FAIL to
+ * decline the message, the search for a rule then goes on.
+ */
+typedef int (*pfuTaskHsmRule)(
+    struct uTaskHsm_T   *pHsm,
+    int                 Id,
+    void                *pMsg
+    );
+
+/* Rule of a state, see uTaskHsmInit */
+typedef struct
+{
+    int                     Id;
+    pfuTaskHsmRule          Action;     /* NULL takes the rule */
+    short                   Next;       /* State to go to, or UTASK_HSM_NONE */
+    short                   Lca;        /* Innermost state not left */
+} uTaskHsmRule_T;
+
+/* State, see uTaskHsmInit */
+typedef struct
+{
+    short                   Parent;     /* Enclosing state, or UTASK_HSM_NONE */
+    short                   Init;       /* Child entered with the state */
+    pfuTaskHsmAction        Entry;
+    pfuTaskHsmAction        Exit;
+    const uTaskHsmRule_T    *pRule;
+    int                     RuleCount;
+} uTaskHsmState_T;
+
+/* State machine, private - do not access directly - use uTaskHsm api's */
+typedef struct uTaskHsm_T
+{
+    uTask_T                 Task;       /* Gets the machine's messages */
+    const uTaskHsmState_T   *pState;
+    int                     Count;
+    int                     Current;    /* Innermost active state */
+    void                    *pCtx;
+} uTaskHsm_T;
+
 /*
  * PORT function, must be !!implemented!!
  *
@@ -239,7 +737,8 @@ uTaskMessageLoop(
 
 /*
  * Send a task message, with delay, this function should only be
- * called from task context, opposed to ISR context.
+ * called from task context, opposed to ISR context.  With UTASK_INTAKE_SIZE
+ * other threads may call it too, the delay starts when it is called.
  */
 int
 uTaskMessageSend(
@@ -261,6 +760,22 @@ uTaskMessageSendIsr(
     void            *pData
     );
 
+/*
+ * Send the same message to Count tasks without copying it, pMsg is shared by
+ * every receiver and freed after the last of them has handled it.  pMsg
+ * must be NULL, a pool block or memory not allocated by uTask, blocks from
+ * the UTASK_TLSF_SIZE region cannot be shared.  Returns the number of tasks
+ * the message was sent to, if 0 the caller still owns pMsg.
+ */
+int
+uTaskMessageMulticast(
+    uTask_T         **ppTask,
+    int             Count,
+    int             Id,
+    void            *pMsg,
+    unsigned long   Time
+    );
+
 /*
  * Cancels all messages in the queue that match this task and id.  This function
  * cannot be called from ISR context and it will not cancel messages sent
@@ -272,27 +787,992 @@ uTaskMessageCancel(
     int             Id
     );
 
+/************************* uTask instance api's *******************************/
+
 /*
- * Allocate a memory block from the fix block pool.  Memory allocated from the
- * fixed block pool are freed automatically when passed as an argument to
- * uTaskMessageSend.  Fails if uSize is zero or there are no available memory
- * blocks that meet the requested size.
+ * The uTask api's above work on a default instance created by uTaskCtor.
+ * The uTaskCore api's below take the instance as their first argument and
+ * otherwise behave the same as the api of the same name without "Core".
+ * Run each instance's uTaskCoreMessageLoop on its own thread, or in turn
+ * from one thread, for independent schedulers in one program.
  */
-void *
-uTaskAlloc(
-    int              uSize
+
+/* Returns the default instance used by the uTask api's */
+uTaskCore_T *
+uTaskCoreDefault(
+    void
     );
 
 /*
- * Free a memory block that was allocated using the function uTaskAlloc.  This
- * call should not be called on message blocks that were passed as an argument
- * to uTaskMessageSend.  pMem can be NULL
+ * Initialize an instance using TcbCount caller provided task control blocks.
+ * uTaskCtor must have been called first, it initializes the memory pool.
  */
+int
+uTaskCoreCtor(
+    uTaskCore_T     *pCore,
+    uTaskTcb_T      *pTcb,
+    int             TcbCount
+    );
+
 void
-uTaskFree(
-    void             *pMem
+uTaskCoreDtor(
+    uTaskCore_T     *pCore
+    );
+
+void
+uTaskCoreTick(
+    uTaskCore_T     *pCore
+    );
+
+unsigned long
+uTaskCoreGetTick(
+    uTaskCore_T     *pCore
     );
 
+void
+uTaskCoreMessageLoop(
+    uTaskCore_T     *pCore
+    );
+
+int
+uTaskCoreMessageSend(
+    uTaskCore_T     *pCore,
+    uTask_T         *pTask,
+    int             Id,
+    void            *pMsg,
+    unsigned long   Time
+    );
+
+int
+uTaskCoreMessageSendIsr(
+    uTaskCore_T     *pCore,
+    uTask_T         *pTask,
+    int             Id,
+    void            *pData
+    );
+
+int
+uTaskCoreMessageMulticast(
+    uTaskCore_T     *pCore,
+    uTask_T         **ppTask,
+    int             Count,
+    int             Id,
+    void            *pMsg,
+    unsigned long   Time
+    );
+
+int
+uTaskCoreMessageCancel(
+    uTaskCore_T     *pCore,
+    uTask_T         *pTask,
+    int             Id
+    );
+
+/*
+ * Free the messages still queued on an instance without delivering them,
+ * also those sent from isr's and other threads.  Call after its loop has
+ * stopped, before its task control blocks go away.
+ */
+void
+uTaskCoreFlush(
+    uTaskCore_T     *pCore
+    );
+
+/************************* uTask executor api's *******************************/
+
+/*
+ * The executor runs messages on several worker threads, each with its own
+ * uTaskCore_T instance for delayed messages.  Worker 0 is the default
+ * instance and runs on the thread calling uTaskExecRun.  Messages that are
+ * due are queued on their task's strand, and the strand on a worker's
+ * ready queue, idle workers steal ready strands from busy ones.  A strand
+ * is never run by two workers at the same time and handles its messages
+ * in the order they became due, so handlers keep their single threaded
+ * guarantee while independent tasks run in parallel.
+ *
+ * A task with an Affinity only runs on that worker, it is never stolen.
+ * Its messages sent from other workers go through the worker's lock-free
+ * inbox, which the worker drains each pass and which wakes it when it is
+ * sleeping, sends from its own worker are queued directly.
+ *
+ * Handlers send with the usual uTask api's, which use the instance of the
+ * worker they run on.  Other threads may only send before uTaskExecRun,
+ * unless UTASK_INTAKE_SIZE is set, isr's use uTaskMessageSendIsr as usual.
+ * uTaskMessageCancel only cancels delayed messages sent from the same
+ * worker.  Only available when UTASK_EXEC_WORKERS is not 0.
+ */
+
+/*
+ * Every task runs on its own strand.  Tasks that share state can join one
+ * shared strand instead, so that no two of their handlers run at the same
+ * time.  A shared strand has its own Affinity, the Affinity of the tasks
+ * on it is not used.  Join before the task is sent any message.
+ */
+void
+uTaskStrandInit(
+    uTaskStrand_T   *pStrand,
+    int             Affinity
+    );
+
+/* Move pTask onto pStrand, NULL moves it back to its own strand */
+void
+uTaskStrandJoin(
+    uTask_T         *pTask,
+    uTaskStrand_T   *pStrand
+    );
+
+/* Prepare Workers workers, call after uTaskCtor */
+int
+uTaskExecCtor(
+    int             Workers
+    );
+
+/*
+ * Run the workers, the calling thread is worker 0.  Returns UTASK_S_OK after
+ * uTaskDtor is called and all workers have stopped.  If a worker thread
+ * cannot be created no handler runs and UTASK_E_FAIL is returned, the
+ * queued messages stay queued.
+ */
+int
+uTaskExecRun(
+    void
+    );
+
+/************************* uTask posix port api's *****************************/
+
+/*
+ * The POSIX port runs one "interrupt" thread.  It calls uTaskTick from a
+ * timerfd every tick and the registered isr of each signal it receives, in
+ * both cases holding the uTaskInterruptDisable lock, so isr's run exactly
+ * as they would with interrupts disabled and may use the Isr api's.  The
+ * lock is a mutex taken once per thread, nested disables only count, so
+ * an uncontended critical section costs one atomic operation.  Only
+ * available when UTASK_PORT_POSIX is not 0.
+ */
+
+/* Isr callback, called with the signal number */
+typedef void (*pfuTaskIsr)(
+    int             Signo
+    );
+
+/* Register pIsr for signal Signo, call before uTaskPortStart */
+int
+uTaskPortIsr(
+    int             Signo,
+    pfuTaskIsr      pIsr
+    );
+
+/*
+ * Start the interrupt thread with a tick of TickUs micro seconds, 0 for no
+ * tick.  Blocks the registered signals in the calling thread, so call it
+ * before creating other threads, which inherit the mask.  uTaskExecRun
+ * blocks them in its workers too.  Fails while uTaskExecRun runs.
+ */
+int
+uTaskPortStart(
+    unsigned long   TickUs
+    );
+
+/* Raise a registered signal, the "interrupt" then runs on its thread */
+int
+uTaskPortRaise(
+    int             Signo
+    );
+
+/* Stop and join the interrupt thread */
+void
+uTaskPortStop(
+    void
+    );
+
+/************************* uTask call api's ***********************************/
+
+/*
+ * A call sends a request to a task and delivers exactly one answer back to
+ * the caller, either the reply or a timeout.  uTaskCall takes a
+ * correlation slot from a fixed table and returns its handle, the target
+ * handles the request as a normal message and answers it, now or later,
+ * with uTaskReply and the handle from uTaskCallCurrent.  The caller's
+ * pReplyTask then gets ReplyId with the reply as its message, or with a
+ * NULL message if the reply did not arrive within Timeout ticks.  A reply
+ * cancels the timeout without searching the timer queue, replies after the
+ * timeout are dropped, and so is a request still queued when it expires.
+ * With the executor the request and the answer run on the strands and
+ * workers of pTarget and pReplyTask.  There a reply cancels the timeout
+ * only when it runs on the worker that made the call, as it does when
+ * pReplyTask is pinned to that worker.  Elsewhere the timeout's tcb stays
+ * queued until it expires and is then dropped.
+ * Call from task context.  Only available when UTASK_CALL_SLOTS is not 0.
+ */
+
+/*
+ * Send pReq to pTarget as message Id.  Returns the call handle, a positive
+ * number, or UTASK_E_FAIL if no slot or tcb is free, in which case the
+ * caller still owns pReq.  Timeout 0 waits for the reply forever.
+ */
+int
+uTaskCall(
+    uTask_T         *pTarget,
+    int             Id,
+    void            *pReq,
+    uTask_T         *pReplyTask,
+    int             ReplyId,
+    unsigned long   Timeout
+    );
+
+/*
+ * Answer call Call with pReply, which must not be NULL.  Returns
+ * UTASK_E_FAIL if the call already has its answer or timed out, the
+ * caller then still owns pReply.
+ */
+int
+uTaskReply(
+    int             Call,
+    void            *pReply
+    );
+
+/*
+ * The handle of the call whose request or answer the running handler was
+ * given, 0 if it was not given one.
+ */
+int
+uTaskCallCurrent(
+    void
+    );
+
+/************************* uTask topic api's **********************************/
+
+/*
+ * A topic keeps a list of subscribers, each a task and the Id it wants the
+ * topic's messages as.  uTaskPublish sends one message to all of them at
+ * once: every subscriber gets the same pool block, reference counted like
+ * uTaskMessageMulticast, and their tcbs enter the timer queue with a single
+ * sorted insert.  Subscriptions are provided by the subscriber, so neither
+ * subscribing nor publishing allocates anything but tcbs.  Call from task
+ * context, with the executor from handlers on one strand.  Only available
+ * when UTASK_TOPIC_USE is 1.
+ */
+
+/* Initialize an empty topic, a zeroed static topic is empty too */
+void
+uTaskTopicInit(
+    uTaskTopic_T    *pTopic
+    );
+
+/*
+ * Add pTask as a subscriber of pTopic, it will get published messages as
+ * message Id.  pSub is the subscription's storage, it must stay valid until
+ * uTaskUnsubscribe.  Subscribers get messages in the order they subscribed.
+ * Fails if pSub is already on the topic.
+ */
+int
+uTaskSubscribe(
+    uTaskTopic_T    *pTopic,
+    uTaskSub_T      *pSub,
+    uTask_T         *pTask,
+    int             Id
+    );
+
+/* Remove subscription pSub from pTopic, fails if it is not on the topic */
+int
+uTaskUnsubscribe(
+    uTaskTopic_T    *pTopic,
+    uTaskSub_T      *pSub
+    );
+
+/*
+ * Send pMsg to every subscriber of pTopic after Time ticks.  pMsg must be
+ * NULL, a pool block or memory not allocated by uTask, blocks from the
+ * UTASK_TLSF_SIZE region cannot be shared.  Returns the number of
+ * subscribers the message was sent to, if 0 the caller still owns pMsg.
+ */
+int
+uTaskPublish(
+    uTaskTopic_T    *pTopic,
+    void            *pMsg,
+    unsigned long   Time
+    );
+
+/************************* uTask event api's **********************************/
+
+/*
+ * An event group is a word of flags that tasks and isr's set and clear with
+ * single atomic operations.  A task waits for any or all of a mask of flags
+ * with uTaskEventWait and gets exactly one message when the wait ends:
+ * Id with the wait as pMsg, where uTaskEventResult gives the flags that
+ * ended it, or 0 if it timed out.  Setting flags no waiter cares about
+ * sends nothing.  Flags set from an isr are checked against the waiters
+ * by one message to the group, so waits end in task context.  The wait
+ * storage is provided by the waiter and must not be a pool block.  With the
+ * executor a wait that ends on another worker than the one it was made on
+ * keeps its timeout tcb until the timeout expires.  Only available when
+ * UTASK_EVENT_USE is 1.
+ */
+
+/* Wait modes, UTASK_EVENT_CLEAR may be or'ed with either */
+#define UTASK_EVENT_ANY         0       /* Any flag of the mask is set */
+#define UTASK_EVENT_ALL         1       /* Every flag of the mask is set */
+#define UTASK_EVENT_CLEAR       2       /* Clear the mask when the wait ends */
+
+void
+uTaskEventInit(
+    uTaskEvent_T        *pEvent
+    );
+
+/* Task context, set the flags in Mask and end the waits they satisfy */
+void
+uTaskEventSet(
+    uTaskEvent_T        *pEvent,
+    unsigned long       Mask
+    );
+
+/* Isr context, set the flags in Mask, waits end when the loop runs */
+void
+uTaskEventSetIsr(
+    uTaskEvent_T        *pEvent,
+    unsigned long       Mask
+    );
+
+/* Clear the flags in Mask, from task or isr context */
+void
+uTaskEventClear(
+    uTaskEvent_T        *pEvent,
+    unsigned long       Mask
+    );
+
+/* Returns the flags, from task or isr context */
+unsigned long
+uTaskEventGet(
+    uTaskEvent_T        *pEvent
+    );
+
+/*
+ * Wait for Mask in Mode, sending Id to pTask when the wait ends, at once if
+ * the flags already satisfy it.  Timeout 0 waits forever.  A wait takes one
+ * tcb until it ends.  Fails if pWait is already waiting or no tcb is free.
+ */
+int
+uTaskEventWait(
+    uTaskEvent_T        *pEvent,
+    uTaskEventWait_T    *pWait,
+    unsigned long       Mask,
+    int                 Mode,
+    uTask_T             *pTask,
+    int                 Id,
+    unsigned long       Timeout
+    );
+
+/* End a wait without a message, fails if it is not waiting */
+int
+uTaskEventCancel(
+    uTaskEventWait_T    *pWait
+    );
+
+/* The flags that ended the wait, 0 if it timed out */
+unsigned long
+uTaskEventResult(
+    uTaskEventWait_T    *pWait
+    );
+
+/************************* uTask semaphore api's ******************************/
+
+/*
+ * Semaphores and mutexes for resources shared by tasks, such as a bus.  An
+ * acquire that cannot be satisfied queues the task, first come first served
+ * or by priority, and returns UTASK_SEM_QUEUED.  A release then hands the
+ * unit straight to the first waiter, which gets its Id with the wait as pMsg
+ * and owns the unit from then on, so nobody polls.  The wait storage is
+ * provided by the waiter, it must not be a pool block and stays in use
+ * until the grant arrives.  A queued wait holds one tcb, so the grant cannot
+ * fail for lack of one.  Call from task context.  Only available when
+ * UTASK_SEM_USE is 1.
+ */
+
+/* Waiter orders */
+#define UTASK_SEM_FIFO          0       /* In the order they waited */
+#define UTASK_SEM_PRIO          1       /* Highest Prio first, then FIFO */
+
+/* Returned when the unit is granted later by message */
+#define UTASK_SEM_QUEUED        1
+
+/* Initialize pSem with Count free units, waiters served in Order */
+void
+uTaskSemInit(
+    uTaskSem_T          *pSem,
+    int                 Count,
+    int                 Order
+    );
+
+/*
+ * Take one unit of pSem.  Returns UTASK_S_OK if it was free, the caller
+ * owns it now and no message is sent.  Otherwise pWait is queued with Prio
+ * and UTASK_SEM_QUEUED is returned, Id is sent to pTask when a release
+ * grants the unit.  Fails if pWait is already queued or no tcb is free.
+ */
+int
+uTaskSemAcquire(
+    uTaskSem_T          *pSem,
+    uTaskSemWait_T      *pWait,
+    uTask_T             *pTask,
+    int                 Id,
+    int                 Prio
+    );
+
+/* Take one unit of pSem if one is free, never queues */
+int
+uTaskSemTryAcquire(
+    uTaskSem_T          *pSem
+    );
+
+/* Return one unit, granting it to the first waiter if there is one */
+void
+uTaskSemRelease(
+    uTaskSem_T          *pSem
+    );
+
+/*
+ * Stop waiting without a grant.  Fails if pWait is not queued, after a grant
+ * was sent the waiter owns the unit and must release it.
+ */
+int
+uTaskSemCancel(
+    uTaskSemWait_T      *pWait
+    );
+
+/* Free units, 0 if tasks wait */
+int
+uTaskSemCount(
+    uTaskSem_T          *pSem
+    );
+
+/*
+ * A mutex is a semaphore of one unit that knows its owner.  Unlock only by
+ * the owning task, ownership moves to the first waiter before its grant is
+ * sent.  A task that locks a mutex it already holds fails.
+ */
+void
+uTaskMutexInit(
+    uTaskMutex_T        *pMutex,
+    int                 Order
+    );
+
+/* Same as uTaskSemAcquire, pTask becomes the owner */
+int
+uTaskMutexLock(
+    uTaskMutex_T        *pMutex,
+    uTaskSemWait_T      *pWait,
+    uTask_T             *pTask,
+    int                 Id,
+    int                 Prio
+    );
+
+/* Fails if pTask does not own pMutex */
+int
+uTaskMutexUnlock(
+    uTaskMutex_T        *pMutex,
+    uTask_T             *pTask
+    );
+
+/* The owning task, NULL if the mutex is free */
+uTask_T *
+uTaskMutexOwner(
+    uTaskMutex_T        *pMutex
+    );
+
+/************************* uTask state machine api's **************************/
+
+/*
+ * Hierarchical state machines described by const tables, so the tables can
+ * live in ROM.  A machine is a task: a message goes to the rules of the
+ * innermost active state, and bubbles up to the enclosing states until a
+ * rule with its Id takes it.  Rules of a state are tried in table order,
+ * an Action that declines acts as a guard.  Messages no rule takes are
+ * dropped.
+ *
+ * A rule with a Next state runs its Action, then the exit actions of the
+ * active states below Lca from the inside out, then the entry actions of
+ * the states below Lca down to Next, and then follows the Init children of
+ * Next.  Lca is the least common ancestor, worked out when the table is
+ * written so no transition searches for it: the innermost state that
+ * encloses both the rule's state and Next, or UTASK_HSM_NONE if none does.
+ * For a transition of a state to itself, which leaves and enters it, Lca is
+ * its parent.  For a transition to a child, Lca is the state itself.
+ *
+ *  enum { OFF, ON, IDLE, BUSY };
+ *
+ *  static const uTaskHsmRule_T OffRules[] =
+ *  {
+ *      { EV_POWER, NULL, ON, UTASK_HSM_NONE },
+ *  };
+ *  // Taken in IDLE and BUSY too, their messages bubble up to ON
+ *  static const uTaskHsmRule_T OnRules[] =
+ *  {
+ *      { EV_POWER, NULL, OFF, UTASK_HSM_NONE },
+ *  };
+ *  static const uTaskHsmRule_T IdleRules[] =
+ *  {
+ *      { EV_START, CanStart, BUSY, ON },
+ *  };
+ *  static const uTaskHsmRule_T BusyRules[] =
+ *  {
+ *      { EV_DONE, Report, IDLE, ON },
+ *  };
+ *
+ *  static const uTaskHsmState_T States[] =
+ *  {
+ *      // Parent  Init  Entry    Exit, -1 is UTASK_HSM_NONE
+ *      { -1,      -1,   NULL,    NULL,      UTASK_HSM_RULES(OffRules) },
+ *      { -1,      IDLE, PowerUp, PowerDown, UTASK_HSM_RULES(OnRules) },
+ *      { ON,      -1,   NULL,    NULL,      UTASK_HSM_RULES(IdleRules) },
+ *      { ON,      -1,   MotorOn, MotorOff,  UTASK_HSM_RULES(BusyRules) },
+ *  };
+ *
+ *  uTaskHsmInit(&Motor, States, 4, OFF, &MotorData);
+ *
+ * Actions find the machine's own data with uTaskHsmContext.  Only available
+ * when UTASK_HSM_DEPTH is not 0.
+ */
+
+#define UTASK_HSM_NONE          (-1)
+
+/* The pRule and RuleCount of a state from an array of rules */
+#define UTASK_HSM_RULES(r)      (r), (int)(sizeof(r) / sizeof((r)[0]))
+
+/*
+ * Initialize pHsm for the Count states of pState and enter Initial.  Entry
+ * actions run in this call.  Fails if a state nests deeper than
+ * UTASK_HSM_DEPTH or a rule's Lca does not enclose its state and Next.
+ */
+int
+uTaskHsmInit(
+    uTaskHsm_T              *pHsm,
+    const uTaskHsmState_T   *pState,
+    int                     Count,
+    int                     Initial,
+    void                    *pCtx
+    );
+
+/* The task to send the machine's messages to */
+uTask_T *
+uTaskHsmTask(
+    uTaskHsm_T              *pHsm
+    );
+
+/* The innermost active state */
+int
+uTaskHsmState(
+    uTaskHsm_T              *pHsm
+    );
+
+/* Returns 1 if State is the innermost active state or encloses it */
+int
+uTaskHsmIn(
+    uTaskHsm_T              *pHsm,
+    int                     State
+    );
+
+/* The pCtx given to uTaskHsmInit */
+void *
+uTaskHsmContext(
+    uTaskHsm_T              *pHsm
+    );
+
+/************************* uTask memory api's *********************************/
+
+/*
+ * Allocate a memory block from the fix block pool.  Memory allocated from the
+ * fixed block pool are freed automatically when passed as an argument to
+ * uTaskMessageSend.  Fails if uSize is zero or there are no available memory
+ * blocks that meet the requested size.  Requests larger than every pool block
+ * come from the UTASK_TLSF_SIZE region when it is enabled.
+ */
+void *
+uTaskAlloc(
+    int              uSize
+    );
+
+/*
+ * Allocate a memory block from isr context.  Same as uTaskAlloc except it
+ * may use the blocks held back by UTASK_POOL_RESERVEx, and it must only be
+ * called with interrupts disabled, it does not disable them itself.
+ */
+void *
+uTaskAllocIsr(
+    int              uSize
+    );
+
+/*
+ * Free a memory block that was allocated using the function uTaskAlloc.  This
+ * call should not be called on message blocks that were passed as an argument
+ * to uTaskMessageSend.  pMem can be NULL
+ */
+void
+uTaskFree(
+    void             *pMem
+    );
+
+/*
+ * Add a reference to a pool block.  Each reference is dropped by one
+ * uTaskFree (or uTaskMsgRelease), the block returns to its pool when the
+ * last reference is dropped.  Sending a block passes one reference to the
+ * receiver, which the message loop drops after dispatch, so a handler that
+ * keeps or forwards the block must retain it first.  Succeeds without doing
+ * anything for memory not allocated by uTask, fails for blocks from the
+ * UTASK_TLSF_SIZE region or when a block has 127 extra references.
+ */
+int
+uTaskMsgRetain(
+    void             *pMsg
+    );
+
+/*
+ * Drop a reference taken with uTaskMsgRetain, same as uTaskFree.
+ */
+void
+uTaskMsgRelease(
+    void             *pMsg
+    );
+
+/*
+ * Message chains hold payloads larger than a pool block as a list of
+ * segments taken from the largest pool.  A chain is a pool block itself, it
+ * is sent like any other message and uTaskFree, or the message loop after
+ * dispatch, frees it with all of its segments.  Data is copied in once by
+ * uTaskChainAppend or uTaskChainPrepend, after that protocol layers pass the
+ * chain between tasks and strip headers with uTaskChainPeel without copying.
+ * Only available when UTASK_CHAIN_USE is 1.
+ */
+
+/* Allocate an empty chain, returns NULL if the pool is exhausted */
+void *
+uTaskChainAlloc(
+    void
+    );
+
+/*
+ * Copy Len bytes to the end or the front of a chain.  Space left in the end
+ * or front segment is used first.  On failure the chain is unchanged.
+ */
+int
+uTaskChainAppend(
+    void             *pChain,
+    const void       *pData,
+    int              Len
+    );
+
+int
+uTaskChainPrepend(
+    void             *pChain,
+    const void       *pData,
+    int              Len
+    );
+
+/*
+ * Remove up to Len bytes from the front of a chain, freeing segments as they
+ * empty.  Returns the number of bytes removed.
+ */
+int
+uTaskChainPeel(
+    void             *pChain,
+    int              Len
+    );
+
+/* Returns the number of data bytes in a chain */
+int
+uTaskChainLength(
+    void             *pChain
+    );
+
+/*
+ * Walk the data of a chain in place.  Set *ppPos to NULL for the first call,
+ * each call returns the next contiguous span and its length in *pLen, and
+ * NULL after the last one.
+ */
+void *
+uTaskChainData(
+    void             *pChain,
+    void             **ppPos,
+    int              *pLen
+    );
+
+/*
+ * A stream moves bytes from an isr to a task through a caller supplied buffer
+ * managed as a bip-buffer (two regions in one circular buffer), so both the
+ * free space and the data are always handed out as contiguous spans.  The
+ * isr writes with uTaskStreamWriteIsr, or uTaskStreamReserveIsr and
+ * uTaskStreamCommitIsr to fill the buffer in place.  The first commit to an
+ * empty stream sends Id to pTask with the stream as pMsg, later commits send
+ * nothing until the task has read the stream empty.  The task calls
+ * uTaskStreamRead and uTaskStreamConsume until uTaskStreamRead returns NULL.
+ * Only available when UTASK_STREAM_USE is 1.
+ */
+void
+uTaskStreamInit(
+    uTaskStream_T    *pStream,
+    void             *pBuf,
+    int              Size,
+    uTask_T          *pTask,
+    int              Id
+    );
+
+/*
+ * Isr context, returns contiguous space for Len bytes or NULL if there is
+ * not that much contiguous space.  Follow with uTaskStreamCommitIsr.
+ */
+void *
+uTaskStreamReserveIsr(
+    uTaskStream_T    *pStream,
+    int              Len
+    );
+
+/*
+ * Isr context, make Len bytes of the last reservation readable, Len may be
+ * less than was reserved.
+ */
+void
+uTaskStreamCommitIsr(
+    uTaskStream_T    *pStream,
+    int              Len
+    );
+
+/*
+ * Isr context, copy Len bytes into the stream.  Returns UTASK_E_FAIL and
+ * writes nothing if there is not enough contiguous space.
+ */
+int
+uTaskStreamWriteIsr(
+    uTaskStream_T    *pStream,
+    const void       *pData,
+    int              Len
+    );
+
+/*
+ * Task context, returns the oldest contiguous span of data and its length
+ * in *pLen, or NULL if the stream is empty.  The data stays in the stream
+ * until uTaskStreamConsume.
+ */
+void *
+uTaskStreamRead(
+    uTaskStream_T    *pStream,
+    int              *pLen
+    );
+
+/* Task context, remove Len bytes returned by uTaskStreamRead */
+void
+uTaskStreamConsume(
+    uTaskStream_T    *pStream,
+    int              Len
+    );
+
+/*
+ * A channel carries fixed size items by value from producers to one
+ * consumer task through a caller supplied ring of Count items of ItemSize
+ * bytes.  Items are copied in and out of the ring, they need no tcb and no
+ * pool block.  The send that makes an empty channel non-empty sends Id to
+ * pTask with the channel as pMsg, later sends send nothing until the task
+ * has read the channel empty, so the task calls uTaskChanRecv until it
+ * fails.  Sends and receives take the interrupt lock, producers may be
+ * other tasks, or other threads when UTASK_INTAKE_SIZE is set.  Only
+ * available when UTASK_CHAN_USE is 1.
+ */
+void
+uTaskChanInit(
+    uTaskChan_T      *pChan,
+    void             *pBuf,
+    int              ItemSize,
+    int              Count,
+    uTask_T          *pTask,
+    int              Id
+    );
+
+/* Copy an item into the channel, returns UTASK_E_FAIL if it is full */
+int
+uTaskChanSend(
+    uTaskChan_T      *pChan,
+    const void       *pItem
+    );
+
+/*
+ * Copy the oldest item out of the channel, returns UTASK_E_FAIL if it is
+ * empty, which also rearms the wakeup message.
+ */
+int
+uTaskChanRecv(
+    uTaskChan_T      *pChan,
+    void             *pItem
+    );
+
+/* Number of items in the channel */
+int
+uTaskChanCount(
+    uTaskChan_T      *pChan
+    );
+
+/*
+ * Return the pool blocks cached by the calling thread to the shared pool.
+ * Call before a thread which used uTaskAlloc or uTaskFree exits, otherwise
+ * its cached blocks are lost.  Executor workers flush their own when they
+ * stop.  Does nothing if UTASK_POOL_MAG_SIZE is 0.
+ */
+void
+uTaskPoolFlush(
+    void
+    );
+
+/*
+ * Fill pStats with the usage of a pool, pools are numbered from 0 in
+ * ascending block size.  Returns UTASK_E_FAIL if there is no such pool.
+ */
+int
+uTaskPoolStats(
+    int              Pool,
+    uTaskPoolStats_T *pStats
+    );
+
+/************************* uTask coroutine macros *****************************/
+
+/*
+ * Stackless coroutines (protothreads) turn a multi step handler into
+ * straight line code.  A wait stores the line to resume at in a uTaskPt_T
+ * kept next to the task and returns from the handler, the loop calls the
+ * handler again with the next message and the switch jumps back to it.
+ * A coroutine costs 8 bytes and needs no stack of its own.
+ *
+ * While waiting, messages with other Ids are ignored, the loop frees their
+ * pMsg as usual.  After a wait Id and pMsg are those of the message that
+ * resumed the coroutine.  Local variables are not kept across waits, keep
+ * state in the task structure.  Do not use a switch around a wait, and put
+ * at most one wait on a line.
+ *
+ * typedef struct
+ * {
+ *     uTask_T     Task;
+ *     uTaskPt_T   Pt;
+ * } Probe_T;
+ *
+ * void ProbeHandler(uTask_T *pTask, int Id, void *pMsg)
+ * {
+ *     Probe_T *p = (Probe_T *)pTask;
+ *
+ *     UTASK_PT_BEGIN(&p->Pt, pTask, Id);
+ *
+ *     PowerUp();
+ *     UTASK_PT_DELAY(&p->Pt, pTask, 50);
+ *
+ *     do
+ *     {
+ *         // The probe isr sends PROBE_DONE with uTaskMessageSendIsr
+ *         ProbeStart();
+ *         UTASK_PT_WAIT_ID_TIMEOUT(&p->Pt, pTask, PROBE_DONE, 10);
+ *     } while (Id == UTASK_PT_TIMEOUT);
+ *
+ *     PowerDown();
+ *
+ *     UTASK_PT_END(&p->Pt);
+ * }
+ *
+ * The sequence starts on the first message sent to the task and starts
+ * over on the next message after UTASK_PT_END.
+ */
+
+/* Ids the coroutine macros send to the task itself */
+#define UTASK_PT_WAKE           0x7FF0
+#define UTASK_PT_TIMEOUT        0x7FF1
+
+#define UTASK_PT_WAITING        (1 << 0)
+#define UTASK_PT_TIMED          (1 << 1)
+
+#define UTASK_PT_INIT(pt)\
+    ((pt)->Lc = 0, (pt)->Flags = 0, (pt)->Wait = 0)
+
+/* Start of the coroutine body, Id is the handler's message Id */
+#define UTASK_PT_BEGIN(pt, pTask, Id)\
+    {\
+        uTaskPt_T *_pPt = (pt);\
+        if (_pPt->Flags & UTASK_PT_WAITING)\
+        {\
+            if ((Id) == _pPt->Wait)\
+            {\
+                if (_pPt->Flags & UTASK_PT_TIMED)\
+                {\
+                    uTaskMessageCancel((pTask), UTASK_PT_TIMEOUT);\
+                }\
+            }\
+            else if (!((_pPt->Flags & UTASK_PT_TIMED) &&\
+                       (Id) == UTASK_PT_TIMEOUT))\
+            {\
+                return;\
+            }\
+            _pPt->Flags = 0;\
+        }\
+        switch (_pPt->Lc)\
+        {\
+        case 0:
+
+/* End of the coroutine body, the next message starts it over */
+#define UTASK_PT_END(pt)\
+        }\
+        _pPt->Lc = 0;\
+    }
+
+/* Wait for a message with WaitId, from a task or an isr */
+#define UTASK_PT_WAIT_ID(pt, WaitId)\
+    do\
+    {\
+        (pt)->Wait = (WaitId);\
+        (pt)->Flags = UTASK_PT_WAITING;\
+        (pt)->Lc = __LINE__;\
+        return;\
+    case __LINE__:;\
+    } while (0)
+
+/*
+ * Wait for a message with WaitId for at most Time ticks, Id is
+ * UTASK_PT_TIMEOUT after the wait if it timed out.  If the timer cannot be
+ * sent the wait has no timeout.
+ */
+#define UTASK_PT_WAIT_ID_TIMEOUT(pt, pTask, WaitId, Time)\
+    do\
+    {\
+        (pt)->Wait = (WaitId);\
+        (pt)->Flags = UTASK_PT_WAITING;\
+        if (uTaskMessageSend((pTask), UTASK_PT_TIMEOUT, NULL, (Time)) ==\
+            UTASK_S_OK)\
+        {\
+            (pt)->Flags = UTASK_PT_WAITING | UTASK_PT_TIMED;\
+        }\
+        (pt)->Lc = __LINE__;\
+        return;\
+    case __LINE__:;\
+    } while (0)
+
+/* Wait Time ticks, skipped if the wake message cannot be sent */
+#define UTASK_PT_DELAY(pt, pTask, Time)\
+    do\
+    {\
+        if (uTaskMessageSend((pTask), UTASK_PT_WAKE, NULL, (Time)) ==\
+            UTASK_S_OK)\
+        {\
+            UTASK_PT_WAIT_ID((pt), UTASK_PT_WAKE);\
+        }\
+    } while (0)
+
+/* Let the other tasks run, then continue */
+#define UTASK_PT_YIELD(pt, pTask)\
+    UTASK_PT_DELAY((pt), (pTask), UTASK_IMMEDIATE)
+
+/* Leave the coroutine, the next message starts it over */
+#define UTASK_PT_EXIT(pt)\
+    do\
+    {\
+        (pt)->Lc = 0;\
+        return;\
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
 
 
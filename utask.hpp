@@ -0,0 +1,820 @@
+/*
+ * uTask C++ front-end
+ *
+ * Description:
+ * Header only C++ layer over the uTask C api's, see utask.h.  It adds
+ * nothing to the C side, everything here ends up in uTaskMessageSend and
+ * the handlers called by uTaskMessageLoop, so C++ and C tasks share one
+ * loop and one timer queue.
+ *
+ * Coroutines (C++20):
+ *
+ * utask::coro Blink(utask::task &Led)
+ * {
+ *     for ( ; ; )
+ *     {
+ *         LedOn();
+ *         co_await utask::sleep(100);
+ *         LedOff();
+ *
+ *         // Wait for the button isr, Msg.pMsg is valid until the next
+ *         // co_await
+ *         utask::message Msg = co_await Led.receive(BUTTON);
+ *     }
+ * }
+ *
+ * Coroutine frames come from uTaskAlloc, so they need a pool class or the
+ * UTASK_TLSF_SIZE region large enough for them, never the global heap.
+ * The compiler expects them aligned for any type new returns, so
+ * coroutines are only built when UTASK_POOL_ALIGN is at least
+ * __STDCPP_DEFAULT_NEW_ALIGNMENT__.
+ * A coroutine starts running when it is called and its frame is freed when
+ * it returns.
+ *
+ * Typed messages (C++14):
+ *
+ * struct Start { int Speed; };
+ * struct Stop { };
+ *
+ * class Motor : public utask::actor<Motor, Start, Stop>
+ * {
+ * public:
+ *     void on(const Start &Msg) { Run(Msg.Speed); }
+ *     void on(const Stop &) { Halt(); }
+ * };
+ *
+ * static Motor gMotor;
+ *
+ * utask::send<Start>(gMotor, 100);
+ * utask::send_after<Stop>(gMotor, utask::ms(500));
+ * utask::post([&] { gMotor.Log(); });
+ *
+ * The Id of a message is the index of its type in the actor's list, the
+ * payload is built in a pool block and destroyed after on() returns.  A
+ * message that is never handled, cancelled or still queued at uTaskDtor,
+ * is freed without its destructor, so payloads that own resources leak
+ * then.
+ */
+#ifndef UTASK_HPP
+#define UTASK_HPP
+
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "utask.h"
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L &&\
+    UTASK_POOL_ALIGN >= __STDCPP_DEFAULT_NEW_ALIGNMENT__
+#include <coroutine>
+#include <exception>
+#define UTASK_CORO_USE          1
+#else
+#define UTASK_CORO_USE          0
+#endif
+
+namespace utask
+{
+
+/* Convert milli seconds to ticks */
+constexpr unsigned long
+ms(
+    unsigned long   Ms
+    )
+{
+    return Ms * UTASK_TICKS_PER_SEC / 1000;
+}
+
+/* Largest pool block, and the alignment every pool block has */
+constexpr int
+pool_max_size()
+{
+    int Max = 0;
+
+    if (UTASK_POOL_COUNT1 && UTASK_POOL_SIZE1 > Max) Max = UTASK_POOL_SIZE1;
+    if (UTASK_POOL_COUNT2 && UTASK_POOL_SIZE2 > Max) Max = UTASK_POOL_SIZE2;
+    if (UTASK_POOL_COUNT3 && UTASK_POOL_SIZE3 > Max) Max = UTASK_POOL_SIZE3;
+    if (UTASK_POOL_COUNT4 && UTASK_POOL_SIZE4 > Max) Max = UTASK_POOL_SIZE4;
+
+    return Max;
+}
+
+/*
+ * utask.c sorts the pools by size when it starts, C++ builds keep the
+ * settings in that order so uTaskPoolStats numbers the pools as utask.h.
+ */
+constexpr bool
+pool_sorted()
+{
+    int Last = 0;
+
+    if (UTASK_POOL_COUNT1 && UTASK_POOL_SIZE1 < Last) return false;
+    if (UTASK_POOL_COUNT1) Last = UTASK_POOL_SIZE1;
+    if (UTASK_POOL_COUNT2 && UTASK_POOL_SIZE2 < Last) return false;
+    if (UTASK_POOL_COUNT2) Last = UTASK_POOL_SIZE2;
+    if (UTASK_POOL_COUNT3 && UTASK_POOL_SIZE3 < Last) return false;
+    if (UTASK_POOL_COUNT3) Last = UTASK_POOL_SIZE3;
+    if (UTASK_POOL_COUNT4 && UTASK_POOL_SIZE4 < Last) return false;
+
+    return true;
+}
+
+static_assert(pool_sorted(),
+              "UTASK_POOL_SIZE1 to UTASK_POOL_SIZE4 must not decrease");
+
+constexpr size_t pool_align =
+    UTASK_POOL_ALIGN ? (size_t)UTASK_POOL_ALIGN : alignof(void *);
+
+/* Alignment of the variable size region, utask.c gives it at least 8 */
+constexpr size_t tlsf_align = pool_align > 8 ? pool_align : 8;
+
+/* A payload of type T fits a pool block, or the variable size region */
+template <typename T>
+constexpr bool
+fits()
+{
+    return sizeof(T) <= (size_t)pool_max_size() ?
+               alignof(T) <= pool_align :
+               UTASK_TLSF_SIZE > 0 && alignof(T) <= tlsf_align;
+}
+
+namespace detail
+{
+
+/* A uTask_T for Handler, the executor fields zeroed when they exist */
+constexpr uTask_T
+make_task(
+    pfuTask         Handler
+    )
+{
+    uTask_T Task{};
+
+    Task.Handler = Handler;
+
+    return Task;
+}
+
+} /* namespace detail */
+
+/* Index of T in Ts, the message Id of T */
+template <typename T, typename... Ts>
+struct index_of;
+
+template <typename T, typename... Ts>
+struct index_of<T, T, Ts...> : std::integral_constant<int, 0> {};
+
+template <typename T, typename U, typename... Ts>
+struct index_of<T, U, Ts...>
+    : std::integral_constant<int, 1 + index_of<T, Ts...>::value> {};
+
+/*
+ * Base of a task with typed messages, Derived provides on(const Msg &) for
+ * each of Msgs.  The Id of each message is the index of its type in Msgs,
+ * dispatch indexes a table built at compile time, there are no virtual
+ * calls.  Messages must have a noexcept destructor, it only runs for
+ * messages that reach on().
+ */
+template <typename Derived, typename... Msgs>
+class actor
+{
+    static_assert(sizeof...(Msgs) > 0, "an actor needs a message type");
+
+public:
+    actor() noexcept = default;
+    actor(const actor &) = delete;
+    actor &operator=(const actor &) = delete;
+
+    uTask_T *handle() noexcept { return &m_Task.Task; }
+
+    template <typename Msg>
+    static constexpr int id = index_of<Msg, Msgs...>::value;
+
+private:
+    struct self
+    {
+        uTask_T         Task;
+        actor           *pOwner;
+    };
+
+    /* Call on() then destroy the payload, the loop frees the block */
+    template <typename Msg>
+    static void
+    Invoke(
+        Derived         &Owner,
+        void            *pMsg
+        )
+    {
+        Msg *p = static_cast<Msg *>(pMsg);
+
+        Owner.on(static_cast<const Msg &>(*p));
+        p->~Msg();
+    }
+
+    static void
+    Dispatch(
+        uTask_T         *pTask,
+        int             Id,
+        void            *pMsg
+        )
+    {
+        static constexpr void (*Table[])(Derived &, void *) = {
+            &actor::Invoke<Msgs>...
+        };
+
+        if (Id >= 0 && Id < (int)sizeof...(Msgs) && pMsg)
+        {
+            Table[Id](*static_cast<Derived *>(
+                          reinterpret_cast<self *>(pTask)->pOwner), pMsg);
+        }
+    }
+
+    self    m_Task = {detail::make_task(Dispatch), this};
+};
+
+namespace detail
+{
+
+/* Placement-new T, falling back to brace init for aggregates like Start{100} */
+template <typename T, typename... Args>
+T *
+make_with(std::true_type, void *pMem, Args &&... args)
+{
+    return new (pMem) T(std::forward<Args>(args)...);
+}
+
+template <typename T, typename... Args>
+T *
+make_with(std::false_type, void *pMem, Args &&... args)
+{
+    return new (pMem) T{std::forward<Args>(args)...};
+}
+
+template <typename T, typename... Args>
+T *
+make(void *pMem, Args &&... args)
+{
+    return make_with<T>(std::is_constructible<T, Args...>(), pMem,
+                        std::forward<Args>(args)...);
+}
+
+} /* namespace detail */
+
+namespace detail
+{
+
+/* Build a Msg in a pool block and send it on pCore, NULL for this thread's */
+template <typename Msg, typename Actor, typename... Args>
+bool
+send_on(
+    uTaskCore_T     *pCore,
+    Actor           &Target,
+    unsigned long   Time,
+    Args &&...      args
+    )
+{
+    static_assert(fits<Msg>(), "message does not fit any pool block");
+
+    void *pMem = uTaskAlloc((int)sizeof(Msg));
+    int Status;
+
+    if (pMem == NULL)
+    {
+        return false;
+    }
+
+    Msg *p = make<Msg>(pMem, std::forward<Args>(args)...);
+
+    if (pCore)
+    {
+        Status = uTaskCoreMessageSend(pCore, Target.handle(),
+                                      Actor::template id<Msg>, p, Time);
+    }
+    else
+    {
+        Status = uTaskMessageSend(Target.handle(), Actor::template id<Msg>, p,
+                                  Time);
+    }
+
+    if (Status != UTASK_S_OK)
+    {
+        p->~Msg();
+        uTaskFree(pMem);
+        return false;
+    }
+
+    return true;
+}
+
+} /* namespace detail */
+
+/*
+ * Build a Msg from Args in a pool block and send it to Actor after Time
+ * ticks.  Returns false, destroying the Msg, if no block or tcb is free.
+ */
+template <typename Msg, typename Actor, typename... Args>
+bool
+send_after(
+    Actor           &Target,
+    unsigned long   Time,
+    Args &&...      args
+    )
+{
+    return detail::send_on<Msg>(NULL, Target, Time, std::forward<Args>(args)...);
+}
+
+/* Build a Msg from Args in a pool block and send it to Actor now */
+template <typename Msg, typename Actor, typename... Args>
+bool
+send(
+    Actor           &Target,
+    Args &&...      args
+    )
+{
+    return send_after<Msg>(Target, UTASK_IMMEDIATE, std::forward<Args>(args)...);
+}
+
+namespace detail
+{
+
+/* Runs closures posted with post, each closure type has its own handler */
+template <typename F>
+struct closure
+{
+    static void
+    Run(
+        uTask_T         *pTask,
+        int             Id,
+        void            *pMsg
+        )
+    {
+        F *p = static_cast<F *>(pMsg);
+
+        (void)pTask;
+        (void)Id;
+
+        (*p)();
+        p->~F();
+    }
+
+    static uTask_T  Task;
+};
+
+template <typename F>
+uTask_T closure<F>::Task = make_task(Run);
+
+} /* namespace detail */
+
+/*
+ * Run a callable on the loop after Time ticks.  The closure is moved into
+ * a pool block, it is not type erased into a heap object, and is called
+ * and destroyed in place.  A closure that never runs is freed without its
+ * destructor, as with messages.  Returns false if no block or tcb is free.
+ */
+template <typename F>
+bool
+post_after(
+    unsigned long   Time,
+    F &&            Fn
+    )
+{
+    typedef typename std::decay<F>::type Fn_T;
+
+    static_assert(fits<Fn_T>(), "closure does not fit any pool block");
+
+    void *pMem = uTaskAlloc((int)sizeof(Fn_T));
+
+    if (pMem == NULL)
+    {
+        return false;
+    }
+
+    Fn_T *p = new (pMem) Fn_T(std::forward<F>(Fn));
+
+    if (uTaskMessageSend(&detail::closure<Fn_T>::Task, 0, p, Time) !=
+        UTASK_S_OK)
+    {
+        p->~Fn_T();
+        uTaskFree(pMem);
+        return false;
+    }
+
+    return true;
+}
+
+/* Run a callable on the loop */
+template <typename F>
+bool
+post(
+    F &&            Fn
+    )
+{
+    return post_after(UTASK_IMMEDIATE, std::forward<F>(Fn));
+}
+
+#if UTASK_CHAN_USE
+
+/*
+ * Channel of N items of T, the ring is part of the object.  Items are
+ * copied in and out with memcpy, so T must be trivially copyable.  The
+ * consumer gets Id with the channel as its message when the channel stops
+ * being empty and calls recv until it returns false.
+ */
+template <typename T, int N>
+class channel
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "channel items are copied with memcpy");
+    static_assert(N > 0, "a channel needs room for one item");
+
+public:
+    static constexpr int capacity = N;
+
+    channel(
+        uTask_T         *pTask,
+        int             Id
+        ) noexcept
+    {
+        uTaskChanInit(&m_Chan, m_Ring, (int)sizeof(T), N, pTask, Id);
+    }
+
+    channel(const channel &) = delete;
+    channel &operator=(const channel &) = delete;
+
+    bool send(const T &Item) noexcept
+    {
+        return uTaskChanSend(&m_Chan, &Item) == UTASK_S_OK;
+    }
+
+    bool recv(T &Item) noexcept
+    {
+        return uTaskChanRecv(&m_Chan, &Item) == UTASK_S_OK;
+    }
+
+    int size() noexcept { return uTaskChanCount(&m_Chan); }
+
+    uTaskChan_T *handle() noexcept { return &m_Chan; }
+
+private:
+    uTaskChan_T                         m_Chan;
+    alignas(T) unsigned char            m_Ring[sizeof(T) * N];
+};
+
+#endif
+
+/*
+ * Scheduler configuration, derive from it and redefine the members to tune
+ * a scheduler:
+ *
+ * struct fast : utask::config
+ * {
+ *     static constexpr int tcb_slots = 128;
+ *     static constexpr unsigned long ticks_per_sec = 10000;
+ * };
+ *
+ * tcb_slots        Task control blocks, the messages it can have queued.
+ * ticks_per_sec    Rate the owner calls tick() at, used by ms() and by
+ *                  sleep(Sched, Ms) in its coroutines.
+ * remote_sends     Other threads send to it, needs the intake queue.
+ *
+ * Message memory is not configured here, every scheduler shares the pools
+ * and the variable size region of utask.h.  The utask.h settings
+ * themselves are checked when utask.c is built.
+ */
+struct config
+{
+    static constexpr int            tcb_slots = UTASK_TCB_SLOTS;
+    static constexpr unsigned long  ticks_per_sec = UTASK_TICKS_PER_SEC;
+    static constexpr bool           remote_sends = false;
+};
+
+/*
+ * A uTaskCore_T instance with its task control blocks embedded, sized and
+ * checked at compile time from Config.  Several schedulers with different
+ * configurations can live in one program, each runs its own loop.  Message
+ * memory is not per scheduler, every scheduler allocates from the global
+ * pool and variable size region sized in utask.h, so sending needs
+ * uTaskCtor to have been called.
+ */
+template <typename Config = config>
+class scheduler
+{
+public:
+    static constexpr int tcb_slots = Config::tcb_slots;
+    static constexpr unsigned long ticks_per_sec = Config::ticks_per_sec;
+
+    static_assert(tcb_slots > 0, "a scheduler needs task control blocks");
+    static_assert(ticks_per_sec > 0 && ticks_per_sec <= 1000000,
+                  "ticks_per_sec must be between 1 and 1000000");
+    static_assert(!Config::remote_sends || UTASK_INTAKE_SIZE > 0,
+                  "remote_sends needs UTASK_INTAKE_SIZE");
+
+    scheduler() noexcept
+    {
+        uTaskCoreCtor(&m_Core, m_Tcb, tcb_slots);
+    }
+
+    /* Messages still queued are freed, their tcbs go away with us */
+    ~scheduler()
+    {
+        uTaskCoreDtor(&m_Core);
+        uTaskCoreFlush(&m_Core);
+    }
+
+    scheduler(const scheduler &) = delete;
+    scheduler &operator=(const scheduler &) = delete;
+
+    /* Convert milli seconds to this scheduler's ticks */
+    static constexpr unsigned long
+    ms(
+        unsigned long   Ms
+        )
+    {
+        return Ms * ticks_per_sec / 1000;
+    }
+
+    uTaskCore_T *core() noexcept { return &m_Core; }
+
+    void tick() noexcept { uTaskCoreTick(&m_Core); }
+    unsigned long now() noexcept { return uTaskCoreGetTick(&m_Core); }
+
+    /* Run the loop until stop() is called */
+    void run() noexcept { uTaskCoreMessageLoop(&m_Core); }
+    void stop() noexcept { uTaskCoreDtor(&m_Core); }
+
+    int
+    send(
+        uTask_T         *pTask,
+        int             Id,
+        void            *pMsg,
+        unsigned long   Time = UTASK_IMMEDIATE
+        ) noexcept
+    {
+        return uTaskCoreMessageSend(&m_Core, pTask, Id, pMsg, Time);
+    }
+
+    int
+    send_isr(
+        uTask_T         *pTask,
+        int             Id,
+        void            *pData
+        ) noexcept
+    {
+        return uTaskCoreMessageSendIsr(&m_Core, pTask, Id, pData);
+    }
+
+    int
+    cancel(
+        uTask_T         *pTask,
+        int             Id
+        ) noexcept
+    {
+        return uTaskCoreMessageCancel(&m_Core, pTask, Id);
+    }
+
+    /* Typed sends to an actor run by this scheduler */
+    template <typename Msg, typename Actor, typename... Args>
+    bool
+    send_after(
+        Actor           &Target,
+        unsigned long   Time,
+        Args &&...      args
+        )
+    {
+        return detail::send_on<Msg>(&m_Core, Target, Time,
+                                    std::forward<Args>(args)...);
+    }
+
+    template <typename Msg, typename Actor, typename... Args>
+    bool
+    send(
+        Actor           &Target,
+        Args &&...      args
+        )
+    {
+        return send_after<Msg>(Target, UTASK_IMMEDIATE,
+                               std::forward<Args>(args)...);
+    }
+
+    /* Bytes of scheduler state, all of it inside this object */
+    static constexpr size_t storage =
+        sizeof(uTaskCore_T) + tcb_slots * sizeof(uTaskTcb_T);
+
+private:
+    uTaskCore_T     m_Core;
+    uTaskTcb_T      m_Tcb[tcb_slots];
+};
+
+#if UTASK_CORO_USE
+
+/* Id that matches any message in task::receive */
+constexpr int any = -0x7FFF;
+
+/* The message that resumed a receive */
+struct message
+{
+    int     Id;
+    void    *pMsg;
+};
+
+/*
+ * Return type of a coroutine.  The coroutine runs until its first
+ * co_await when called, the caller does not own or resume it.  Converts
+ * to false if the frame could not be allocated and the coroutine never
+ * ran.
+ */
+class coro
+{
+public:
+    struct promise_type
+    {
+        static_assert(pool_align >= __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+                      "coroutine frames need UTASK_POOL_ALIGN of at least "
+                      "__STDCPP_DEFAULT_NEW_ALIGNMENT__");
+
+        static void *
+        operator new(
+            size_t          Size
+            ) noexcept
+        {
+            return uTaskAlloc((int)Size);
+        }
+
+        static void
+        operator delete(
+            void            *pMem
+            ) noexcept
+        {
+            uTaskFree(pMem);
+        }
+
+        static coro
+        get_return_object_on_allocation_failure() noexcept
+        {
+            return coro(false);
+        }
+
+        coro get_return_object() noexcept { return coro(true); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+
+    explicit operator bool() const noexcept { return m_Started; }
+
+private:
+    explicit coro(bool Started) noexcept : m_Started(Started) {}
+
+    bool m_Started;
+};
+
+/*
+ * Awaiter of sleep, it is its own uTask_T so the wake up is an ordinary
+ * message dispatched by the loop.  It lives in the coroutine frame while
+ * the coroutine is suspended.  sleep(Ms) counts UTASK_TICKS_PER_SEC ticks
+ * of this thread's instance, a coroutine run by a scheduler passes it,
+ * sleep(Sched, Ms), to wait on that scheduler's loop at its tick rate.
+ */
+class sleep
+{
+public:
+    explicit sleep(unsigned long Ms) noexcept : m_pCore(NULL), m_Ticks(ms(Ms)) {}
+
+    template <typename Config>
+    sleep(scheduler<Config> &Sched, unsigned long Ms) noexcept
+        : m_pCore(Sched.core()), m_Ticks(Sched.ms(Ms)) {}
+
+    sleep(const sleep &) = delete;
+    sleep &operator=(const sleep &) = delete;
+
+    bool await_ready() const noexcept { return false; }
+
+    /* If the message cannot be sent the coroutine continues at once */
+    bool
+    await_suspend(
+        std::coroutine_handle<> Handle
+        ) noexcept
+    {
+        m_Handle = Handle;
+
+        if (m_pCore)
+        {
+            return uTaskCoreMessageSend(m_pCore, &m_Task.Task, 0, NULL,
+                                        m_Ticks) == UTASK_S_OK;
+        }
+
+        return uTaskMessageSend(&m_Task.Task, 0, NULL, m_Ticks) == UTASK_S_OK;
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    /* Standard layout, the uTask_T is first so the handler finds us */
+    struct wake
+    {
+        uTask_T         Task;
+        sleep           *pSleep;
+    };
+
+    static void
+    Wake(
+        uTask_T         *pTask,
+        int             Id,
+        void            *pMsg
+        )
+    {
+        (void)Id;
+        (void)pMsg;
+        reinterpret_cast<wake *>(pTask)->pSleep->m_Handle.resume();
+    }
+
+    uTaskCore_T                 *m_pCore;
+    unsigned long               m_Ticks;
+    std::coroutine_handle<>     m_Handle;
+    wake                        m_Task = {detail::make_task(Wake), this};
+};
+
+/*
+ * A uTask_T whose messages resume a coroutine waiting in receive.  Other
+ * code sends to it with uTaskMessageSend(Task.handle(), ...) or from an
+ * isr with uTaskMessageSendIsr.  One coroutine may wait on a task at a
+ * time, messages that arrive while none waits for their Id are ignored
+ * and freed by the loop as usual.
+ */
+class task
+{
+public:
+    task() noexcept = default;
+    task(const task &) = delete;
+    task &operator=(const task &) = delete;
+
+    uTask_T *handle() noexcept { return &m_Task.Task; }
+
+    class receiver
+    {
+    public:
+        bool await_ready() const noexcept { return false; }
+
+        void
+        await_suspend(
+            std::coroutine_handle<> Handle
+            ) noexcept
+        {
+            m_pOwner->m_Handle = Handle;
+            m_pOwner->m_Wait = m_Id;
+        }
+
+        message await_resume() const noexcept { return m_pOwner->m_Msg; }
+
+    private:
+        friend class task;
+
+        receiver(task *pOwner, int Id) noexcept : m_pOwner(pOwner), m_Id(Id) {}
+
+        task    *m_pOwner;
+        int     m_Id;
+    };
+
+    /* Wait for the next message with Id, or any message with utask::any */
+    receiver receive(int Id = any) noexcept { return receiver(this, Id); }
+
+private:
+    struct self
+    {
+        uTask_T         Task;
+        task            *pOwner;
+    };
+
+    static void
+    Dispatch(
+        uTask_T         *pTask,
+        int             Id,
+        void            *pMsg
+        )
+    {
+        task *pOwner = reinterpret_cast<self *>(pTask)->pOwner;
+        std::coroutine_handle<> Handle = pOwner->m_Handle;
+
+        if (!Handle || (pOwner->m_Wait != any && pOwner->m_Wait != Id))
+        {
+            return;
+        }
+
+        pOwner->m_Handle = nullptr;
+        pOwner->m_Msg.Id = Id;
+        pOwner->m_Msg.pMsg = pMsg;
+
+        Handle.resume();
+    }
+
+    self                        m_Task = {detail::make_task(Dispatch), this};
+    std::coroutine_handle<>     m_Handle;
+    int                         m_Wait = any;
+    message                     m_Msg = {0, NULL};
+};
+
+#endif
+
+} /* namespace utask */
+
+#endif